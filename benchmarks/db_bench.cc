@@ -4,17 +4,22 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -39,6 +44,9 @@
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      filterlookup  -- N lookups of absent keys in a filter over N keys
+//      cachelookup   -- N random lookups in the block cache, inserting
+//                       4K entries on a miss (requires --cache_size)
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -98,10 +106,36 @@ static int FLAGS_max_file_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// If true, give data blocks a hash index for point lookups.
+static bool FLAGS_data_block_hash_index = false;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// If true, use NewClockCache() instead of NewLRUCache() for --cache_size.
+static bool FLAGS_clock_cache = false;
+
+// Number of bits of the LRU cache's shard count.
+static int FLAGS_cache_numshardbits = 4;
+
+// Number of bytes to use as a cache of compressed data.
+// Negative means no such cache.
+static int FLAGS_compressed_cache_size = -1;
+
+// Number of bytes to use as a persistent cache of blocks in
+// --persistent_cache_dir.  Zero or negative means no such cache.
+static int FLAGS_persistent_cache_size = 0;
+
+// Directory of the persistent cache.
+static const char* FLAGS_persistent_cache_dir = nullptr;
+
+// Bytes that readseq and readreverse iterators read ahead (0 = automatic).
+static int FLAGS_readahead_size = 0;
+
+// Bytes that compactions read ahead of their inputs.
+static int FLAGS_compaction_readahead_size = 0;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -109,6 +143,13 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, use NewCacheLocalBloomFilterPolicy() for --bloom_bits.
+static bool FLAGS_cache_local_bloom = false;
+
+// If non-negative, use NewBinaryFuseFilterPolicy() with this many bits per
+// fingerprint instead of a bloom filter.
+static int FLAGS_fuse_filter_bits = -1;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -123,6 +164,18 @@ static bool FLAGS_reuse_logs = false;
 // If true, use compression.
 static bool FLAGS_compression = true;
 
+// If true, pipeline logging and memtable insertion of write groups.
+static bool FLAGS_pipelined_write = false;
+
+// If true, writers of a write group insert into the memtable in parallel.
+static bool FLAGS_concurrent_memtable_write = false;
+
+// Maximum number of key-range shards per compaction.
+static int FLAGS_max_subcompactions = 0;
+
+// Limit on flush and compaction writes in bytes per second (0 = none).
+static int FLAGS_rate_limiter_bytes_per_sec = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -425,10 +478,36 @@ void Uncompress(
 
 }  // namespace
 
+// Returns the block cache selected by the flags, or nullptr.
+static Cache* NewCacheFromFlags() {
+  if (FLAGS_cache_size < 0) {
+    return nullptr;
+  }
+  return FLAGS_clock_cache
+             ? NewClockCache(FLAGS_cache_size)
+             : NewLRUCache(FLAGS_cache_size, FLAGS_cache_numshardbits, false);
+}
+
+// Returns the filter policy selected by the flags, or nullptr.
+static const FilterPolicy* NewFilterPolicyFromFlags() {
+  if (FLAGS_fuse_filter_bits >= 0) {
+    return NewBinaryFuseFilterPolicy(FLAGS_fuse_filter_bits);
+  }
+  if (FLAGS_bloom_bits < 0) {
+    return nullptr;
+  }
+  return FLAGS_cache_local_bloom
+             ? NewCacheLocalBloomFilterPolicy(FLAGS_bloom_bits)
+             : NewBloomFilterPolicy(FLAGS_bloom_bits);
+}
+
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  PersistentCache* persistent_cache_;
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -519,10 +598,16 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(NewCacheFromFlags()),
+        compressed_cache_(FLAGS_compressed_cache_size >= 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
+        persistent_cache_(nullptr),
+        filter_policy_(NewFilterPolicyFromFlags()),
+        rate_limiter_(FLAGS_rate_limiter_bytes_per_sec > 0
+                          ? NewGenericRateLimiter(
+                                FLAGS_rate_limiter_bytes_per_sec)
+                          : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -541,12 +626,27 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_persistent_cache_size > 0) {
+      std::string dir = FLAGS_persistent_cache_dir != nullptr
+                            ? FLAGS_persistent_cache_dir
+                            : std::string(FLAGS_db) + "_pcache";
+      Status s = NewFilePersistentCache(g_env, dir, FLAGS_persistent_cache_size,
+                                        &persistent_cache_);
+      if (!s.ok()) {
+        std::fprintf(stderr, "persistent cache error: %s\n",
+                     s.ToString().c_str());
+        std::exit(1);
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete persistent_cache_;
     delete filter_policy_;
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -631,6 +731,10 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("filterlookup")) {
+        method = &Benchmark::FilterLookup;
+      } else if (name == Slice("cachelookup")) {
+        method = &Benchmark::CacheLookup;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -772,6 +876,86 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  static void DeleteCacheValue(const Slice& key, void* value) {}
+
+  void CacheLookup(ThreadState* thread) {
+    if (cache_ == nullptr) {
+      thread->stats.AddMessage("(requires --cache_size)");
+      return;
+    }
+    // Keys look like block cache keys: a cache id and an offset.  There
+    // are a few more keys than fit in the cache, so about 10% of lookups
+    // miss and insert.
+    const int kCharge = 4096;
+    const int range = std::max(1, FLAGS_cache_size / kCharge * 10 / 9);
+    char key[16];
+    int hits = 0;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(range);
+      EncodeFixed64(key, 1);
+      EncodeFixed64(key + 8, static_cast<uint64_t>(k) * kCharge);
+      Cache::Handle* handle = cache_->Lookup(Slice(key, sizeof(key)));
+      if (handle != nullptr) {
+        hits++;
+      } else {
+        handle = cache_->Insert(Slice(key, sizeof(key)), nullptr, kCharge,
+                                &DeleteCacheValue);
+      }
+      cache_->Release(handle);
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", hits, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void FilterLookup(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(requires --bloom_bits or --fuse_filter_bits)");
+      return;
+    }
+    // Build all keys up front so that formatting them is not measured.
+    KeyBuffer key;
+    std::string added;
+    for (int i = 0; i < num_; i++) {
+      key.Set(i);
+      added.append(key.slice().data(), key.slice().size());
+    }
+    const size_t key_size = key.slice().size();
+    std::vector<Slice> keys;
+    for (int i = 0; i < num_; i++) {
+      keys.push_back(Slice(added.data() + i * key_size, key_size));
+    }
+    std::string filter;
+    const uint64_t build_start = g_env->NowMicros();
+    filter_policy_->CreateFilter(keys.data(), num_, &filter);
+    const double build_micros = g_env->NowMicros() - build_start;
+
+    std::string absent;
+    for (int i = 0; i < reads_; i++) {
+      key.Set(num_ + thread->rand.Uniform(num_));
+      absent.append(key.slice().data(), key.slice().size());
+    }
+
+    thread->stats.Start();
+    int matches = 0;
+    for (int i = 0; i < reads_; i++) {
+      if (filter_policy_->KeyMayMatch(
+              Slice(absent.data() + i * key_size, key_size), filter)) {
+        matches++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg),
+                  "(%.2f%% false positives, %.2f bits/key, built in %.3f "
+                  "micros/key)",
+                  matches * 100.0 / std::max(reads_, 1),
+                  filter.size() * 8.0 / std::max(num_, 1),
+                  build_micros / std::max(num_, 1));
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     Compress(thread, "snappy", &port::Snappy_Compress);
   }
@@ -805,15 +989,23 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.block_cache_compressed = compressed_cache_;
+    options.persistent_cache = persistent_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_pipelined_write;
+    options.allow_concurrent_memtable_write = FLAGS_concurrent_memtable_write;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.compaction_readahead_size = FLAGS_compaction_readahead_size;
+    options.rate_limiter = rate_limiter_;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
     Status s = DB::Open(options, FLAGS_db, &db_);
@@ -866,7 +1058,9 @@ class Benchmark {
   }
 
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -879,7 +1073,9 @@ class Benchmark {
   }
 
   void ReadReverse(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
@@ -1066,6 +1262,9 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
+  FLAGS_compaction_readahead_size =
+      leveldb::Options().compaction_readahead_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
@@ -1093,6 +1292,20 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_write = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1) {
+      FLAGS_readahead_size = n;
+    } else if (sscanf(argv[i], "--compaction_readahead_size=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_compaction_readahead_size = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1107,14 +1320,40 @@ int main(int argc, char** argv) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
+    } else if (sscanf(argv[i], "--rate_limiter_bytes_per_sec=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_rate_limiter_bytes_per_sec = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (sscanf(argv[i], "--cache_numshardbits=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_cache_numshardbits = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--cache_local_bloom=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_local_bloom = n;
+    } else if (sscanf(argv[i], "--fuse_filter_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_fuse_filter_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--persistent_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_persistent_cache_size = n;
+    } else if (strncmp(argv[i], "--persistent_cache_dir=", 23) == 0) {
+      FLAGS_persistent_cache_dir = argv[i] + 23;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -6,12 +6,14 @@
 
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 // implement build table
@@ -26,28 +28,54 @@ namespace leveldb {
 // - after add all the key value data into database. you need to flush the file
 // and sync.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   meta->file_size = 0;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
+  const bool has_range_deletions =
+      range_del_iter != nullptr && range_del_iter->Valid();
   std::string fileName = TableFileName(dbname, meta->number);
   Status s;
-  if (iter->Valid()) {
+  if (iter->Valid() || has_range_deletions) {
     // open a file
     WritableFile* file;
-    s = env->NewWritableFile(fileName, &file);
+    if (options.use_direct_io_for_flush_and_compaction) {
+      s = env->NewDirectWritableFile(fileName, &file);
+    } else {
+      s = env->NewWritableFile(fileName, &file);
+    }
     if (!s.ok()) {
       return s;
     }
+    file = NewRateLimitedWritableFile(file, options.rate_limiter,
+                                      Env::kHighPriority);
     // build a table build for write key value into file
     TableBuilder* builder = new TableBuilder(options, file);
     // we need to set the meta data
-    meta->smallest.DecodeFrom(iter->key());
+    bool has_bounds = iter->Valid();
+    if (has_bounds) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       Slice value = iter->value();
       builder->Add(key, value);
       meta->largest.DecodeFrom(key);
     }
+    // The file's key range must include its tombstones so that reads and
+    // compactions of the deleted range find them.
+    meta->has_range_deletions = has_range_deletions;
+    for (; has_range_deletions && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      Slice key = range_del_iter->key();
+      Slice value = range_del_iter->value();
+      builder->AddRangeTombstone(key, value);
+      ExtendBoundsForTombstone(options.comparator, key, value, &has_bounds,
+                               &meta->smallest, &meta->largest);
+    }
     s = builder->Finish();
     if (s.ok()) {
       meta->file_size = builder->FileSize();
@@ -66,7 +94,7 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     if (s.ok()) {
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+                                              meta->file_size, 0);
       s = it->status();
       delete it;
     }
@@ -75,6 +103,8 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   // Check for input iterator errors
   if (!iter->status().ok()) {
     s = iter->status();
+  } else if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
   }
 
   if (s.ok() && meta->file_size > 0) {
@@ -11,6 +11,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -22,8 +23,10 @@
 #include <string>
 #include <vector>
 
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -35,6 +38,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
@@ -43,21 +47,42 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        exclusive(false),
+        last_sequence(0),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  bool exclusive;  // Never joins a batch group (see IngestExternalFile)
+  SequenceNumber last_sequence;  // Last sequence of the group (pipelined)
+  Writer* leader;       // Non-null while asked to insert into the memtable
+  int pending_inserts;  // Followers still inserting (group leader only)
   port::CondVar cv;
 };
 
+struct DBImpl::ExternalFile {
+  std::string path;
+  uint64_t file_size;
+  std::string smallest;  // Smallest user key
+  std::string largest;   // Largest user key
+  uint64_t temp_number;  // Of the copy or link in the database directory
+  uint64_t number;       // Assigned when the file is installed, else 0
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -65,6 +90,11 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        begin(nullptr),
+        end(nullptr),
+        range_del(nullptr),
+        output_range_del(nullptr),
+        has_output_lower(false),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -77,6 +107,25 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // When the compaction is split into shards, this state only handles
+  // user keys in [*begin, *end).  nullptr means unbounded.
+  const Slice* begin;
+  const Slice* end;
+
+  // Range tombstones of the compaction inputs, used to drop the entries
+  // they hide, and the subset of them that must be kept in the outputs.
+  // Owned by DoCompactionWork(); nullptr if there are none.
+  const RangeDelAggregator* range_del;
+  const RangeDelAggregator* output_range_del;
+
+  // Start of the key space of the current output, to which its share of
+  // the tombstones is clipped; unbounded while has_output_lower is false.
+  std::string output_lower;
+  bool has_output_lower;
+
+  // Progress of this state's outputs through the key space
+  Compaction::Cursor cursor;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -103,6 +152,17 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.level0_file_num_compaction_trigger, 1, 1 << 20);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              result.level0_file_num_compaction_trigger, 1 << 20);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1 << 20);
+  ClipToRange(&result.max_mem_compaction_level, 0, config::kNumLevels - 2);
+  ClipToRange(&result.max_bytes_for_level_base, uint64_t{64} << 10,
+              uint64_t{1} << 40);
+  ClipToRange(&result.max_bytes_for_level_multiplier, 1.0, 1000.0);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.max_background_jobs, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -127,7 +187,8 @@ static int TableCacheSize(const Options& sanitized_options) {
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -145,16 +206,28 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      write_controller_(options_.delayed_write_rate),
+      last_compaction_debt_(0),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
       manual_compaction_(nullptr),
+      manifest_write_in_progress_(false),
+      manifest_write_finished_signal_(&mutex_),
+      ingest_in_progress_(false),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)) {
+  if (HasFlushJob()) {
+    env_->SetBackgroundThreads(1, Env::kHighPriority);
+    env_->SetBackgroundThreads(MaxBackgroundCompactions(), Env::kLowPriority);
+  }
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 ||
+         background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -510,20 +583,22 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 // are
 //  part of ongoing compactions.
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del_iter,
+                   &meta);
     mutex_.Lock();
   }
 
@@ -531,7 +606,13 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
+  if (file_number != nullptr) {
+    // The caller installs *edit and releases the file afterwards.
+    *file_number = meta.number;
+  } else {
+    pending_outputs_.erase(meta.number);
+  }
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -543,7 +624,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, meta.has_range_deletions);
   }
 
   CompactionStats stats;
@@ -561,7 +642,8 @@ void DBImpl::CompactMemTable() {
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t file_number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &file_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -572,8 +654,9 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(file_number);
 
   if (s.ok()) {
     // Commit to the new state
@@ -603,6 +686,347 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+// Returns true if the key span of "mem", including its range tombstones,
+// overlaps [smallest,largest].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+  bool overlaps = false;
+  Iterator* iter = mem->NewIterator();
+  iter->SeekToFirst();
+  if (iter->Valid() &&
+      ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0) {
+    iter->SeekToLast();
+    overlaps = ucmp->Compare(ExtractUserKey(iter->key()), smallest) >= 0;
+  }
+  delete iter;
+
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); iter->Valid() && !overlaps; iter->Next()) {
+      overlaps = ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0 &&
+                 ucmp->Compare(iter->value(), smallest) > 0;
+    }
+    delete iter;
+  }
+  return overlaps;
+}
+
+// Flush the contents of the existing file "fname" to stable storage.
+static Status SyncFile(Env* env, const std::string& fname) {
+  WritableFile* file;
+  Status s = env->NewAppendableFile(fname, &file);
+  if (s.ok()) {
+    s = file->Sync();
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+  }
+  return s;
+}
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& target) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(target, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, buffer);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+  }
+  delete[] buffer;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->RemoveFile(target);
+  }
+  return s;
+}
+
+Status DBImpl::ReadExternalFile(ExternalFile* file) {
+  file->number = 0;
+  RandomAccessFile* raf = nullptr;
+  Table* table = nullptr;
+  Status s = env_->GetFileSize(file->path, &file->file_size);
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(file->path, &raf);
+  }
+  if (s.ok()) {
+    s = Table::Open(IngestedTableOptions(options_), raf, file->file_size,
+                    &table);
+  }
+  if (s.ok()) {
+    Iterator* tombstones = table->NewRangeTombstoneIterator();
+    if (tombstones != nullptr) {
+      delete tombstones;
+      s = Status::InvalidArgument(file->path, "holds range tombstones");
+    }
+  }
+  if (s.ok()) {
+    // Read the whole file once: this checks its checksums and that its
+    // keys are in the order of our comparator.
+    ReadOptions options;
+    options.verify_checksums = true;
+    options.fill_cache = false;
+    Iterator* iter = table->NewIterator(options);
+    const Comparator* ucmp = user_comparator();
+    bool empty = true;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      const Slice key = iter->key();
+      if (empty) {
+        file->smallest.assign(key.data(), key.size());
+        empty = false;
+      } else if (ucmp->Compare(file->largest, key) >= 0) {
+        s = Status::InvalidArgument(file->path,
+                                    "keys are not in increasing order");
+        break;
+      }
+      file->largest.assign(key.data(), key.size());
+    }
+    if (s.ok()) {
+      s = iter->status();
+    }
+    if (s.ok() && empty) {
+      s = Status::InvalidArgument(file->path, "is empty");
+    }
+    delete iter;
+  }
+  delete table;
+  delete raf;
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const std::vector<std::string>& paths,
+                                  const IngestExternalFileOptions& options) {
+  const Comparator* ucmp = user_comparator();
+  std::vector<ExternalFile> files(paths.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    files[i].path = paths[i];
+    s = ReadExternalFile(&files[i]);
+  }
+  if (!s.ok() || files.empty()) {
+    return s;
+  }
+  std::sort(files.begin(), files.end(),
+            [ucmp](const ExternalFile& a, const ExternalFile& b) {
+              return ucmp->Compare(a.smallest, b.smallest) < 0;
+            });
+  for (size_t i = 1; i < files.size(); i++) {
+    if (ucmp->Compare(files[i - 1].largest, files[i].smallest) >= 0) {
+      return Status::InvalidArgument(files[i].path,
+                                     "overlaps another ingested file");
+    }
+  }
+
+  // Bring the files into the database directory under temporary names.
+  // They are numbered for good once writes are held back, since a level-0
+  // table must be numbered after every table holding older entries.
+  {
+    MutexLock l(&mutex_);
+    for (ExternalFile& f : files) {
+      f.temp_number = versions_->NewFileNumber();
+      pending_outputs_.insert(f.temp_number);
+    }
+  }
+  // A hard link shares the caller's file, so it is only used when the
+  // caller gives the file up.  Either way the data must be durable before
+  // the manifest refers to it.
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    const std::string temp = TempFileName(dbname_, files[i].temp_number);
+    if (options.move_files && env_->LinkFile(files[i].path, temp).ok()) {
+      s = SyncFile(env_, temp);
+    } else {
+      s = CopyFile(env_, files[i].path, temp);
+    }
+  }
+
+  MutexLock l(&mutex_);
+  if (s.ok()) {
+    Writer w(&mutex_);
+    w.exclusive = true;
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+      w.cv.Wait();
+    }
+    // Pipelined writes may still be applying logged groups.
+    while (!memtable_writers_.empty()) {
+      w.cv.Wait();
+    }
+    ingest_in_progress_ = true;
+    s = InstallExternalFiles(&files);
+    ingest_in_progress_ = false;
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+  }
+
+  for (const ExternalFile& f : files) {
+    pending_outputs_.erase(f.temp_number);
+    pending_outputs_.erase(f.number);
+    if (s.ok()) {
+      if (options.move_files) {
+        env_->RemoveFile(f.path);
+      }
+    } else {
+      env_->RemoveFile(TempFileName(dbname_, f.temp_number));
+      if (f.number != 0) {
+        env_->RemoveFile(TableFileName(dbname_, f.number));
+      }
+    }
+  }
+  MaybeScheduleCompaction();
+  return s;
+}
+
+Status DBImpl::InstallExternalFiles(std::vector<ExternalFile>* files) {
+  mutex_.AssertHeld();
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+
+  // Entries in the memtables are older than the ingested ones but would
+  // be found first, so flush any memtable that might hold such keys.
+  // Their span matters, not just their keys: a flush may place its table
+  // in a level below level-0.
+  const Comparator* ucmp = user_comparator();
+  const Slice smallest = files->front().smallest;
+  const Slice largest = files->back().largest;
+  Status s;
+  if (MemTableOverlaps(mem_, ucmp, smallest, largest)) {
+    s = MakeRoomForWrite(/*force=*/true);
+  }
+  while (s.ok() && imm_ != nullptr &&
+         MemTableOverlaps(imm_, ucmp, smallest, largest)) {
+    if (!bg_error_.ok()) {
+      s = bg_error_;
+    } else {
+      background_work_finished_signal_.Wait();
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  // All ingested entries share one sequence number, newer than any entry
+  // written so far.
+  const SequenceNumber seq = versions_->LastSequence() + 1;
+  Version* current = versions_->current();
+  VersionEdit edit;
+  std::string summary;
+  for (ExternalFile& f : *files) {
+    f.number = versions_->NewFileNumber();
+    pending_outputs_.insert(f.number);
+    s = env_->RenameFile(TempFileName(dbname_, f.temp_number),
+                         TableFileName(dbname_, f.number));
+    if (!s.ok()) {
+      break;
+    }
+    const int level = current->PickLevelForIngestedFile(f.smallest, f.largest);
+    edit.AddFile(level, f.number, f.file_size,
+                 InternalKey(f.smallest, seq, kTypeValue),
+                 InternalKey(f.largest, seq, kTypeValue),
+                 /*has_range_deletions=*/false, seq);
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), " #%llu@%d",
+                  static_cast<unsigned long long>(f.number), level);
+    summary.append(buf);
+  }
+  if (s.ok()) {
+    versions_->SetLastSequence(seq);
+    s = LogAndApply(&edit);
+  }
+  Log(options_.info_log, "Ingested%s at seq %llu: %s\n", summary.c_str(),
+      static_cast<unsigned long long>(seq), s.ToString().c_str());
+  return s;
+}
+
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  InternalKey begin_storage, end_storage;
+  InternalKey* begin_key = nullptr;
+  InternalKey* end_key = nullptr;
+  if (begin != nullptr) {
+    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    begin_key = &begin_storage;
+  }
+  if (end != nullptr) {
+    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
+    end_key = &end_storage;
+  }
+  const Comparator* ucmp = user_comparator();
+
+  MutexLock l(&mutex_);
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+  Version* base = versions_->current();
+  VersionEdit edit;
+  std::vector<FileMetaData*> deleted;
+  uint64_t deleted_bytes = 0;
+  // Level-0 files overlap one another and hold the newest data, so they
+  // are left to compaction.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    base->GetOverlappingInputs(level, begin_key, end_key, &files);
+    for (FileMetaData* f : files) {
+      if (f->being_compacted ||
+          (begin != nullptr &&
+           ucmp->Compare(f->smallest.user_key(), *begin) < 0) ||
+          (end != nullptr && ucmp->Compare(f->largest.user_key(), *end) > 0)) {
+        continue;
+      }
+      edit.RemoveFile(level, f->number);
+      deleted.push_back(f);
+      deleted_bytes += f->file_size;
+    }
+  }
+  if (deleted.empty()) {
+    return Status::OK();
+  }
+
+  // LogAndApply() may release the mutex; keep compactions off the files
+  // in the meantime.  Once it installs the new version "base" may be its
+  // last owner, so pin it until the flags are cleared.
+  base->Ref();
+  for (FileMetaData* f : deleted) {
+    f->being_compacted = true;
+  }
+  Status s = LogAndApply(&edit);
+  for (FileMetaData* f : deleted) {
+    f->being_compacted = false;
+  }
+  base->Unref();
+  Log(options_.info_log, "Deleted %d files in range (%lld bytes): %s\n",
+      static_cast<int>(deleted.size()),
+      static_cast<long long>(deleted_bytes), s.ToString().c_str());
+  if (s.ok()) {
+    RemoveObsoleteFiles();
+    MaybeScheduleCompaction();
+  }
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
@@ -666,20 +1090,55 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_write_in_progress_) {
+    manifest_write_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  manifest_write_finished_signal_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    return;
+  }
+
+  if (HasFlushJob()) {
+    if (imm_ != nullptr && !background_flush_scheduled_) {
+      background_flush_scheduled_ = true;
+      env_->ScheduleWithPriority(&DBImpl::BGFlush, this, Env::kHighPriority);
+    }
+  }
+
+  if (manual_compaction_ != nullptr) {
+    // A manual compaction runs on its own, once every other compaction
+    // has finished.
+    if (background_compactions_scheduled_ == 0) {
+      background_compactions_scheduled_++;
+      env_->ScheduleWithPriority(&DBImpl::BGWork, this, Env::kLowPriority);
+    }
+    return;
+  }
+  // Each job picks its own compaction.  A job that finds every needed
+  // compaction blocked by running ones simply exits; the next one to
+  // finish schedules more work.
+  while (background_compactions_scheduled_ < MaxBackgroundCompactions() &&
+         ((!HasFlushJob() && imm_ != nullptr) ||
+          versions_->NeedsCompaction())) {
+    background_compactions_scheduled_++;
+    env_->ScheduleWithPriority(&DBImpl::BGWork, this, Env::kLowPriority);
+    if (!HasFlushJob() && imm_ != nullptr) {
+      break;
+    }
   }
 }
 
@@ -687,37 +1146,72 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    did_work = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
   // so reschedule another compaction if needed.
+  if (did_work) {
+    MaybeScheduleCompaction();
+  }
+  background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
   MaybeScheduleCompaction();
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
+  if (imm_ != nullptr && !HasFlushJob()) {
     CompactMemTable();
-    return;
+    return true;
+  }
+  if (ingest_in_progress_) {
+    // The files being ingested are not in the current version yet, so a
+    // compaction picked now could write outputs that overlap them.
+    // IngestExternalFile() schedules compactions again when done.
+    return false;
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
-  if (is_manual) {
+  if (is_manual && background_compactions_scheduled_ > 1) {
+    // Other compactions are still running.  The last of them will
+    // schedule the manual compaction.
+    return false;
+  } else if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
@@ -734,6 +1228,7 @@ void DBImpl::BackgroundCompaction() {
   }
 
   Status status;
+  const bool did_work = (c != nullptr || is_manual);
   if (c == nullptr) {
     // Nothing to do
   } else if (!is_manual && c->IsTrivialMove()) {
@@ -742,8 +1237,8 @@ void DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+                       f->largest, f->has_range_deletions, f->global_seqno);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -785,6 +1280,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return did_work;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -816,38 +1312,70 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s;
+  if (options_.use_direct_io_for_flush_and_compaction) {
+    s = env_->NewDirectWritableFile(fname, &compact->outfile);
+  } else {
+    s = env_->NewWritableFile(fname, &compact->outfile);
+  }
   if (s.ok()) {
+    compact->outfile = NewRateLimitedWritableFile(
+        compact->outfile, options_.rate_limiter, Env::kLowPriority);
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
   return s;
 }
 
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* upper) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
+  // Store the tombstones covering this output's share of the key space,
+  // [output_lower, *upper), widening its key range to match.
+  if (compact->output_range_del != nullptr) {
+    std::vector<RangeTombstone> tombstones;
+    const Slice lower(compact->output_lower);
+    compact->output_range_del->GetClipped(
+        compact->has_output_lower ? &lower : nullptr, upper, &tombstones);
+    bool has_bounds = compact->builder->NumEntries() > 0;
+    for (const RangeTombstone& t : tombstones) {
+      InternalKey start(t.begin, t.seq, kTypeRangeDeletion);
+      compact->builder->AddRangeTombstone(start.Encode(), t.end);
+      ExtendBoundsForTombstone(&internal_comparator_, start.Encode(), t.end,
+                               &has_bounds, &out->smallest, &out->largest);
+    }
+    out->has_range_deletions = !tombstones.empty();
+  }
+  if (upper != nullptr) {
+    compact->output_lower.assign(upper->data(), upper->size());
+    compact->has_output_lower = true;
+  }
+
   // Check for iterator errors
   Status s = input->status();
-  const uint64_t current_entries = compact->builder->NumEntries();
+  const uint64_t current_entries = compact->builder->NumEntries() +
+                                   compact->builder->NumRangeTombstones();
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
   }
   const uint64_t current_bytes = compact->builder->FileSize();
-  compact->current_output()->file_size = current_bytes;
+  out->file_size = current_bytes;
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = nullptr;
@@ -864,8 +1392,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+    Iterator* iter = table_cache_->NewIterator(ReadOptions(), output_number,
+                                               current_bytes, 0);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -878,6 +1406,51 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+Status DBImpl::GetCompactionTombstones(CompactionState* compact,
+                                       RangeDelAggregator** range_del,
+                                       RangeDelAggregator** output_range_del) {
+  *range_del = nullptr;
+  *output_range_del = nullptr;
+  Compaction* const c = compact->compaction;
+  RangeDelAggregator* all = new RangeDelAggregator(user_comparator());
+  Status s;
+  for (int which = 0; which < 2 && s.ok(); which++) {
+    for (int i = 0; i < c->num_input_files(which) && s.ok(); i++) {
+      const FileMetaData* f = c->input(which, i);
+      if (f->has_range_deletions) {
+        s = table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                             kMaxSequenceNumber, all);
+      }
+    }
+  }
+  all->Finish();
+  if (!s.ok() || all->empty()) {
+    delete all;
+    return s;
+  }
+
+  // A tombstone that every snapshot can see has done its job once the
+  // entries it hides are dropped here, unless older entries it hides
+  // remain in the levels below the output.
+  std::vector<RangeTombstone> tombstones;
+  all->GetClipped(nullptr, nullptr, &tombstones);
+  RangeDelAggregator* kept = new RangeDelAggregator(user_comparator());
+  for (const RangeTombstone& t : tombstones) {
+    if (t.seq > compact->smallest_snapshot ||
+        !c->IsBaseLevelForRange(t.begin, t.end)) {
+      kept->Add(t.begin, t.end, t.seq);
+    }
+  }
+  kept->Finish();
+  if (kept->empty()) {
+    delete kept;
+    kept = nullptr;
+  }
+  *range_del = all;
+  *output_range_del = kept;
+  return s;
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
@@ -891,43 +1464,55 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+                                         out.smallest, out.largest,
+                                         out.has_range_deletions);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
-Status DBImpl::DoCompactionWork(CompactionState* compact) {
-  const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+// One key-range shard of a compaction
+struct DBImpl::Subcompaction {
+  DBImpl* db;
+  CompactionState* compact;
+  Iterator* input;
+  Status status;
+  int* remaining;  // Shards still running, guarded by db->mutex_
+};
 
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+void DBImpl::BGSubcompaction(void* arg) {
+  Subcompaction* sub = reinterpret_cast<Subcompaction*>(arg);
+  DBImpl* db = sub->db;
+  sub->status = db->CompactRangeShard(sub->compact, sub->input, nullptr);
+  MutexLock l(&db->mutex_);
+  if (--*sub->remaining == 0) {
+    db->background_work_finished_signal_.SignalAll();
+  }
+}
 
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
-  assert(compact->builder == nullptr);
-  assert(compact->outfile == nullptr);
-  if (snapshots_.empty()) {
-    compact->smallest_snapshot = versions_->LastSequence();
+Status DBImpl::CompactRangeShard(CompactionState* compact, Iterator* input,
+                                 int64_t* imm_micros) {
+  const Comparator* user_cmp = user_comparator();
+  if (compact->begin != nullptr) {
+    InternalKey start(*compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+    compact->output_lower = compact->begin->ToString();
+    compact->has_output_lower = true;
   } else {
-    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    input->SeekToFirst();
   }
-
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
-
-  // Release mutex while we're actually doing the compaction work
-  mutex_.Unlock();
-
-  input->SeekToFirst();
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // The current output is full and is closed before the next key that may
+  // start a new output.  While tombstones are written, outputs are cut
+  // only between user keys, as a tombstone clipped at a user key would
+  // miss the entries of that key left in the previous output.
+  bool close_output = false;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    if (imm_micros != nullptr && has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
       if (imm_ != nullptr) {
@@ -936,13 +1521,28 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->end != nullptr && ParseInternalKey(key, &ikey) &&
+        user_cmp->Compare(ikey.user_key, *compact->end) >= 0) {
+      // The rest of the key space belongs to the next shard
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
+      close_output = true;
+    }
+    const bool valid_key = ParseInternalKey(key, &ikey);
+    if (close_output &&
+        (compact->output_range_del == nullptr ||
+         (valid_key &&
+          (!has_current_user_key ||
+           user_cmp->Compare(ikey.user_key, current_user_key) != 0)))) {
+      close_output = false;
+      status = FinishCompactionOutputFile(
+          compact, input, valid_key ? &ikey.user_key : nullptr);
       if (!status.ok()) {
         break;
       }
@@ -950,7 +1550,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
-    if (!ParseInternalKey(key, &ikey)) {
+    if (!valid_key) {
       // case: add key
       // Do not hide error keys
       current_user_key.clear();
@@ -959,8 +1559,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     } else {
       // case: remove key
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
-              0) {
+          user_cmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
@@ -970,9 +1569,17 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
+      } else if (compact->range_del != nullptr &&
+                 compact->range_del->MaxCoveringSequence(
+                     ikey.user_key, compact->smallest_snapshot) >
+                     ikey.sequence) {
+        // Hidden by a range tombstone that every snapshot can see, and so
+        // are all older entries for this user key
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -991,7 +1598,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -1012,10 +1620,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+        close_output = true;
       }
     }
 
@@ -1025,14 +1630,125 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == nullptr &&
+      compact->output_range_del != nullptr) {
+    // Tombstones past the last output still need a file.
+    std::vector<RangeTombstone> tombstones;
+    const Slice lower(compact->output_lower);
+    compact->output_range_del->GetClipped(
+        compact->has_output_lower ? &lower : nullptr, compact->end,
+        &tombstones);
+    if (!tombstones.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, compact->end);
   }
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
+  return status;
+}
+
+Status DBImpl::DoCompactionWork(CompactionState* compact) {
+  const uint64_t start_micros = env_->NowMicros();
+  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+
+  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
+      compact->compaction->num_input_files(0), compact->compaction->level(),
+      compact->compaction->num_input_files(1),
+      compact->compaction->level() + 1);
+
+  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(compact->builder == nullptr);
+  assert(compact->outfile == nullptr);
+  if (snapshots_.empty()) {
+    compact->smallest_snapshot = versions_->LastSequence();
+  } else {
+    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+  }
+
+  // Split the compaction into key-range shards.  Shard 0 runs on this
+  // thread; every other shard gets a thread of its own.
+  std::vector<std::string> boundaries;
+  compact->compaction->GetShardBoundaries(options_.max_subcompactions,
+                                          &boundaries);
+  std::vector<Slice> bounds(boundaries.begin(), boundaries.end());
+  const size_t num_shards = bounds.size() + 1;
+  std::vector<Subcompaction> shards(num_shards);
+  for (size_t i = 0; i < num_shards; i++) {
+    CompactionState* state = compact;
+    if (num_shards > 1) {
+      state = new CompactionState(compact->compaction);
+      state->smallest_snapshot = compact->smallest_snapshot;
+      state->begin = (i == 0) ? nullptr : &bounds[i - 1];
+      state->end = (i == num_shards - 1) ? nullptr : &bounds[i];
+    }
+    shards[i].db = this;
+    shards[i].compact = state;
+    shards[i].input = versions_->MakeInputIterator(compact->compaction);
+  }
+  int remaining = num_shards - 1;
+  if (num_shards > 1) {
+    Log(options_.info_log, "Compacting in %d shards",
+        static_cast<int>(num_shards));
+  }
+
+  // Release mutex while we're actually doing the compaction work
+  mutex_.Unlock();
+
+  RangeDelAggregator* range_del;
+  RangeDelAggregator* output_range_del;
+  Status status =
+      GetCompactionTombstones(compact, &range_del, &output_range_del);
+  if (status.ok()) {
+    for (size_t i = 0; i < num_shards; i++) {
+      shards[i].compact->range_del = range_del;
+      shards[i].compact->output_range_del = output_range_del;
+    }
+    for (size_t i = 1; i < num_shards; i++) {
+      shards[i].remaining = &remaining;
+      env_->StartThread(&DBImpl::BGSubcompaction, &shards[i]);
+    }
+    // Without a flush job of its own, imm_ is flushed by the compaction.
+    status = CompactRangeShard(shards[0].compact, shards[0].input,
+                               HasFlushJob() ? nullptr : &imm_micros);
+  } else {
+    remaining = 0;
+  }
+
+  mutex_.Lock();
+  while (remaining > 0) {
+    background_work_finished_signal_.Wait();
+  }
+  mutex_.Unlock();
+
+  if (num_shards > 1) {
+    // Gather the outputs of all shards, in key order, into "compact".
+    for (size_t i = 0; i < num_shards; i++) {
+      CompactionState* state = shards[i].compact;
+      if (status.ok()) {
+        status = shards[i].status;
+      }
+      if (state->builder != nullptr) {
+        state->builder->Abandon();
+        delete state->builder;
+      }
+      delete state->outfile;
+      compact->outputs.insert(compact->outputs.end(), state->outputs.begin(),
+                              state->outputs.end());
+      compact->total_bytes += state->total_bytes;
+      delete state;
+    }
+  }
+  for (size_t i = 0; i < num_shards; i++) {
+    delete shards[i].input;
+  }
+  delete range_del;
+  delete output_range_del;
+  compact->range_del = nullptr;
+  compact->output_range_del = nullptr;
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros - imm_micros;
@@ -1085,28 +1801,65 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeDelAggregator** range_del) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  MemTable* const mem = mem_;
+  MemTable* const imm = imm_;
+  Version* const current = versions_->current();
+  list.push_back(mem->NewIterator());
+  mem->Ref();
+  if (imm != nullptr) {
+    list.push_back(imm->NewIterator());
+    imm->Ref();
   }
-  versions_->current()->AddIterators(options, &list);
+  current->AddIterators(options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
+  current->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+  IterState* cleanup = new IterState(&mutex_, mem, imm, current);
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_del != nullptr) {
+    // The iterator pins mem, imm and current, so their tombstones can be
+    // read without holding the mutex.
+    *range_del = nullptr;
+    std::shared_ptr<const RangeDelAggregator> tables;
+    Status s = current->GetRangeTombstones(&tables);
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    // Every source caches its tombstones already fragmented, so they are
+    // shared here rather than merged again.
+    RangeDelAggregator* agg = new RangeDelAggregator(user_comparator());
+    MemTable* const mems[] = {mem, imm};
+    for (MemTable* m : mems) {
+      if (m != nullptr) {
+        std::shared_ptr<const RangeDelAggregator> r = m->RangeTombstones();
+        if (r != nullptr) {
+          agg->AddChild(std::move(r));
+        }
+      }
+    }
+    if (tables != nullptr) {
+      agg->AddChild(std::move(tables));
+    }
+    agg->Finish();
+    if (agg->empty()) {
+      delete agg;
+    } else {
+      *range_del = agg;
+    }
+  }
   return internal_iter;
 }
 
@@ -1121,6 +1874,28 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+double DBImpl::TEST_LevelMaxBytes(int level) {
+  MutexLock l(&mutex_);
+  return versions_->LevelMaxBytes(level);
+}
+
+int64_t DBImpl::TEST_NumLevelBytes(int level) {
+  MutexLock l(&mutex_);
+  return versions_->NumLevelBytes(level);
+}
+
+void DBImpl::TEST_EvictTables() {
+  MutexLock l(&mutex_);
+  for (int level = 0; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    versions_->current()->GetOverlappingInputs(level, nullptr, nullptr,
+                                               &files);
+    for (FileMetaData* f : files) {
+      table_cache_->Evict(f->number);
+    }
+  }
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
   Status s;
@@ -1168,16 +1943,126 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   return s;
 }
 
+namespace {
+
+// Orders indices into a vector of user keys by the keys they refer to.
+struct ByUserKey {
+  const Comparator* ucmp;
+  const std::vector<Slice>* keys;
+
+  bool operator()(size_t a, size_t b) const {
+    return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
+  }
+};
+
+}  // anonymous namespace
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->assign(n, std::string());
+  statuses->assign(n, Status());
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // Visit the keys in sorted order so that lookups that land in the
+    // same table file (and the same block within it) are issued together.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    ByUserKey cmp;
+    cmp.ucmp = user_comparator();
+    cmp.keys = &keys;
+    std::stable_sort(order.begin(), order.end(), cmp);
+
+    std::vector<LookupKey*> lkeys;
+    std::vector<const LookupKey*> pending_keys;
+    std::vector<std::string*> pending_values;
+    std::vector<size_t> pending_index;
+    lkeys.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      const size_t index = order[i];
+      LookupKey* lkey = new LookupKey(keys[index], snapshot);
+      lkeys.push_back(lkey);
+      std::string* value = &(*values)[index];
+      Status* s = &(*statuses)[index];
+      // First look in the memtable, then in the immutable memtable (if any).
+      if (mem->Get(*lkey, value, s)) {
+        // Done
+      } else if (imm != nullptr && imm->Get(*lkey, value, s)) {
+        // Done
+      } else {
+        pending_keys.push_back(lkey);
+        pending_values.push_back(value);
+        pending_index.push_back(index);
+      }
+    }
+
+    if (!pending_keys.empty()) {
+      std::vector<Status> pending_statuses;
+      current->MultiGet(options, pending_keys, pending_values,
+                        &pending_statuses, &stats);
+      for (size_t i = 0; i < pending_index.size(); i++) {
+        (*statuses)[pending_index[i]] = pending_statuses[i];
+      }
+    }
+    for (size_t i = 0; i < lkeys.size(); i++) {
+      delete lkeys[i];
+    }
+    mutex_.Lock();
+  }
+
+  bool need_compaction = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (current->UpdateStats(stats[i])) {
+      need_compaction = true;
+    }
+  }
+  if (need_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeDelAggregator* range_del;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &range_del);
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, range_del,
+                       options.prefix_same_as_start ? options_.prefix_extractor
+                                                    : nullptr,
+                       options.iterate_upper_bound);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1206,7 +2091,16 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  return DB::DeleteRange(options, begin, end);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1216,6 +2110,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   writers_.push_back(&w);
   while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
+    if (w.leader != nullptr) {
+      InsertAsFollower(&w);
+    }
   }
   if (w.done) {
     return w.status;
@@ -1226,9 +2123,13 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
-    WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
+    DelayWrite(WriteBatchInternal::ByteSize(write_batch));
+    const SequenceNumber first_sequence = last_sequence + 1;
+    WriteBatchInternal::SetSequence(write_batch, first_sequence);
     last_sequence += WriteBatchInternal::Count(write_batch);
+    const bool parallel = options_.allow_concurrent_memtable_write &&
+                          write_batch != w.batch;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1244,7 +2145,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1255,6 +2156,16 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok() && parallel) {
+      std::vector<Writer*> group;
+      for (Writer* member : writers_) {
+        if (member->batch != nullptr) {
+          group.push_back(member);
+        }
+        if (member == last_writer) break;
+      }
+      status = InsertGroupConcurrently(&w, group, first_sequence);
+    }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
@@ -1279,9 +2190,188 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// The pipelined variant of Write().  A batch group moves through two
+// stages.  Its leader first appends the group to the log while at the
+// front of writers_, exactly as in Write().  The group then leaves
+// writers_, so the next leader can start logging, and queues up in
+// memtable_writers_.  Groups are applied to the memtable one at a time in
+// log order, and the last sequence of each group is published only once
+// it has been applied, so readers never observe a gap.
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  // Once its group has been logged, a follower is no longer in writers_,
+  // which may then be empty.
+  while (!w.done && (writers_.empty() || &w != writers_.front())) {
+    w.cv.Wait();
+    if (w.leader != nullptr) {
+      InsertAsFollower(&w);
+    }
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // May temporarily unlock and wait.  Switching to a new memtable also
+  // waits for the groups still in the memtable stage.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  uint64_t last_sequence = memtable_writers_.empty()
+                               ? versions_->LastSequence()
+                               : memtable_writers_.back()->last_sequence;
+  Writer* last_writer = &w;
+  // Unlike Write(), the merged batch must outlive our turn at the front of
+  // writers_, so it cannot live in the shared tmp_batch_.
+  WriteBatch group_batch;
+  WriteBatch* write_batch = nullptr;
+  const SequenceNumber first_sequence = last_sequence + 1;
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    write_batch = BuildBatchGroup(&last_writer, &group_batch);
+    DelayWrite(WriteBatchInternal::ByteSize(write_batch));
+    WriteBatchInternal::SetSequence(write_batch, first_sequence);
+    last_sequence += WriteBatchInternal::Count(write_batch);
+
+    // Add to log.  We can release the lock during this phase since &w is
+    // currently responsible for logging and protects against concurrent
+    // loggers.
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+
+  // Hand the group over to the memtable stage and let the next group
+  // start logging.
+  std::vector<Writer*> group;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    group.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  w.last_sequence = last_sequence;
+  memtable_writers_.push_back(&w);
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Wait until every earlier group has been applied.  mem_ cannot change
+  // in the meantime since MakeRoomForWrite() drains this stage before
+  // switching memtables.
+  while (&w != memtable_writers_.front()) {
+    w.cv.Wait();
+  }
+  if (write_batch != nullptr) {
+    if (status.ok() && options_.allow_concurrent_memtable_write &&
+        write_batch != w.batch) {
+      std::vector<Writer*> inserters;
+      for (size_t i = 0; i < group.size(); i++) {
+        if (group[i]->batch != nullptr) {
+          inserters.push_back(group[i]);
+        }
+      }
+      status = InsertGroupConcurrently(&w, inserters, first_sequence);
+    } else if (status.ok()) {
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertInto(write_batch, mem_);
+      mutex_.Lock();
+    }
+    versions_->SetLastSequence(last_sequence);
+  }
+  memtable_writers_.pop_front();
+
+  // Wake the next group in the memtable stage, or the logging leader in
+  // case it is waiting for this stage to drain.
+  if (!memtable_writers_.empty()) {
+    memtable_writers_.front()->cv.Signal();
+  } else if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  for (size_t i = 0; i < group.size(); i++) {
+    Writer* ready = group[i];
+    if (ready != &w) {
+      ready->status = status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+  }
+  return status;
+}
+
+// Applies a logged batch group to mem_ with every writer in "group"
+// inserting its own batch, so that large groups are not inserted by the
+// leader alone.  "group" lists the writers whose batches are non-null, in
+// log order, starting with "leader"; their batches are numbered
+// consecutively from "sequence".  Returns once every batch is applied.
+Status DBImpl::InsertGroupConcurrently(Writer* leader,
+                                       const std::vector<Writer*>& group,
+                                       SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  assert(!group.empty() && group[0] == leader);
+  leader->pending_inserts = 0;
+  for (size_t i = 0; i < group.size(); i++) {
+    Writer* member = group[i];
+    WriteBatchInternal::SetSequence(member->batch, sequence);
+    sequence += WriteBatchInternal::Count(member->batch);
+    if (member != leader) {
+      member->leader = leader;
+      leader->pending_inserts++;
+      member->cv.Signal();
+    }
+  }
+
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  for (size_t i = 1; i < group.size() && s.ok(); i++) {
+    s = group[i]->status;
+  }
+  return s;
+}
+
+// Inserts w's batch on behalf of the leader that handed it out in
+// InsertGroupConcurrently().
+void DBImpl::InsertAsFollower(Writer* w) {
+  mutex_.AssertHeld();
+  Writer* leader = w->leader;
+  w->leader = nullptr;
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, mem);
+  mutex_.Lock();
+  w->status = s;
+  if (--leader->pending_inserts == 0) {
+    leader->cv.Signal();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1308,6 +2398,10 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
+    if (w->exclusive) {
+      break;
+    }
+
     if (w->batch != nullptr) {
       size += WriteBatchInternal::ByteSize(w->batch);
       if (size > max_size) {
@@ -1318,7 +2412,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1331,28 +2425,61 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
+void DBImpl::UpdateWriteController() {
+  mutex_.AssertHeld();
+  if (versions_->NumLevelFiles(0) < options_.level0_slowdown_writes_trigger) {
+    write_controller_.SetDelayedWriteRate(0);
+    last_compaction_debt_ = 0;
+    return;
+  }
+
+  // Start at the configured rate, then back off while the compaction debt
+  // keeps growing and speed up again once compactions are catching up.
+  const uint64_t debt = versions_->EstimatedPendingCompactionBytes();
+  uint64_t rate = write_controller_.delayed_write_rate();
+  if (rate == 0) {
+    rate = write_controller_.max_delayed_write_rate();
+  } else if (debt > last_compaction_debt_) {
+    rate = rate / 5 * 4;
+  } else if (debt < last_compaction_debt_) {
+    rate = rate / 4 * 5;
+  }
+  write_controller_.SetDelayedWriteRate(rate);
+  last_compaction_debt_ = debt;
+}
+
+// REQUIRES: mutex_ is held
+// REQUIRES: this thread is currently at the front of the writer queue
+void DBImpl::DelayWrite(size_t write_bytes) {
+  mutex_.AssertHeld();
+  UpdateWriteController();
+  if (!write_controller_.IsDelayed()) {
+    return;
+  }
+  // We are getting close to hitting a hard limit on the number of L0
+  // files.  Rather than delaying a single write by several seconds when we
+  // hit the hard limit, admit writes at a rate derived from the compaction
+  // debt, charging each batch group for its size.  Also, this delay hands
+  // over some CPU to the compaction thread in case it is sharing the same
+  // core as the writer.
+  const uint64_t delay =
+      write_controller_.GetDelay(env_->NowMicros(), write_bytes);
+  if (delay > 0) {
+    mutex_.Unlock();
+    env_->SleepForMicroseconds(static_cast<int>(delay));
+    mutex_.Lock();
+  }
+}
+
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1362,10 +2489,15 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (versions_->NumLevelFiles(0) >=
+               options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined writes: earlier groups are still being applied to the
+      // memtable we are about to retire.  The last of them wakes us up.
+      writers_.front()->cv.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1429,6 +2561,20 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       *value = buf;
       return true;
     }
+  } else if (in == "delayed-write-rate") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      write_controller_.delayed_write_rate()));
+    *value = buf;
+    return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      versions_->EstimatedPendingCompactionBytes()));
+    *value = buf;
+    return true;
   } else if (in == "stats") {
     char buf[200];
     std::snprintf(buf, sizeof(buf),
@@ -1459,11 +2605,72 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (imm_) {
       total_usage += imm_->ApproximateMemoryUsage();
     }
+    total_usage += table_cache_->ApproximateMemoryUsage();
     char buf[50];
     std::snprintf(buf, sizeof(buf), "%llu",
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "block-cache-usage") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      options_.block_cache->TotalCharge()));
+    *value = buf;
+    return true;
+  } else if (in == "block-cache-index-and-filter-usage") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      options_.block_cache->HighPriorityCharge()));
+    *value = buf;
+    return true;
+  } else if (in == "block-cache-stats") {
+    std::vector<Cache::ShardStats> shards;
+    options_.block_cache->GetShardStats(&shards);
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Shard Capacity(MB) Usage(MB) Pinned(MB)    Lookups"
+                  "       Hits FailedInserts\n"
+                  "-----------------------------------------------------"
+                  "-----------------------\n");
+    value->append(buf);
+    for (size_t i = 0; i < shards.size(); i++) {
+      const Cache::ShardStats& shard = shards[i];
+      std::snprintf(buf, sizeof(buf),
+                    "%5d %12.1f %9.1f %10.1f %10llu %10llu %13llu\n",
+                    static_cast<int>(i), shard.capacity / 1048576.0,
+                    shard.usage / 1048576.0, shard.pinned_usage / 1048576.0,
+                    static_cast<unsigned long long>(shard.lookups),
+                    static_cast<unsigned long long>(shard.hits),
+                    static_cast<unsigned long long>(shard.failed_inserts));
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "persistent-cache-stats") {
+    if (options_.persistent_cache == nullptr) {
+      return false;
+    }
+    const PersistentCache::Stats stats =
+        options_.persistent_cache->GetStats();
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Lookups: %llu Hits: %llu (%.1f%%) Inserts: %llu "
+                  "Usage(MB): %.1f\n",
+                  static_cast<unsigned long long>(stats.lookups),
+                  static_cast<unsigned long long>(stats.hits),
+                  stats.lookups > 0 ? 100.0 * stats.hits / stats.lookups : 0.0,
+                  static_cast<unsigned long long>(stats.inserts),
+                  stats.usage / 1048576.0);
+    *value = buf;
+    return true;
+  } else if (in == "table-readers-memory") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      table_cache_->ApproximateMemoryUsage()));
+    *value = buf;
+    return true;
   }
 
   return false;
@@ -1501,6 +2708,22 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  return Status::NotSupported("DeleteFilesInRange");
+}
+
+Status DB::IngestExternalFile(const std::vector<std::string>& paths,
+                              const IngestExternalFileOptions& options) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1530,7 +2753,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (s.ok() && save_manifest) {
     edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
     edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    s = impl->LogAndApply(&edit);
   }
   if (s.ok()) {
     impl->RemoveObsoleteFiles();
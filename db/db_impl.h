@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -21,6 +23,7 @@
 namespace leveldb {
 
 class MemTable;
+class RangeDelAggregator;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -39,15 +42,23 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin,
+                     const Slice& end) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status DeleteFilesInRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFile(const std::vector<std::string>& paths,
+                            const IngestExternalFileOptions& options) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -66,6 +77,15 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the size target of the specified level, and the combined size
+  // of its files.
+  double TEST_LevelMaxBytes(int level);
+  int64_t TEST_NumLevelBytes(int level);
+
+  // Drop the tables of the current version from the table cache, so that
+  // they are opened again when next read.
+  void TEST_EvictTables();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
@@ -74,6 +94,8 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct ExternalFile;
+  struct Subcompaction;
   struct Writer;
 
   // Information for a manual compaction
@@ -101,9 +123,12 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // If range_del is non-null, also collects every range tombstone of the
+  // DB in *range_del, or sets it to nullptr if there are none.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelAggregator** range_del = nullptr);
 
   Status NewDB();
 
@@ -127,27 +152,89 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // If file_number is non-null the new table stays in pending_outputs_ and
+  // the caller must erase *file_number once *edit has been applied.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* file_number = nullptr)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  // While writes are being slowed down, waits until the write controller
+  // admits a batch group of "write_bytes" bytes.
+  void DelayWrite(size_t write_bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Recompute the delayed write rate from the level-0 file count and the
+  // compaction debt of the current version.
+  void UpdateWriteController() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Implementation of Write() used when options_.enable_pipelined_write
+  // is set.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  // Used when options_.allow_concurrent_memtable_write is set: the group
+  // leader hands every writer in a logged group its own batch to insert.
+  Status InsertGroupConcurrently(Writer* leader,
+                                 const std::vector<Writer*>& group,
+                                 SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void InsertAsFollower(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Check that the table at file->path may be ingested and fill in its
+  // size and key range.
+  Status ReadExternalFile(ExternalFile* file);
+  // Add the files brought into the database directory by
+  // IngestExternalFile() to the current version.
+  // REQUIRES: this thread is at the front of the writer queue
+  Status InstallExternalFiles(std::vector<ExternalFile>* files)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
+  // Serializes calls to VersionSet::LogAndApply(), which releases mutex_
+  // while it writes to the MANIFEST.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // With options_.max_background_jobs > 1, one job is reserved for
+  // memtable flushes and the others run compactions.  Otherwise a single
+  // job does both, flushing first.
+  bool HasFlushJob() const { return options_.max_background_jobs > 1; }
+  int MaxBackgroundCompactions() const {
+    return HasFlushJob() ? options_.max_background_jobs - 1 : 1;
+  }
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGFlush(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundFlushCall();
+  // Returns false if there was nothing that could be compacted.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compacts the part of "input" that falls within compact's key range.
+  // Only the shard that passes a non-null "imm_micros" flushes imm_ when
+  // needed, adding the time spent doing so to *imm_micros.
+  Status CompactRangeShard(CompactionState* compact, Iterator* input,
+                           int64_t* imm_micros) LOCKS_EXCLUDED(mutex_);
+  static void BGSubcompaction(void* arg);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Finish the current output of "compact".  Its share of the range
+  // tombstones ends at the user key *upper, or is unbounded if upper is
+  // nullptr.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* upper);
+  // Collect the range tombstones of the inputs of "compact".  Sets
+  // *range_del to all of them and *output_range_del to those that must
+  // be kept in the outputs; either is set to nullptr if empty.
+  Status GetCompactionTombstones(CompactionState* compact,
+                                 RangeDelAggregator** range_del,
+                                 RangeDelAggregator** output_range_del)
+      LOCKS_EXCLUDED(mutex_);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -184,19 +271,38 @@ class DBImpl : public DB {
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+  // Leaders of batch groups that have been logged but not yet applied to
+  // the memtable, in log order.  Only used by pipelined writes.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Paces writes while level-0 is over its slowdown trigger.
+  WriteController write_controller_ GUARDED_BY(mutex_);
+  // Compaction debt seen by the last UpdateWriteController() call.
+  uint64_t last_compaction_debt_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compaction jobs scheduled or running
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a memtable flush been scheduled in its own job, or is it running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
+  // Is some thread inside VersionSet::LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
+  port::CondVar manifest_write_finished_signal_ GUARDED_BY(mutex_);
+
+  // Is IngestExternalFile() installing files?  No new compactions start
+  // meanwhile.
+  bool ingest_in_progress_ GUARDED_BY(mutex_);
+
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
   // Have we encountered a background error in paranoid mode?
@@ -7,6 +7,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -46,20 +47,28 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, RangeDelAggregator* range_del,
+         const SliceTransform* prefix_extractor, const Slice* upper_bound)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        range_del_(range_del),
+        prefix_extractor_(prefix_extractor),
+        upper_bound_(upper_bound),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        has_prefix_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_del_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
@@ -88,6 +97,48 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Record the prefix that later keys must share, if "user_key" has one.
+  void SetPrefix(const Slice& user_key) {
+    has_prefix_ = prefix_extractor_ != nullptr &&
+                  prefix_extractor_->InDomain(user_key);
+    if (has_prefix_) {
+      Slice prefix = prefix_extractor_->Transform(user_key);
+      prefix_.assign(prefix.data(), prefix.size());
+    }
+  }
+
+  bool PastUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  // Is "user_key" beyond the keys this iterator may yield when moving
+  // forward?
+  bool PastBounds(const Slice& user_key) const {
+    if (PastUpperBound(user_key)) {
+      return true;
+    }
+    return has_prefix_ && !(prefix_extractor_->InDomain(user_key) &&
+                            prefix_extractor_->Transform(user_key) ==
+                                Slice(prefix_));
+  }
+
+  // Prefix iteration only moves forward; see ReadOptions.
+  bool ReverseNotSupported() {
+    if (prefix_extractor_ == nullptr) {
+      return false;
+    }
+    valid_ = false;
+    status_ = Status::NotSupported(
+        "prefix_same_as_start iterators cannot move backwards");
+    return true;
+  }
+
+  // Is the entry "key" hidden by a range tombstone?
+  bool IsCovered(const ParsedInternalKey& key) const {
+    return range_del_ != nullptr && range_del_->ShouldDelete(key, sequence_);
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -109,12 +160,17 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  RangeDelAggregator* const range_del_;
+  const SliceTransform* const prefix_extractor_;  // Null unless prefix mode
+  const Slice* const upper_bound_;
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool has_prefix_;  // Keys past prefix_ end the iteration
+  std::string prefix_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -181,6 +237,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (PastBounds(ikey.user_key)) {
+        break;
+      }
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -192,12 +251,19 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (IsCovered(ikey)) {
+            // Deleted by a range tombstone, as are all older entries
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          // Range tombstones are kept apart from point entries
+          break;
       }
     }
     iter_->Next();
@@ -208,6 +274,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 
 void DBIter::Prev() {
   assert(valid_);
+  if (ReverseNotSupported()) {
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
@@ -240,13 +309,16 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      // Entries past the upper bound are skipped rather than trusted to be
+      // absent: the internal iterator does not cut seeks short.
+      if (ParseKey(&ikey) && ikey.sequence <= sequence_ &&
+          !PastUpperBound(ikey.user_key)) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = IsCovered(ikey) ? kTypeDeletion : ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -277,6 +349,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  SetPrefix(target);
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -291,6 +364,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  has_prefix_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -298,12 +372,32 @@ void DBIter::SeekToFirst() {
   } else {
     valid_ = false;
   }
+  if (valid_) {
+    SetPrefix(key());
+  }
 }
 
 void DBIter::SeekToLast() {
+  if (ReverseNotSupported()) {
+    return;
+  }
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // Start from the last entry below the bound.
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_,
+                                                     kMaxSequenceNumber,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -311,8 +405,11 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, RangeDelAggregator* range_del,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* upper_bound) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    range_del, prefix_extractor, upper_bound);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,24 @@
 namespace leveldb {
 
 class DBImpl;
+class RangeDelAggregator;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries hidden by a tombstone in
+// "*range_del" are skipped; range_del may be nullptr if there are no
+// range tombstones.  Takes ownership of internal_iter and range_del.
+//
+// If "prefix_extractor" is non-null, the iterator only yields keys that
+// share the prefix of the key it was positioned at, and does not support
+// moving backwards.  If "upper_bound" is non-null, it only yields keys
+// below *upper_bound.  See ReadOptions for both.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed,
+                        RangeDelAggregator* range_del = nullptr,
+                        const SliceTransform* prefix_extractor = nullptr,
+                        const Slice* upper_bound = nullptr);
 
 }  // namespace leveldb
 
@@ -8,14 +8,21 @@
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "helpers/memenv/memenv.h"
 #include <atomic>
 #include <cinttypes>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
+#include "leveldb/table_builder.h"
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -142,6 +149,11 @@ class SpecialEnv : public EnvWrapper {
 
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
+  AtomicCounter multi_read_counter_;  // Calls to MultiRead() while counting
+
+  // Table reads return their data in the caller's buffer, as they do for
+  // files that are not memory-mapped, which makes the blocks cachable.
+  bool copy_random_reads_;
 
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
@@ -152,7 +164,8 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        copy_random_reads_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -239,21 +252,49 @@ class SpecialEnv : public EnvWrapper {
      private:
       RandomAccessFile* target_;
       AtomicCounter* counter_;
+      AtomicCounter* multi_counter_;
 
      public:
-      CountingFile(RandomAccessFile* target, AtomicCounter* counter)
-          : target_(target), counter_(counter) {}
+      CountingFile(RandomAccessFile* target, AtomicCounter* counter,
+                   AtomicCounter* multi_counter)
+          : target_(target), counter_(counter), multi_counter_(multi_counter) {}
       ~CountingFile() override { delete target_; }
       Status Read(uint64_t offset, size_t n, Slice* result,
                   char* scratch) const override {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      Status MultiRead(ReadRequest* requests, size_t num) const override {
+        counter_->IncrementBy(static_cast<int>(num));
+        multi_counter_->Increment();
+        return target_->MultiRead(requests, num);
+      }
+    };
+
+    class CopyingFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+
+     public:
+      explicit CopyingFile(RandomAccessFile* target) : target_(target) {}
+      ~CopyingFile() override { delete target_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const override {
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          std::memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok() && copy_random_reads_) {
+      *r = new CopyingFile(*r);
+    }
     if (s.ok() && count_random_reads_) {
-      *r = new CountingFile(*r, &random_read_counter_);
+      *r = new CountingFile(*r, &random_read_counter_, &multi_read_counter_);
     }
     return s;
   }
@@ -308,6 +349,12 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
       default:
         break;
     }
@@ -422,6 +469,9 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "DELRANGE";
+              break;
           }
         }
         iter->Next();
@@ -501,6 +551,25 @@ class DBTest : public testing::Test {
     MakeTables(config::kNumLevels, smallest, largest);
   }
 
+  // Write a table for IngestExternalFile() holding the "key=value" pairs
+  // in "entries", which must be sorted, to a file named "name".  Returns
+  // its path.
+  std::string WriteExternalFile(const std::string& name,
+                                const std::vector<std::string>& entries) {
+    const std::string fname = dbname_ + "_" + name;
+    WritableFile* file;
+    EXPECT_LEVELDB_OK(env_->NewWritableFile(fname, &file));
+    TableBuilder builder(last_options_, file);
+    for (const std::string& entry : entries) {
+      const size_t eq = entry.find('=');
+      builder.Add(entry.substr(0, eq), entry.substr(eq + 1));
+    }
+    EXPECT_LEVELDB_OK(builder.Finish());
+    EXPECT_LEVELDB_OK(file->Close());
+    delete file;
+    return fname;
+  }
+
   void DumpFileCounts(const char* label) {
     std::fprintf(stderr, "---\n%s:\n", label);
     std::fprintf(
@@ -564,7 +633,15 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -1081,6 +1158,104 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread the keys over level-1+, level-0 and the memtable, with a
+    // deletion and an overwrite in the newer layers.
+    for (int i = 0; i < 200; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "base" + Key(i)));
+    }
+    Compact(Key(0), Key(200));
+    ASSERT_LEVELDB_OK(Put(Key(10), "l0"));
+    ASSERT_LEVELDB_OK(Delete(Key(20)));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put(Key(30), "mem"));
+    ASSERT_LEVELDB_OK(Delete(Key(40)));
+
+    std::vector<Slice> keys;
+    std::vector<std::string> key_storage;
+    const int probes[] = {150, 30, 10, 20, 40, 5, 250, 10, 199};
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+      key_storage.push_back(Key(probes[i]));
+    }
+    for (size_t i = 0; i < key_storage.size(); i++) {
+      keys.push_back(key_storage[i]);
+    }
+
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), statuses.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      std::string expected = Get(key_storage[i]);
+      if (expected == "NOT_FOUND") {
+        ASSERT_TRUE(statuses[i].IsNotFound()) << key_storage[i];
+        ASSERT_EQ("", values[i]);
+      } else {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(expected, values[i]);
+      }
+    }
+    ASSERT_EQ("mem", values[1]);
+    ASSERT_EQ("l0", values[2]);
+    ASSERT_TRUE(statuses[3].IsNotFound());
+    ASSERT_TRUE(statuses[4].IsNotFound());
+    ASSERT_EQ("base" + Key(5), values[5]);
+    ASSERT_TRUE(statuses[6].IsNotFound());
+    ASSERT_EQ("l0", values[7]);
+
+    // Reads through a snapshot see neither the overwrite nor the deletion
+    // made after it.
+    ReadOptions options;
+    options.snapshot = snapshot;
+    db_->MultiGet(options, keys, &values, &statuses);
+    ASSERT_EQ("base" + Key(30), values[1]);
+    ASSERT_EQ("base" + Key(40), values[4]);
+    db_->ReleaseSnapshot(snapshot);
+
+    db_->MultiGet(ReadOptions(), std::vector<Slice>(), &values, &statuses);
+    ASSERT_TRUE(values.empty());
+    ASSERT_TRUE(statuses.empty());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MultiGetReadsBlocksTogether) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  Compact("a", "z");
+
+  // Every key is in a different block of the same table.
+  std::vector<std::string> key_storage;
+  for (int i = 0; i < N; i += 100) {
+    key_storage.push_back(Key(i));
+  }
+  std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  env_->random_read_counter_.Reset();
+  env_->multi_read_counter_.Reset();
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_LEVELDB_OK(statuses[i]);
+    ASSERT_EQ(std::string(100, 'v'), values[i]);
+  }
+  ASSERT_EQ(1, env_->multi_read_counter_.Read());
+  ASSERT_EQ(static_cast<int>(keys.size()), env_->random_read_counter_.Read());
+
+  Close();
+  delete options.block_cache;
+}
+
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1156,6 +1331,90 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Build several overlapping level-0 files out of puts, overwrites and
+  // deletions.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 3000; i++) {
+    std::string k = Key(rnd.Uniform(1000));
+    if (rnd.OneIn(5)) {
+      ASSERT_LEVELDB_OK(Delete(k));
+      model.erase(k);
+    } else {
+      std::string v = RandomString(&rnd, 200);
+      ASSERT_LEVELDB_OK(Put(k, v));
+      model[k] = v;
+    }
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_EQ(NumTableFilesAtLevel(1), 0);
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+
+  // The sharded compaction reports its shard count in the info log.
+  std::string log;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, InfoLogFileName(dbname_), &log));
+  ASSERT_NE(log.find("Compacting in "), std::string::npos);
+
+  // Every shard must have produced its part of the key space exactly once.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::map<std::string, std::string>::const_iterator expected = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+    ASSERT_TRUE(expected != model.end());
+    ASSERT_EQ(expected->first, iter->key().ToString());
+    ASSERT_EQ(expected->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(expected == model.end());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+}
+
+TEST_F(DBTest, ConcurrentBackgroundJobs) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 20000;  // Small write buffer
+  options.max_background_jobs = 4;
+  Reopen(&options);
+
+  // Flushes run in their own pool and several compactions may be in flight
+  // at once; none of that may lose or resurrect data.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 10000; i++) {
+    std::string k = Key(rnd.Uniform(2000));
+    if (rnd.OneIn(10)) {
+      ASSERT_LEVELDB_OK(Delete(k));
+      model.erase(k);
+    } else {
+      std::string v = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(k, v));
+      model[k] = v;
+    }
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    std::map<std::string, std::string>::const_iterator expected =
+        model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+      ASSERT_TRUE(expected != model.end());
+      ASSERT_EQ(expected->first, iter->key().ToString());
+      ASSERT_EQ(expected->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(expected == model.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    Reopen(&options);
+  }
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1163,8 +1422,9 @@ TEST_F(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles =
+      config::kNumLevels + options.level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1383,6 +1643,10 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // Let the level-0 compaction FillLevels() triggers finish now.  If it
+    // only got to run after the flush below, it would compact "foo" while
+    // the snapshot still needs the hidden value.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1413,7 +1677,7 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
 TEST_F(DBTest, DeletionMarkers1) {
   Put("foo", "v1");
   ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = last_options_.max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1442,7 +1706,7 @@ TEST_F(DBTest, DeletionMarkers1) {
 TEST_F(DBTest, DeletionMarkers2) {
   Put("foo", "v1");
   ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = last_options_.max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1465,9 +1729,296 @@ TEST_F(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));  // Newer than the tombstone
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+    // Same answers once the tombstone lives in a table, and after it has
+    // been compacted with the data it covers.
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeHidesOlderTables) {
+  do {
+    ASSERT_LEVELDB_OK(Put("k1", "v1"));
+    ASSERT_LEVELDB_OK(Put("k2", "v2"));
+    ASSERT_LEVELDB_OK(Put("k3", "v3"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    // A tombstone in the memtable hides entries in tables.
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "k0", "k3"));
+    ASSERT_EQ("NOT_FOUND", Get("k1"));
+    ASSERT_EQ("NOT_FOUND", Get("k2"));
+    ASSERT_EQ("v3", Get("k3"));
+    ASSERT_EQ("v1", Get("k1", snapshot));
+    ASSERT_EQ("(k3->v3)", Contents());
+
+    // As does a tombstone in a newer table.
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("k2"));
+    ASSERT_EQ("v2", Get("k2", snapshot));
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), {"k1", "k2", "k3"}, &values, &statuses);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_LEVELDB_OK(statuses[2]);
+
+    // The snapshot keeps the hidden entries alive through compaction.
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("v2", Get("k2", snapshot));
+    ASSERT_EQ("NOT_FOUND", Get("k2"));
+    ReadOptions options;
+    options.snapshot = snapshot;
+    Iterator* iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ("k1->v1", IterStatus(iter));
+    delete iter;
+
+    // Without it, compacting a tombstone into the bottom level drops both
+    // the entries it hides and the tombstone itself.
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "k", "l"));
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("NOT_FOUND", Get("k3"));
+    ASSERT_EQ(AllEntriesFor("k1"), "[ ]");
+    ASSERT_EQ(0, TotalTableFiles());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeAcrossOutputFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_file_size = 1 << 20;  // Several output files per compaction
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 400;
+  std::vector<std::string> values;
+  for (int i = 0; i < kNumKeys; i++) {
+    values.push_back(RandomString(&rnd, 10000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(50), Key(350)));
+  ASSERT_LEVELDB_OK(Put(Key(200), "new"));
+
+  // The tombstone is newer than the snapshot, so it is split between the
+  // output files instead of being dropped.
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(TotalTableFiles(), 1);
+  for (int i = 0; i < kNumKeys; i++) {
+    const bool deleted = i >= 50 && i < 350;
+    if (i == 200) {
+      ASSERT_EQ("new", Get(Key(i)));
+    } else {
+      ASSERT_EQ(deleted ? "NOT_FOUND" : values[i], Get(Key(i))) << i;
+    }
+    ASSERT_EQ(values[i], Get(Key(i), snapshot)) << i;
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(kNumKeys - 300 + 1, count);
+  delete iter;
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, DeleteFilesInRange) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_file_size = 100000;  // About ten keys per file
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 400;
+  std::vector<std::string> values;
+  for (int i = 0; i < kNumKeys; i++) {
+    values.push_back(RandomString(&rnd, 10000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  const int files_before = TotalTableFiles();
+
+  // Nothing lies wholly inside a range narrower than a file.
+  std::string begin_key = Key(100), end_key = Key(101);
+  Slice begin(begin_key), end(end_key);
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ(files_before, TotalTableFiles());
+
+  end_key = Key(299);
+  end = end_key;
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_LT(TotalTableFiles(), files_before);
+
+  // Keys outside the range survive, as do keys in the boundary files.
+  for (int pass = 0; pass < 2; pass++) {
+    int dropped = 0;
+    for (int i = 0; i < kNumKeys; i++) {
+      const std::string v = Get(Key(i));
+      if (v == "NOT_FOUND") {
+        ASSERT_TRUE(i >= 100 && i <= 299) << i;
+        dropped++;
+      } else {
+        ASSERT_EQ(values[i], v) << i;
+      }
+    }
+    ASSERT_GT(dropped, 100);
+    ASSERT_LE(dropped, 200);
+    Reopen(&options);
+  }
+
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(nullptr, nullptr));
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("", Contents());
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("k2", "old"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(Put("k3", "mem"));  // Forces a flush
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    const std::string path =
+        WriteExternalFile("ext1", {"k1=i1", "k2=i2", "k3=i3"});
+    ASSERT_LEVELDB_OK(db_->IngestExternalFile({path}, {}));
+    ASSERT_TRUE(env_->FileExists(path));
+    // The database has its own copy; rewriting the original in place
+    // leaves it alone.
+    WriteExternalFile("ext1", {"k1=x"});
+    ASSERT_EQ("i1", Get("k1"));
+    ASSERT_EQ("i2", Get("k2"));
+    ASSERT_EQ("i3", Get("k3"));
+    ASSERT_EQ("(a->va)(k1->i1)(k2->i2)(k3->i3)", Contents());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), {"k1", "k2", "k4"}, &values, &statuses);
+    ASSERT_EQ("i1", values[0]);
+    ASSERT_EQ("i2", values[1]);
+    ASSERT_TRUE(statuses[2].IsNotFound());
+
+    // Earlier snapshots do not see the ingested entries.
+    ASSERT_EQ("NOT_FOUND", Get("k1", snapshot));
+    ASSERT_EQ("old", Get("k2", snapshot));
+    ASSERT_EQ("mem", Get("k3", snapshot));
+    ASSERT_EQ(AllEntriesFor("k2"), "[ i2, old ]");
+
+    // Later writes replace them as usual.
+    ASSERT_LEVELDB_OK(Put("k2", "new"));
+    ASSERT_LEVELDB_OK(Delete("k3"));
+    ASSERT_EQ("new", Get("k2"));
+    ASSERT_EQ("NOT_FOUND", Get("k3"));
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen();
+    ASSERT_EQ("i1", Get("k1"));
+    ASSERT_EQ("new", Get("k2"));
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("(a->va)(k1->i1)(k2->new)", Contents());
+    env_->RemoveFile(path);
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, IngestExternalFilePicksLevel) {
+  // Nothing overlaps: the file goes straight to the last level.
+  std::string path = WriteExternalFile("ext1", {"m1=v1", "m2=v2"});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({path}, {}));
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+  ASSERT_EQ(1, TotalTableFiles());
+  env_->RemoveFile(path);
+
+  // An overlapping table in level-0 keeps it in level-0.
+  ASSERT_LEVELDB_OK(Put("m1", "x"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int level0 = NumTableFilesAtLevel(0);
+  path = WriteExternalFile("ext2", {"m1=v3"});
+  IngestExternalFileOptions options;
+  options.move_files = true;
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({path}, options));
+  ASSERT_TRUE(!env_->FileExists(path));
+  ASSERT_EQ("v3", Get("m1"));
+  ASSERT_EQ("v2", Get("m2"));
+  if (level0 > 0) {
+    ASSERT_EQ(level0 + 1, NumTableFilesAtLevel(0));
+  }
+
+  // Files are sorted and may be ingested together.
+  std::string p1 = WriteExternalFile("ext3", {"x=1", "y=2"});
+  std::string p2 = WriteExternalFile("ext4", {"a=3", "b=4"});
+  options.move_files = true;
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({p1, p2}, options));
+  ASSERT_EQ("(a->3)(b->4)(m1->v3)(m2->v2)(x->1)(y->2)", Contents());
+}
+
+TEST_F(DBTest, IngestExternalFileRejectsBadFiles) {
+  ASSERT_LEVELDB_OK(Put("k", "v"));
+  const std::string p1 = WriteExternalFile("ext1", {"a=1", "c=2"});
+  const std::string p2 = WriteExternalFile("ext2", {"b=3"});
+  Status s = db_->IngestExternalFile({p1, p2}, {});
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+
+  const std::string p3 = dbname_ + "_ext3";
+  WritableFile* file;
+  ASSERT_LEVELDB_OK(env_->NewWritableFile(p3, &file));
+  TableBuilder builder(last_options_, file);
+  builder.Add("d", "4");
+  builder.AddRangeTombstone("e", "f");
+  ASSERT_LEVELDB_OK(builder.Finish());
+  ASSERT_LEVELDB_OK(file->Close());
+  delete file;
+  s = db_->IngestExternalFile({p3}, {});
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+
+  s = db_->IngestExternalFile({dbname_ + "_missing"}, {});
+  ASSERT_TRUE(!s.ok());
+
+  // Nothing changed, and no stray files were left behind.
+  ASSERT_EQ("(k->v)", Contents());
+  ASSERT_EQ(0, TotalTableFiles());
+  std::vector<std::string> children;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &children));
+  for (const std::string& child : children) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(child, &number, &type)) {
+      ASSERT_NE(kTempFile, type) << child;
+      ASSERT_NE(kTableFile, type) << child;
+    }
+  }
+  env_->RemoveFile(p1);
+  env_->RemoveFile(p2);
+  env_->RemoveFile(p3);
+}
+
 TEST_F(DBTest, OverlapInLevel0) {
   do {
-    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+    ASSERT_EQ(last_options_.max_mem_compaction_level, 2)
+        << "Fix test to match config";
 
     // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
     // 0.
@@ -1638,53 +2189,303 @@ TEST_F(DBTest, CustomComparator) {
   }
 }
 
-TEST_F(DBTest, ManualCompaction) {
-  ASSERT_EQ(config::kMaxMemCompactLevel, 2)
-      << "Need to update this test to match kMaxMemCompactLevel";
+TEST_F(DBTest, LevelOptions) {
+  Options options = CurrentOptions();
+  options.max_mem_compaction_level = 0;
+  options.level0_file_num_compaction_trigger = 100;
+  options.level0_slowdown_writes_trigger = 100;
+  options.level0_stop_writes_trigger = 100;
+  Reopen(&options);
 
-  MakeTables(3, "p", "q");
-  ASSERT_EQ("1,1,1", FilesPerLevel());
+  // Flushed memtables stay in level-0 and do not trigger compactions.
+  for (int i = 0; i < 5; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("5", FilesPerLevel());
 
-  // Compaction range falls before files
-  Compact("", "c");
-  ASSERT_EQ("1,1,1", FilesPerLevel());
+  options.max_mem_compaction_level = 2;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put(Key(10), "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("5,0,1", FilesPerLevel());
+}
 
-  // Compaction range falls after files
-  Compact("r", "z");
-  ASSERT_EQ("1,1,1", FilesPerLevel());
+TEST_F(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_bytes_for_level_base = 100000;
+  options.max_bytes_for_level_multiplier = 4;
+  options.level_compaction_dynamic_level_bytes = true;
+  Reopen(&options);
 
-  // Compaction range overlaps files
-  Compact("p1", "p9");
-  ASSERT_EQ("0,0,1", FilesPerLevel());
+  // Fill level 3 with about 1.2MB, below its static target of 1.6MB.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 1200; i++) {
+    std::string k = Key(2 * i);
+    std::string v = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(k, v));
+    model[k] = v;
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 0; level < 3; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(2));
+  ASSERT_GT(NumTableFilesAtLevel(3), 0);
+
+  // The levels above are sized backward from level 3, but never below
+  // max_bytes_for_level_base.
+  const int64_t bottom_bytes = dbfull()->TEST_NumLevelBytes(3);
+  ASSERT_GT(bottom_bytes, 1000000);
+  ASSERT_LT(bottom_bytes, 1600000);
+  ASSERT_EQ(bottom_bytes / 4.0, dbfull()->TEST_LevelMaxBytes(2));
+  ASSERT_EQ(100000, dbfull()->TEST_LevelMaxBytes(1));
+  ASSERT_EQ(1600000, dbfull()->TEST_LevelMaxBytes(3));
+
+  // About 350KB at level 2 is within its static target of 400KB, but over
+  // its dynamic one, so it is compacted into level 3.
+  for (int i = 0; i < 350; i++) {
+    std::string k = Key(2 * i + 1);
+    std::string v = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(k, v));
+    model[k] = v;
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  for (int i = 0; i < 1000 && dbfull()->TEST_NumLevelBytes(2) >
+                                  dbfull()->TEST_LevelMaxBytes(2);
+       i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_LE(dbfull()->TEST_NumLevelBytes(2), dbfull()->TEST_LevelMaxBytes(2));
+  ASSERT_GT(dbfull()->TEST_NumLevelBytes(3), bottom_bytes);
+  Reopen(&options);
 
-  // Populate a different range
-  MakeTables(3, "c", "e");
-  ASSERT_EQ("1,1,2", FilesPerLevel());
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::map<std::string, std::string>::const_iterator expected = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+    ASSERT_TRUE(expected != model.end());
+    ASSERT_EQ(expected->first, iter->key().ToString());
+    ASSERT_EQ(expected->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(expected == model.end());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+}
 
-  // Compact just the new range
-  Compact("b", "f");
-  ASSERT_EQ("0,0,2", FilesPerLevel());
+TEST_F(DBTest, DelayedWriteRate) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_mem_compaction_level = 0;
+  options.level0_file_num_compaction_trigger = 1;
+  options.level0_slowdown_writes_trigger = 1;
+  options.delayed_write_rate = 4 << 20;
+  Reopen(&options);
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &property));
+  ASSERT_EQ("0", property);
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &property));
+  ASSERT_EQ("0", property);
+
+  // Every level-0 file now slows writes down; they must still all succeed
+  // and the reported rate never exceeds the configured one.
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &property));
+    ASSERT_LE(std::strtoull(property.c_str(), nullptr, 10),
+              options.delayed_write_rate);
+  }
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(1000, Get(Key(i)).size());
+  }
+
+  // A batch group is charged for the writes of all its members, so
+  // concurrent writers together are held to the configured rate.  Writes
+  // stay delayed while two level-0 files wait for a compaction that the
+  // rate limiter stretches to at least a second.
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, 10000);
+  options.create_if_missing = true;
+  options.write_buffer_size = 4 << 20;  // No flushes while writing
+  options.level0_file_num_compaction_trigger = 2;
+  options.level0_slowdown_writes_trigger = 2;
+  options.delayed_write_rate = 512 << 10;
+  options.rate_limiter = limiter;
+  DestroyAndReopen(&options);
+  for (int file = 0; file < 2; file++) {
+    for (int i = 0; i < 500; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
 
-  // Compact all
-  MakeTables(1, "a", "z");
-  ASSERT_EQ("0,1,2", FilesPerLevel());
-  db_->CompactRange(nullptr, nullptr);
-  ASSERT_EQ("0,0,1", FilesPerLevel());
+  static const int kThreads = 8;
+  static const int kWritesPerThread = 16;
+  static const int kValueSize = 2000;
+  struct WriterState {
+    DB* db;
+    int id;
+    std::atomic<int>* remaining;
+
+    static void Run(void* arg) {
+      WriterState* state = reinterpret_cast<WriterState*>(arg);
+      Random rnd(state->id);
+      for (int i = 0; i < kWritesPerThread; i++) {
+        char key[100];
+        std::snprintf(key, sizeof(key), "%d.%d", state->id, i);
+        ASSERT_LEVELDB_OK(state->db->Put(WriteOptions(), key,
+                                         RandomString(&rnd, kValueSize)));
+      }
+      state->remaining->fetch_sub(1, std::memory_order_release);
+    }
+  };
+  std::atomic<int> remaining(kThreads);
+  WriterState states[kThreads];
+  const uint64_t start_micros = env_->NowMicros();
+  for (int id = 0; id < kThreads; id++) {
+    states[id].db = db_;
+    states[id].id = id;
+    states[id].remaining = &remaining;
+    env_->StartThread(&WriterState::Run, &states[id]);
+  }
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    DelayMilliseconds(1);
+  }
+  const uint64_t elapsed_micros = env_->NowMicros() - start_micros;
+  const uint64_t bytes = kThreads * kWritesPerThread * kValueSize;
+  // Allow for the first group, which is admitted without a delay.
+  ASSERT_GE(elapsed_micros, bytes * 800000 / options.delayed_write_rate);
+  Close();
+  delete limiter;
 }
 
-TEST_F(DBTest, DBOpen_Options) {
-  std::string dbname = testing::TempDir() + "db_options_test";
-  DestroyDB(dbname, Options());
+TEST_F(DBTest, RateLimiter) {
+  RateLimiter* limiter = NewGenericRateLimiter(64 << 20, 10000);
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.rate_limiter = limiter;
+  Reopen(&options);
 
-  // Does not exist, and create_if_missing == false: error
-  DB* db = nullptr;
-  Options opts;
-  opts.create_if_missing = false;
-  Status s = DB::Open(opts, dbname, &db);
-  ASSERT_TRUE(strstr(s.ToString().c_str(), "does not exist") != nullptr);
-  ASSERT_TRUE(db == nullptr);
+  // Overwrite every key so compactions cannot just move files.
+  Random rnd(301);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
 
-  // Does not exist, and create_if_missing == true: OK
+  // Flushes are charged at high priority, compactions at low priority.
+  const int64_t high = limiter->GetTotalBytesThrough(Env::kHighPriority);
+  const int64_t low = limiter->GetTotalBytesThrough(Env::kLowPriority);
+  ASSERT_GT(high, 0);
+  ASSERT_GT(low, 0);
+
+  // The limit can be changed while the DB is open.
+  limiter->SetBytesPerSecond(16 << 20);
+  ASSERT_EQ(16 << 20, limiter->GetBytesPerSecond());
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(limiter->GetTotalBytesThrough(Env::kHighPriority), high);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(1000, Get(Key(i)).size());
+  }
+  Close();
+  delete limiter;
+}
+
+TEST_F(DBTest, DirectIO) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.use_direct_reads = true;
+  options.use_direct_io_for_flush_and_compaction = true;
+  Reopen(&options);
+
+  // Values of odd sizes, so that tables do not end on block boundaries.
+  Random rnd(301);
+  std::vector<std::string> values(1000);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 1000; i++) {
+      values[i] = RandomString(&rnd, 100 + rnd.Uniform(1000));
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  // The tables can be read back without direct I/O.
+  options.use_direct_reads = false;
+  Reopen(&options);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ(values[i], iter->value().ToString());
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(1000, i);
+  delete iter;
+}
+
+TEST_F(DBTest, ManualCompaction) {
+  ASSERT_EQ(last_options_.max_mem_compaction_level, 2)
+      << "Need to update this test to match max_mem_compaction_level";
+
+  MakeTables(3, "p", "q");
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+
+  // Compaction range falls before files
+  Compact("", "c");
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+
+  // Compaction range falls after files
+  Compact("r", "z");
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+
+  // Compaction range overlaps files
+  Compact("p1", "p9");
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // Populate a different range
+  MakeTables(3, "c", "e");
+  ASSERT_EQ("1,1,2", FilesPerLevel());
+
+  // Compact just the new range
+  Compact("b", "f");
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+
+  // Compact all
+  MakeTables(1, "a", "z");
+  ASSERT_EQ("0,1,2", FilesPerLevel());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+}
+
+TEST_F(DBTest, DBOpen_Options) {
+  std::string dbname = testing::TempDir() + "db_options_test";
+  DestroyDB(dbname, Options());
+
+  // Does not exist, and create_if_missing == false: error
+  DB* db = nullptr;
+  Options opts;
+  opts.create_if_missing = false;
+  Status s = DB::Open(opts, dbname, &db);
+  ASSERT_TRUE(strstr(s.ToString().c_str(), "does not exist") != nullptr);
+  ASSERT_TRUE(db == nullptr);
+
+  // Does not exist, and create_if_missing == true: OK
   opts.create_if_missing = true;
   s = DB::Open(opts, dbname, &db);
   ASSERT_LEVELDB_OK(s);
@@ -1873,7 +2674,7 @@ TEST_F(DBTest, ManifestWriteError) {
     // Memtable compaction (will succeed)
     dbfull()->TEST_CompactMemTable();
     ASSERT_EQ("bar", Get("foo"));
-    const int last = config::kMaxMemCompactLevel;
+    const int last = last_options_.max_mem_compaction_level;
     ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo=>bar is now in last level
 
     // Merging compaction (will fail)
@@ -1979,6 +2780,476 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, FullFileFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Tables with per-block filters stay usable next to full-file ones.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  options.full_file_filter = true;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "new" + Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ((i % 100 == 0 ? "new" : "") + Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  // Compactions rewrite the old tables with full-file filters.
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 7) {
+    ASSERT_EQ((i % 100 == 0 ? "new" : "") + Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Without a cache every lookup reads the filter partition, and those
+  // that pass it the index partition and the data block too.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_EQ(3 * N, reads);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, N + 2 * 3 * N / 100);
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(Key(count), iter->key().ToString());
+  }
+  ASSERT_EQ(0, count);
+  delete iter;
+
+  // Tables with a single index remain readable next to partitioned ones.
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  options.partition_index_and_filters = false;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "new" + Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i += 7) {
+    ASSERT_EQ((i % 100 == 0 ? "new" : "") + Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, DataBlockHashIndex) {
+  Options options = CurrentOptions();
+  options.data_block_hash_index = true;
+  Reopen(&options);
+
+  // Several versions of each key, some of them hidden from a snapshot,
+  // spread the entries of a key over more than one restart interval.
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v1." + Key(i)));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int round = 2; round <= 20; round++) {
+    for (int i = 0; i < N; i += round) {
+      ASSERT_LEVELDB_OK(
+          Put(Key(i), "v" + std::to_string(round) + "." + Key(i)));
+    }
+  }
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  for (int i = 0; i < N; i++) {
+    std::string expected = "v1." + Key(i);
+    for (int round = 20; round >= 2; round--) {
+      if (i % round == 0) {
+        expected = "v" + std::to_string(round) + "." + Key(i);
+        break;
+      }
+    }
+    ASSERT_EQ(i % 3 == 0 ? "NOT_FOUND" : expected, Get(Key(i)));
+    ASSERT_EQ("v1." + Key(i), Get(Key(i), snapshot));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + "x"));
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  // Tables without a hash index stay readable next to those with one.
+  options.data_block_hash_index = false;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put(Key(0), "new"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("new", Get(Key(0)));
+  ASSERT_EQ("v1." + Key(1), Get(Key(1)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(3)));
+}
+
+static uint64_t NumberProperty(DB* db, const char* property) {
+  std::string value;
+  EXPECT_TRUE(db->GetProperty(property, &value)) << property;
+  return std::stoull(value);
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(100 * 1024);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  ASSERT_EQ(Key(0), Get(Key(0)));
+  const uint64_t held_memory =
+      NumberProperty(db_, "leveldb.table-readers-memory");
+  ASSERT_GT(held_memory, 0);
+  ASSERT_EQ(0, NumberProperty(db_,
+                              "leveldb.block-cache-index-and-filter-usage"));
+
+  options.cache_index_and_filter_blocks = true;
+  Reopen(&options);
+  ASSERT_EQ(Key(0), Get(Key(0)));
+  const uint64_t cached_memory =
+      NumberProperty(db_, "leveldb.table-readers-memory");
+  ASSERT_LT(cached_memory, held_memory / 10);
+  const uint64_t index_and_filter_usage =
+      NumberProperty(db_, "leveldb.block-cache-index-and-filter-usage");
+  ASSERT_GT(index_and_filter_usage, 0);
+  ASSERT_LE(index_and_filter_usage,
+            NumberProperty(db_, "leveldb.block-cache-usage"));
+  ASSERT_GE(NumberProperty(db_, "leveldb.approximate-memory-usage"),
+            cached_memory + index_and_filter_usage);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  // Scanning more data than fits in the cache leaves the index and the
+  // filter in it.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  delete iter;
+  ASSERT_EQ(index_and_filter_usage,
+            NumberProperty(db_, "leveldb.block-cache-index-and-filter-usage"));
+  Close();
+  delete options.block_cache;
+
+  // Reads work even if the index and the filter are evicted right away.
+  options.block_cache = NewLRUCache(0);
+  Reopen(&options);
+  for (int i = 0; i < N; i += 7) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  const std::string lookups[] = {Key(1), Key(2), Key(3) + ".missing",
+                                 Key(4)};
+  std::vector<Slice> keys(std::begin(lookups), std::end(lookups));
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  ASSERT_LEVELDB_OK(statuses[0]);
+  ASSERT_EQ(Key(2), values[1]);
+  ASSERT_TRUE(statuses[2].IsNotFound());
+  ASSERT_EQ(Key(4), values[3]);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, StrictBlockCacheLimit) {
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  const size_t kCapacity = 64 * 1024;
+  options.block_cache = NewLRUCache(kCapacity, 0, true);
+  options.cache_index_and_filter_blocks = true;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Iterators pin a block each, until the cache is full of pinned blocks.
+  std::vector<Iterator*> iters;
+  for (int i = 0; i < N; i += N / 50) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek(Key(i));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    iters.push_back(iter);
+  }
+  ASSERT_LE(NumberProperty(db_, "leveldb.block-cache-usage"), kCapacity);
+
+  // Blocks that do not fit are read uncached.
+  for (int i = 0; i < N; i += 13) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  ASSERT_LE(NumberProperty(db_, "leveldb.block-cache-usage"), kCapacity);
+  std::vector<Cache::ShardStats> stats;
+  options.block_cache->GetShardStats(&stats);
+  ASSERT_EQ(1, stats.size());
+  ASSERT_GT(stats[0].failed_inserts, 0);
+  ASSERT_GT(stats[0].pinned_usage, 0);
+  ASSERT_GT(stats[0].hits, 0);
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-stats", &property));
+  ASSERT_NE(std::string::npos, property.find("FailedInserts"));
+
+  for (Iterator* iter : iters) {
+    delete iter;
+  }
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, PersistentCache) {
+  env_->copy_random_reads_ = true;
+  env_->count_random_reads_ = true;
+  Env* cache_env = NewMemEnv(Env::Default());
+  PersistentCache* persistent_cache;
+  ASSERT_LEVELDB_OK(NewFilePersistentCache(cache_env, "/pcache", 1 << 20,
+                                           &persistent_cache));
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.persistent_cache = persistent_cache;
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  // Every block is in the persistent cache now.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  const PersistentCache::Stats stats = persistent_cache->GetStats();
+  ASSERT_GE(stats.hits, N);
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.persistent-cache-stats", &property));
+  ASSERT_NE(std::string::npos, property.find("Hits:"));
+
+  // The blocks stay reachable when the tables are opened again.
+  dbfull()->TEST_EvictTables();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  const PersistentCache::Stats reopened = persistent_cache->GetStats();
+  ASSERT_GE(reopened.hits, stats.hits + N);
+  ASSERT_EQ(stats.lookups - stats.hits, reopened.lookups - reopened.hits);
+
+  Close();
+  delete options.block_cache;
+  delete persistent_cache;
+  delete cache_env;
+}
+
+static std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "p%03d/%04d", prefix, i);
+  return std::string(buf);
+}
+
+TEST_F(DBTest, PrefixScan) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Even prefixes only, spread over a compacted level and level-0.
+  const int kPrefixes = 200;
+  const int kPerPrefix = 20;
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int i = 0; i < kPerPrefix; i += 2) {
+      ASSERT_LEVELDB_OK(Put(PrefixKey(p, i), "v"));
+    }
+  }
+  Compact("a", "z");
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int i = 1; i < kPerPrefix; i += 2) {
+      ASSERT_LEVELDB_OK(Put(PrefixKey(p, i), "v"));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  ReadOptions ropts;
+  ropts.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ropts);
+  for (int p = 0; p < kPrefixes; p += 2) {
+    int count = 0;
+    for (iter->Seek(PrefixKey(p, 0).substr(0, 4)); iter->Valid();
+         iter->Next()) {
+      ASSERT_EQ(PrefixKey(p, count), iter->key().ToString());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(kPerPrefix, count);
+  }
+
+  // Absent prefixes are ruled out by the filters.
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes; p += 2) {
+    iter->Seek(PrefixKey(p, 0));
+    ASSERT_TRUE(!iter->Valid());
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing prefixes => %d reads\n", kPrefixes / 2,
+               reads);
+  ASSERT_LE(reads, kPrefixes / 10);
+
+  // Prefix iterators cannot move backwards.
+  iter->Seek(PrefixKey(4, 3));
+  ASSERT_EQ(PrefixKey(4, 3), iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  // Without prefix_same_as_start, a missing prefix finds the next key.
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek(PrefixKey(5, 0));
+  ASSERT_EQ(PrefixKey(6, 0), iter->key().ToString());
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, IterateUpperBound) {
+  do {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    ASSERT_LEVELDB_OK(Delete(Key(49)));
+    ASSERT_LEVELDB_OK(Put(Key(50), "new"));
+
+    Slice upper("key000051");
+    ReadOptions ropts;
+    ropts.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(ropts);
+    iter->Seek(Key(47));
+    ASSERT_EQ(IterStatus(iter), "key000047->key000047");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "key000048->key000048");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "key000050->new");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "key000050->new");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "key000048->key000048");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "key000050->new");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_EQ(50, count);
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -2127,6 +3398,11 @@ class ModelDB : public DB {
     assert(false);  // Not implemented
     return Status::NotFound(key);
   }
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override {
+    assert(false);  // Not implemented
+  }
   Iterator* NewIterator(const ReadOptions& options) override {
     if (options.snapshot == nullptr) {
       KVMap* saved = new KVMap;
@@ -2155,6 +3431,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2327,7 +3609,10 @@ TEST_F(DBTest, Randomized) {
             // Periodically re-use the same key from the previous iter, so
             // we have multiple entries in the write batch for the same key
           }
-          if (rnd.OneIn(2)) {
+          if (rnd.OneIn(20)) {
+            // Every key starting with k
+            b.DeleteRange(k, k + "\xff");
+          } else if (rnd.OneIn(2)) {
             v = RandomString(&rnd, rnd.Uniform(10));
             b.Put(k, v);
           } else {
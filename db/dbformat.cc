@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -96,7 +97,19 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
-const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p), prefix_extractor_(prefix_extractor) {
+  if (user_policy_ != nullptr) {
+    name_ = user_policy_->Name();
+    if (prefix_extractor_ != nullptr) {
+      name_.append(":");
+      name_.append(prefix_extractor_->Name());
+    }
+  }
+}
+
+const char* InternalFilterPolicy::Name() const { return name_.c_str(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
@@ -107,7 +120,26 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == nullptr) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Keys arrive in sorted order, so equal prefixes are adjacent.
+  std::vector<Slice> all(keys, keys + n);
+  Slice last_prefix;
+  bool has_last_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_last_prefix || prefix != last_prefix) {
+        all.push_back(prefix);
+        last_prefix = prefix;
+        has_last_prefix = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(all.data(), static_cast<int>(all.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
@@ -88,6 +88,14 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
@@ -167,43 +175,52 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
 
   ReadOptions ro;
   ro.fill_cache = false;
-  Iterator* iter = table->NewIterator(ro);
+  // Range tombstones, if any, are listed after the point entries.
+  Iterator* iters[] = {table->NewIterator(ro),
+                       table->NewRangeTombstoneIterator()};
   std::string r;
-  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-    r.clear();
-    ParsedInternalKey key;
-    if (!ParseInternalKey(iter->key(), &key)) {
-      r = "badkey '";
-      AppendEscapedStringTo(&r, iter->key());
-      r += "' => '";
-      AppendEscapedStringTo(&r, iter->value());
-      r += "'\n";
-      dst->Append(r);
-    } else {
-      r = "'";
-      AppendEscapedStringTo(&r, key.user_key);
-      r += "' @ ";
-      AppendNumberTo(&r, key.sequence);
-      r += " : ";
-      if (key.type == kTypeDeletion) {
-        r += "del";
-      } else if (key.type == kTypeValue) {
-        r += "val";
+  for (Iterator* iter : iters) {
+    if (iter == nullptr) {
+      continue;
+    }
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      r.clear();
+      ParsedInternalKey key;
+      if (!ParseInternalKey(iter->key(), &key)) {
+        r = "badkey '";
+        AppendEscapedStringTo(&r, iter->key());
+        r += "' => '";
+        AppendEscapedStringTo(&r, iter->value());
+        r += "'\n";
+        dst->Append(r);
       } else {
-        AppendNumberTo(&r, key.type);
+        r = "'";
+        AppendEscapedStringTo(&r, key.user_key);
+        r += "' @ ";
+        AppendNumberTo(&r, key.sequence);
+        r += " : ";
+        if (key.type == kTypeDeletion) {
+          r += "del";
+        } else if (key.type == kTypeValue) {
+          r += "val";
+        } else if (key.type == kTypeRangeDeletion) {
+          r += "delrange";
+        } else {
+          AppendNumberTo(&r, key.type);
+        }
+        r += " => '";
+        AppendEscapedStringTo(&r, iter->value());
+        r += "'\n";
+        dst->Append(r);
       }
-      r += " => '";
-      AppendEscapedStringTo(&r, iter->value());
-      r += "'\n";
-      dst->Append(r);
     }
-  }
-  s = iter->status();
-  if (!s.ok()) {
-    dst->Append("iterator error: " + s.ToString() + "\n");
+    s = iter->status();
+    if (!s.ok()) {
+      dst->Append("iterator error: " + s.ToString() + "\n");
+    }
+    delete iter;
   }
 
-  delete iter;
   delete table;
   delete file;
   return Status::OK();
@@ -5,12 +5,14 @@
 #include "db/memtable.h"
 
 #include "db/dbformat.h"
+#include "db/range_del.h"
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -28,7 +30,12 @@ static void printSlice(Slice s) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      num_range_dels_(0),
+      range_del_count_(0) {}
 
 MemTable::~MemTable() { assert(refs_ == 0); }
 
@@ -82,6 +89,35 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  Table::Iterator iter(&range_del_table_);
+  iter.SeekToFirst();
+  if (!iter.Valid()) {
+    return nullptr;
+  }
+  return new MemTableIterator(&range_del_table_);
+}
+
+std::shared_ptr<const RangeDelAggregator> MemTable::RangeTombstones() {
+  const int count = num_range_dels_.load(std::memory_order_acquire);
+  if (count == 0) {
+    return nullptr;
+  }
+  MutexLock l(&range_del_mutex_);
+  if (range_del_count_ != count) {
+    // Tombstones added while this runs are picked up too; they only make
+    // the next rebuild come sooner.
+    RangeDelAggregator* agg =
+        new RangeDelAggregator(comparator_.comparator.user_comparator());
+    MemTableIterator iter(&range_del_table_);
+    agg->AddTombstones(&iter);
+    agg->Finish();
+    range_del_.reset(agg);
+    range_del_count_ = count;
+  }
+  return range_del_;
+}
+
 // hint:
 // - user MemTable.table_(SkipList) to save the kv data
 // - key size and value size use varint32 save
@@ -93,6 +129,16 @@ Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
+  Add(s, type, key, value, false);
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  Add(s, type, key, value, true);
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value, bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -106,7 +152,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
 
   int total_size = VarintLength(internal_key_size) + internal_key_size +
                    VarintLength(value.size()) + value.size();
-  char* buffer = arena_.Allocate(total_size);
+  char* buffer = concurrent ? arena_.AllocateConcurrently(total_size)
+                            : arena_.Allocate(total_size);
   // point to the head
   char* p = buffer;
   p = EncodeVarint32(p, internal_key_size);
@@ -117,7 +164,15 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p += 8;
   p = EncodeVarint32(p, value.size());
   memcpy(p, value.data(), value.size());
-  table_.Insert(buffer);
+  Table* table = (type == kTypeRangeDeletion) ? &range_del_table_ : &table_;
+  if (concurrent) {
+    table->InsertConcurrently(buffer);
+  } else {
+    table->Insert(buffer);
+  }
+  if (type == kTypeRangeDeletion) {
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+  }
   // print result
   // std::fprintf(stdout, "memtable add[finish]...");
   // printSlice(key);
@@ -142,10 +197,20 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   // all entries with overly large sequence numbers.
 
   // MemTable implement
+  // Everything older than the memtable lives in older memtables or in
+  // tables, so a covering tombstone settles the lookup unless this
+  // memtable holds an even newer entry for the key.
+  const SequenceNumber tombstone_seq =
+      MaxCoveringTombstone(key.user_key(), key.sequence());
+
   Table::Iterator iterator(&table_);
   Slice memtable_key = key.memtable_key();
   iterator.Seek(memtable_key.data());
   if (!iterator.Valid()) {
+    if (tombstone_seq > 0) {
+      *s = Status::NotFound(Slice());
+      return true;
+    }
     return false;
   }
   const char* item = iterator.key();
@@ -155,12 +220,16 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   Slice keySlice2(key.user_key());
   if (comparator_.comparator.user_comparator()->Compare(keySlice1, keySlice2) !=
       0) {
+    if (tombstone_seq > 0) {
+      *s = Status::NotFound(Slice());
+      return true;
+    }
     return false;
   }
   // get type
   uint64_t tag = DecodeFixed64(p + key_size - 8);
   ValueType type = static_cast<ValueType>(tag & 0xff);
-  if (ValueType::kTypeValue == type) {
+  if (ValueType::kTypeValue == type && (tag >> 8) > tombstone_seq) {
     // get value from item
     p += key_size;
     Slice valueSlice = GetLengthPrefixedSlice(p);
@@ -176,4 +245,13 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   return true;
 }
 
+SequenceNumber MemTable::MaxCoveringTombstone(const Slice& user_key,
+                                              SequenceNumber snapshot) {
+  std::shared_ptr<const RangeDelAggregator> range_del = RangeTombstones();
+  if (range_del == nullptr) {
+    return 0;
+  }
+  return range_del->MaxCoveringSequence(user_key, snapshot);
+}
+
 }  // namespace leveldb
@@ -5,17 +5,22 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
 
 #include "db/dbformat.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class RangeDelAggregator;
 
 class MemTable {
  public:
@@ -50,15 +55,34 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones in the memtable, or
+  // nullptr if there are none.  Keys are internal keys holding the begin
+  // of each deleted range and values are the (exclusive) end keys.  The
+  // same lifetime rules as for NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
+  // Return the range tombstones in the memtable, fragmented for lookups,
+  // or nullptr if there are none.  The result is cached until the next
+  // tombstone is added, and stays valid for as long as the caller holds it.
+  std::shared_ptr<const RangeDelAggregator> RangeTombstones();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, key is the begin and value the end of the
+  // deleted range.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called by several threads at once.  Must not
+  // be mixed with concurrent calls to Add().
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone covering
+  // key that is newer than any value for it, store a NotFound() error in
+  // *status and return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
@@ -76,10 +100,28 @@ class MemTable {
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  void Add(SequenceNumber seq, ValueType type, const Slice& key,
+           const Slice& value, bool concurrent);
+
+  // Return the largest sequence number not above "snapshot" of the range
+  // tombstones covering "user_key", or zero if there is none.
+  SequenceNumber MaxCoveringTombstone(const Slice& user_key,
+                                      SequenceNumber snapshot);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;  // Range tombstones, kept apart from point entries
+
+  // Number of tombstones in range_del_table_.  Bumped after each insert.
+  std::atomic<int> num_range_dels_;
+
+  port::Mutex range_del_mutex_;
+  std::shared_ptr<const RangeDelAggregator> range_del_
+      GUARDED_BY(range_del_mutex_);
+  // Value of num_range_dels_ when range_del_ was built.
+  int range_del_count_ GUARDED_BY(range_del_mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,207 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+RangeDelAggregator::RangeDelAggregator(const Comparator* user_comparator)
+    : ucmp_(user_comparator), finished_(false) {}
+
+void RangeDelAggregator::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber seq) {
+  assert(!finished_);
+  if (ucmp_->Compare(begin, end) < 0) {
+    tombstones_.push_back(RangeTombstone(begin, end, seq));
+  }
+}
+
+Status RangeDelAggregator::AddTombstones(Iterator* iter,
+                                         SequenceNumber snapshot) {
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    if (ikey.sequence <= snapshot) {
+      Add(ikey.user_key, iter->value(), ikey.sequence);
+    }
+  }
+  return iter->status();
+}
+
+void RangeDelAggregator::AddAll(const RangeDelAggregator& other,
+                                SequenceNumber snapshot) {
+  assert(!finished_);
+  for (const RangeTombstone& t : other.tombstones_) {
+    if (t.seq <= snapshot) {
+      tombstones_.push_back(t);
+    }
+  }
+  for (const auto& child : other.children_) {
+    AddAll(*child, snapshot);
+  }
+}
+
+void RangeDelAggregator::AddChild(
+    std::shared_ptr<const RangeDelAggregator> child) {
+  assert(!finished_);
+  assert(child->finished_);
+  if (!child->empty()) {
+    children_.push_back(std::move(child));
+  }
+}
+
+void RangeDelAggregator::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  const Comparator* ucmp = ucmp_;
+  auto less = [ucmp](const std::string& a, const std::string& b) {
+    return ucmp->Compare(a, b) < 0;
+  };
+  for (const RangeTombstone& t : tombstones_) {
+    points_.push_back(t.begin);
+    points_.push_back(t.end);
+  }
+  std::sort(points_.begin(), points_.end(), less);
+  points_.erase(std::unique(points_.begin(), points_.end(),
+                            [ucmp](const std::string& a, const std::string& b) {
+                              return ucmp->Compare(a, b) == 0;
+                            }),
+                points_.end());
+
+  seqs_.resize(points_.size() - 1);
+  for (const RangeTombstone& t : tombstones_) {
+    size_t i = std::lower_bound(points_.begin(), points_.end(), t.begin,
+                                less) -
+               points_.begin();
+    for (; ucmp_->Compare(points_[i], t.end) < 0; i++) {
+      seqs_[i].push_back(t.seq);
+    }
+  }
+  for (std::vector<SequenceNumber>& seqs : seqs_) {
+    std::sort(seqs.begin(), seqs.end(), std::greater<SequenceNumber>());
+  }
+}
+
+SequenceNumber RangeDelAggregator::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  assert(finished_);
+  SequenceNumber result = 0;
+  for (const auto& child : children_) {
+    result = std::max(result, child->MaxCoveringSequence(user_key, snapshot));
+  }
+  return std::max(result, OwnMaxCoveringSequence(user_key, snapshot));
+}
+
+SequenceNumber RangeDelAggregator::OwnMaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  if (points_.empty()) {
+    return 0;
+  }
+  // Find the last fragment starting at or before user_key.
+  size_t left = 0;
+  size_t right = points_.size();
+  while (left < right) {
+    const size_t mid = left + (right - left) / 2;
+    if (ucmp_->Compare(points_[mid], user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0 || left == points_.size()) {
+    return 0;  // Before the first or at/after the last boundary
+  }
+  for (SequenceNumber seq : seqs_[left - 1]) {
+    if (seq <= snapshot) {
+      return seq;
+    }
+  }
+  return 0;
+}
+
+void RangeDelAggregator::GetClipped(const Slice* lower, const Slice* upper,
+                                    std::vector<RangeTombstone>* result) const {
+  result->clear();
+  std::vector<RangeTombstone> all = tombstones_;
+  for (const auto& child : children_) {
+    std::vector<RangeTombstone> pieces;
+    child->GetClipped(lower, upper, &pieces);
+    all.insert(all.end(), pieces.begin(), pieces.end());
+  }
+  for (const RangeTombstone& t : all) {
+    RangeTombstone clipped = t;
+    if (lower != nullptr && ucmp_->Compare(clipped.begin, *lower) < 0) {
+      clipped.begin = lower->ToString();
+    }
+    if (upper != nullptr && ucmp_->Compare(clipped.end, *upper) > 0) {
+      clipped.end = upper->ToString();
+    }
+    if (ucmp_->Compare(clipped.begin, clipped.end) < 0) {
+      result->push_back(clipped);
+    }
+  }
+
+  // Tombstones that were split across tables come back as adjacent
+  // pieces with the same sequence number; glue them together.
+  const Comparator* ucmp = ucmp_;
+  std::sort(result->begin(), result->end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              if (a.seq != b.seq) return a.seq > b.seq;
+              return ucmp->Compare(a.begin, b.begin) < 0;
+            });
+  size_t out = 0;
+  for (size_t i = 0; i < result->size(); i++) {
+    RangeTombstone& t = (*result)[i];
+    if (out > 0) {
+      RangeTombstone& last = (*result)[out - 1];
+      if (last.seq == t.seq && ucmp_->Compare(last.end, t.begin) >= 0) {
+        if (ucmp_->Compare(last.end, t.end) < 0) {
+          last.end.swap(t.end);
+        }
+        continue;
+      }
+    }
+    if (out != i) {
+      (*result)[out] = std::move(t);
+    }
+    out++;
+  }
+  result->resize(out);
+
+  // Internal key order: by begin key, then by decreasing sequence number.
+  std::sort(result->begin(), result->end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              const int r = ucmp->Compare(a.begin, b.begin);
+              if (r != 0) return r < 0;
+              return a.seq > b.seq;
+            });
+}
+
+void ExtendBoundsForTombstone(const Comparator* icmp, const Slice& start,
+                              const Slice& end, bool* has_bounds,
+                              InternalKey* smallest, InternalKey* largest) {
+  InternalKey limit(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (!*has_bounds || icmp->Compare(start, smallest->Encode()) < 0) {
+    smallest->DecodeFrom(start);
+  }
+  if (!*has_bounds || icmp->Compare(limit.Encode(), largest->Encode()) > 0) {
+    *largest = limit;
+  }
+  *has_bounds = true;
+}
+
+}  // namespace leveldb
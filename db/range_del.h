@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+
+// A range tombstone hides every entry whose user key lies in [begin, end)
+// and whose sequence number is smaller than seq.
+struct RangeTombstone {
+  RangeTombstone() : seq(0) {}
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), seq(s) {}
+
+  std::string begin;
+  std::string end;
+  SequenceNumber seq;
+};
+
+// RangeDelAggregator collects range tombstones from memtables and tables
+// and answers whether a key is covered by any of them.
+//
+// Tombstones are split at every begin and end key into non-overlapping
+// fragments, each carrying the sequence numbers of all tombstones that
+// span it, so a lookup is a binary search regardless of how the original
+// tombstones overlap.
+//
+// An aggregator may also consult finished "child" aggregators, so that a
+// cached set of tombstones can be shared without being fragmented again.
+//
+// Add(), AddTombstones(), AddAll() and AddChild() must not be called after
+// Finish(); the query methods may only be called after Finish().  A
+// finished aggregator is immutable and may be read by several threads at
+// once.
+class RangeDelAggregator {
+ public:
+  explicit RangeDelAggregator(const Comparator* user_comparator);
+
+  RangeDelAggregator(const RangeDelAggregator&) = delete;
+  RangeDelAggregator& operator=(const RangeDelAggregator&) = delete;
+
+  // Add the tombstone [begin, end)@seq.  Empty ranges are ignored.
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // Add every tombstone yielded by "iter", whose keys are internal keys
+  // holding the begin key and sequence number and whose values are end
+  // keys.  Tombstones newer than "snapshot" are skipped.  Does not take
+  // ownership of "iter".
+  Status AddTombstones(Iterator* iter,
+                       SequenceNumber snapshot = kMaxSequenceNumber);
+
+  // Add the tombstones of "other" that are not newer than "snapshot".
+  void AddAll(const RangeDelAggregator& other,
+              SequenceNumber snapshot = kMaxSequenceNumber);
+
+  // Consult the tombstones of "child", which must be finished, as well as
+  // this aggregator's own.  Unlike AddAll(), no snapshot filter applies.
+  void AddChild(std::shared_ptr<const RangeDelAggregator> child);
+
+  void Finish();
+
+  bool empty() const { return tombstones_.empty() && children_.empty(); }
+
+  // Return the largest sequence number not above "snapshot" of the
+  // tombstones covering "user_key", or zero if there is none.
+  SequenceNumber MaxCoveringSequence(
+      const Slice& user_key,
+      SequenceNumber snapshot = kMaxSequenceNumber) const;
+
+  // Return true if a tombstone not newer than "snapshot" hides "key".
+  bool ShouldDelete(const ParsedInternalKey& key,
+                    SequenceNumber snapshot = kMaxSequenceNumber) const {
+    return MaxCoveringSequence(key.user_key, snapshot) > key.sequence;
+  }
+
+  // Store in *result the tombstones clipped to [*lower, *upper), with
+  // pieces of the same tombstone merged back together.  A null bound is
+  // unbounded.  The result is sorted by begin key.
+  void GetClipped(const Slice* lower, const Slice* upper,
+                  std::vector<RangeTombstone>* result) const;
+
+ private:
+  // MaxCoveringSequence() over this aggregator's own tombstones only.
+  SequenceNumber OwnMaxCoveringSequence(const Slice& user_key,
+                                        SequenceNumber snapshot) const;
+
+  const Comparator* const ucmp_;
+  bool finished_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<std::shared_ptr<const RangeDelAggregator>> children_;
+
+  // Fragment i covers [points_[i], points_[i + 1]) and is hidden by the
+  // tombstones with the sequence numbers seqs_[i], in decreasing order.
+  std::vector<std::string> points_;
+  std::vector<std::vector<SequenceNumber>> seqs_;
+};
+
+// Widen the file key range [*smallest, *largest] to include the tombstone
+// whose internal key is "start" and whose (exclusive) end user key is
+// "end".  The range is bounded above by the first possible entry of "end".
+// If *has_bounds is false the range is instead set to the tombstone's and
+// *has_bounds becomes true.  "icmp" compares internal keys.
+void ExtendBoundsForTombstone(const Comparator* icmp, const Slice& start,
+                              const Slice& end, bool* has_bounds,
+                              InternalKey* smallest, InternalKey* largest);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
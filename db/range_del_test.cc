@@ -0,0 +1,189 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include "gtest/gtest.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+static std::string Dump(const std::vector<RangeTombstone>& tombstones) {
+  std::string r;
+  for (const RangeTombstone& t : tombstones) {
+    if (!r.empty()) r += " ";
+    r += "[" + t.begin + "," + t.end + ")@" + std::to_string(t.seq);
+  }
+  return r;
+}
+
+TEST(RangeDelTest, Empty) {
+  RangeDelAggregator agg(BytewiseComparator());
+  agg.Add("b", "b", 5);  // Empty range
+  agg.Add("c", "a", 5);  // Reversed range
+  agg.Finish();
+  ASSERT_TRUE(agg.empty());
+  ASSERT_EQ(0, agg.MaxCoveringSequence("b"));
+}
+
+TEST(RangeDelTest, Covering) {
+  RangeDelAggregator agg(BytewiseComparator());
+  agg.Add("b", "f", 10);
+  agg.Add("d", "h", 20);
+  agg.Finish();
+
+  ASSERT_EQ(0, agg.MaxCoveringSequence("a"));
+  ASSERT_EQ(10, agg.MaxCoveringSequence("b"));
+  ASSERT_EQ(10, agg.MaxCoveringSequence("c"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("d"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("f"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("g"));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("h"));  // End is exclusive
+  ASSERT_EQ(0, agg.MaxCoveringSequence("z"));
+
+  // Snapshots only see older tombstones.
+  ASSERT_EQ(10, agg.MaxCoveringSequence("e", 15));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("g", 15));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("c", 5));
+
+  ASSERT_TRUE(agg.ShouldDelete(ParsedInternalKey("e", 19, kTypeValue)));
+  ASSERT_TRUE(!agg.ShouldDelete(ParsedInternalKey("e", 21, kTypeValue)));
+  ASSERT_TRUE(!agg.ShouldDelete(ParsedInternalKey("e", 9, kTypeValue), 5));
+}
+
+TEST(RangeDelTest, AddTombstones) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  ASSERT_TRUE(mem->NewRangeTombstoneIterator() == nullptr);
+  mem->Add(100, kTypeRangeDeletion, "a", "c");
+  mem->Add(200, kTypeRangeDeletion, "x", "z");
+  mem->Add(300, kTypeValue, "k", "v");
+
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  ASSERT_TRUE(iter != nullptr);
+  RangeDelAggregator agg(BytewiseComparator());
+  ASSERT_TRUE(agg.AddTombstones(iter, 150).ok());
+  delete iter;
+  agg.Finish();
+  ASSERT_EQ(100, agg.MaxCoveringSequence("b"));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("y"));  // Newer than the snapshot
+
+  // Memtable reads honour the tombstones as well.
+  std::string value;
+  Status s;
+  LookupKey hidden("b", 400);
+  ASSERT_TRUE(mem->Get(hidden, &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  LookupKey before("b", 50);
+  ASSERT_TRUE(!mem->Get(before, &value, &s));
+  LookupKey live("k", 400);
+  ASSERT_TRUE(mem->Get(live, &value, &s));
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ("v", value);
+  mem->Unref();
+}
+
+TEST(RangeDelTest, GetClipped) {
+  RangeDelAggregator agg(BytewiseComparator());
+  agg.Add("a", "e", 10);
+  agg.Add("c", "g", 20);
+  agg.Add("m", "p", 30);
+  agg.Finish();
+
+  std::vector<RangeTombstone> result;
+  agg.GetClipped(nullptr, nullptr, &result);
+  ASSERT_EQ("[a,e)@10 [c,g)@20 [m,p)@30", Dump(result));
+
+  Slice lower("d"), upper("n");
+  agg.GetClipped(&lower, &upper, &result);
+  // Same begin key: newest first, as in internal key order.
+  ASSERT_EQ("[d,g)@20 [d,e)@10 [m,n)@30", Dump(result));
+
+  Slice gap_lower("h"), gap_upper("k");
+  agg.GetClipped(&gap_lower, &gap_upper, &result);
+  ASSERT_EQ("", Dump(result));
+}
+
+TEST(RangeDelTest, GetClippedMergesPieces) {
+  // A tombstone split across two tables comes back whole.
+  RangeDelAggregator agg(BytewiseComparator());
+  agg.Add("a", "f", 10);
+  agg.Add("f", "k", 10);
+  agg.Add("c", "h", 5);
+  agg.Finish();
+  ASSERT_EQ(10, agg.MaxCoveringSequence("f"));
+
+  std::vector<RangeTombstone> result;
+  agg.GetClipped(nullptr, nullptr, &result);
+  ASSERT_EQ("[a,k)@10 [c,h)@5", Dump(result));
+}
+
+TEST(RangeDelTest, Children) {
+  RangeDelAggregator* child = new RangeDelAggregator(BytewiseComparator());
+  child->Add("b", "f", 10);
+  child->Finish();
+  std::shared_ptr<const RangeDelAggregator> shared(child);
+
+  RangeDelAggregator agg(BytewiseComparator());
+  agg.Add("d", "h", 20);
+  agg.AddChild(shared);
+  agg.Finish();
+  ASSERT_FALSE(agg.empty());
+  ASSERT_EQ(10, agg.MaxCoveringSequence("c"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("e"));
+  ASSERT_EQ(10, agg.MaxCoveringSequence("e", 15));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("h"));
+
+  std::vector<RangeTombstone> result;
+  agg.GetClipped(nullptr, nullptr, &result);
+  ASSERT_EQ("[b,f)@10 [d,h)@20", Dump(result));
+}
+
+TEST(RangeDelTest, MemTableCache) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  ASSERT_TRUE(mem->RangeTombstones() == nullptr);
+
+  mem->Add(10, kTypeRangeDeletion, "b", "f");
+  std::shared_ptr<const RangeDelAggregator> first = mem->RangeTombstones();
+  ASSERT_TRUE(first != nullptr);
+  ASSERT_EQ(first, mem->RangeTombstones());  // Cached
+  ASSERT_EQ(0, first->MaxCoveringSequence("g"));
+
+  // A new tombstone replaces the cached set; holders of the old one keep
+  // a valid copy.
+  mem->Add(20, kTypeRangeDeletion, "e", "k");
+  std::shared_ptr<const RangeDelAggregator> second = mem->RangeTombstones();
+  ASSERT_NE(first, second);
+  ASSERT_EQ(20, second->MaxCoveringSequence("g"));
+  ASSERT_EQ(10, first->MaxCoveringSequence("e"));
+  mem->Unref();
+}
+
+TEST(RangeDelTest, ExtendBounds) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  InternalKey smallest, largest;
+  bool has_bounds = false;
+  InternalKey start("d", 7, kTypeRangeDeletion);
+  ExtendBoundsForTombstone(&icmp, start.Encode(), "g", &has_bounds, &smallest,
+                           &largest);
+  ASSERT_TRUE(has_bounds);
+  ASSERT_EQ("d", smallest.user_key().ToString());
+  ASSERT_EQ("g", largest.user_key().ToString());
+
+  // A point entry at the end key sorts after the tombstone's bound.
+  InternalKey point("g", 3, kTypeValue);
+  ASSERT_LT(icmp.Compare(largest, point), 0);
+
+  InternalKey other("a", 9, kTypeRangeDeletion);
+  ExtendBoundsForTombstone(&icmp, other.Encode(), "b", &has_bounds, &smallest,
+                           &largest);
+  ASSERT_EQ("a", smallest.user_key().ToString());
+  ASSERT_EQ("g", largest.user_key().ToString());
+}
+
+}  // namespace leveldb
@@ -31,12 +31,14 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/table.h"
 
 namespace leveldb {
 
@@ -48,7 +50,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -203,8 +205,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -224,12 +229,14 @@ class Repairer {
     }
   }
 
-  Iterator* NewTableIterator(const FileMetaData& meta) {
+  Iterator* NewTableIterator(const FileMetaData& meta,
+                             Table** tableptr = nullptr) {
     // Same as compaction iterators: if paranoid_checks are on, turn
     // on checksum verification.
     ReadOptions r;
     r.verify_checksums = options_.paranoid_checks;
-    return table_cache_->NewIterator(r, meta.number, meta.file_size);
+    return table_cache_->NewIterator(r, meta.number, meta.file_size,
+                                     meta.global_seqno, tableptr);
   }
 
   void ScanTable(uint64_t number) {
@@ -255,7 +262,8 @@ class Repairer {
 
     // Extract metadata by scanning through table.
     int counter = 0;
-    Iterator* iter = NewTableIterator(t.meta);
+    Table* table;
+    Iterator* iter = NewTableIterator(t.meta, &table);
     bool empty = true;
     ParsedInternalKey parsed;
     t.max_sequence = 0;
@@ -280,6 +288,30 @@ class Repairer {
     if (!iter->status().ok()) {
       status = iter->status();
     }
+    Iterator* range_del_iter =
+        (table != nullptr) ? table->NewRangeTombstoneIterator() : nullptr;
+    if (range_del_iter != nullptr) {
+      bool has_bounds = !empty;
+      for (range_del_iter->SeekToFirst(); range_del_iter->Valid();
+           range_del_iter->Next()) {
+        Slice key = range_del_iter->key();
+        if (!ParseInternalKey(key, &parsed) ||
+            parsed.type != kTypeRangeDeletion) {
+          Log(options_.info_log, "Table #%llu: unparsable tombstone %s",
+              (unsigned long long)t.meta.number, EscapeString(key).c_str());
+          continue;
+        }
+        counter++;
+        t.meta.has_range_deletions = true;
+        ExtendBoundsForTombstone(&icmp_, key, range_del_iter->value(),
+                                 &has_bounds, &t.meta.smallest,
+                                 &t.meta.largest);
+        if (parsed.sequence > t.max_sequence) {
+          t.max_sequence = parsed.sequence;
+        }
+      }
+      delete range_del_iter;
+    }
     delete iter;
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
@@ -305,12 +337,24 @@ class Repairer {
     TableBuilder* builder = new TableBuilder(options_, file);
 
     // Copy data.
-    Iterator* iter = NewTableIterator(t.meta);
+    Table* table;
+    Iterator* iter = NewTableIterator(t.meta, &table);
     int counter = 0;
     for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
       builder->Add(iter->key(), iter->value());
       counter++;
     }
+    Iterator* range_del_iter =
+        (table != nullptr) ? table->NewRangeTombstoneIterator() : nullptr;
+    if (range_del_iter != nullptr) {
+      for (range_del_iter->SeekToFirst(); range_del_iter->Valid();
+           range_del_iter->Next()) {
+        builder->AddRangeTombstone(range_del_iter->key(),
+                                   range_del_iter->value());
+        counter++;
+      }
+      delete range_del_iter;
+    }
     delete iter;
 
     ArchiveFile(src);
@@ -369,7 +413,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.has_range_deletions);
     }
 
     // std::fprintf(stderr,
@@ -8,7 +8,9 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes via Insert() require external synchronization, most likely a
+// mutex.  Writes via InsertConcurrently() may run concurrently with each
+// other, but not with Insert().
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -21,15 +23,17 @@
 //
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
-// Only Insert() modifies the list, and it is careful to initialize
-// a node and use release-stores to publish the nodes in one or
-// more lists.
+// Only Insert() and InsertConcurrently() modify the list, and they are
+// careful to initialize a node and use release-stores (or
+// compare-and-swap) to publish the nodes in one or more lists.
 //
 // ... prev vs. next pointer ordering ...
 
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <functional>
+#include <thread>
 
 #include "util/arena.h"
 #include "util/random.h"
@@ -54,6 +58,14 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but safe to call from several threads at once.  Nodes
+  // are linked in with compare-and-swap, bottom level first, and retried
+  // from the current predecessor whenever another thread wins the race.
+  // REQUIRES: nothing that compares equal to key is currently in the
+  // list or being inserted concurrently.
+  // REQUIRES: no concurrent calls to Insert().
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -103,8 +115,8 @@ class SkipList {
     return max_height_.load(std::memory_order_relaxed);
   }
 
-  Node* NewNode(const Key& key, int height);
-  int RandomHeight();
+  Node* NewNode(const Key& key, int height, bool concurrent = false);
+  int RandomHeight(Random* rnd);
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -117,6 +129,11 @@ class SkipList {
   // node at "level" for every level in [0..max_height_-1].
   Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
 
+  // Starting at "before", which must precede key, advance along "level"
+  // until *prev precedes key and *next is at or after key.
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** prev, Node** next) const;
+
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
   Node* FindLessThan(const Key& key) const;
@@ -131,11 +148,12 @@ class SkipList {
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
+  // Modified only by inserts.  Read racily by readers, but stale
   // values are ok.
   std::atomic<int> max_height_;  // Height of the entire list
 
-  // Read/written only by Insert().
+  // Read/written only by Insert().  InsertConcurrently() uses a
+  // per-thread generator instead.
   Random rnd_;
 };
 
@@ -171,6 +189,15 @@ struct SkipList<Key, Comparator>::Node {
     next_[n].store(x, std::memory_order_relaxed);
   }
 
+  // Replace the link at level n with x iff it still points to "expected".
+  // Succeeds with release semantics, like SetNext().
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   std::atomic<Node*> next_[1];
@@ -178,9 +205,11 @@ struct SkipList<Key, Comparator>::Node {
 
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
-    const Key& key, int height) {
-  char* const node_memory = arena_->AllocateAligned(
-      sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+    const Key& key, int height, bool concurrent) {
+  const size_t bytes = sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1);
+  char* const node_memory = concurrent
+                                ? arena_->AllocateAlignedConcurrently(bytes)
+                                : arena_->AllocateAligned(bytes);
   return new (node_memory) Node(key);
 }
 
@@ -237,11 +266,11 @@ inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
 }
 
 template <typename Key, class Comparator>
-int SkipList<Key, Comparator>::RandomHeight() {
+int SkipList<Key, Comparator>::RandomHeight(Random* rnd) {
   // Increase height with probability 1 in kBranching
   static const unsigned int kBranching = 4;
   int height = 1;
-  while (height < kMaxHeight && rnd_.OneIn(kBranching)) {
+  while (height < kMaxHeight && rnd->OneIn(kBranching)) {
     height++;
   }
   assert(height > 0);
@@ -278,6 +307,23 @@ SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key,
+                                                   Node* before, int level,
+                                                   Node** prev,
+                                                   Node** next) const {
+  while (true) {
+    Node* after = before->Next(level);
+    if (KeyIsAfterNode(key, after)) {
+      before = after;
+    } else {
+      *prev = before;
+      *next = after;
+      return;
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node*
 SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
@@ -341,7 +387,7 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   // Our data structure does not allow duplicate insertion
   assert(x == nullptr || !Equal(key, x->key));
 
-  int height = RandomHeight();
+  int height = RandomHeight(&rnd_);
   if (height > GetMaxHeight()) {
     for (int i = GetMaxHeight(); i < height; i++) {
       prev[i] = head_;
@@ -365,6 +411,56 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+  // rnd_ is not thread-safe, so each inserting thread draws heights from
+  // its own generator.
+  static thread_local Random rnd(static_cast<uint32_t>(
+      std::hash<std::thread::id>()(std::this_thread::get_id())));
+  const int height = RandomHeight(&rnd);
+
+  // Raise max_height_ if needed.  As in Insert(), readers that observe
+  // the new height before the new levels are linked simply see nullptr
+  // from head_ and drop down a level.
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.compare_exchange_weak(max_height, height,
+                                          std::memory_order_relaxed)) {
+      max_height = height;
+      break;
+    }
+  }
+
+  // Compute the splice at every level, top-down.  Levels above the
+  // current list height start (and end) at head_.
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* before = head_;
+  for (int i = max_height - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, before, i, &prev[i], &next[i]);
+    before = prev[i];
+  }
+
+  // Our data structure does not allow duplicate insertion
+  assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+  Node* x = NewNode(key, height, true);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      // NoBarrier_SetNext() suffices since the CAS publishing "x" in
+      // prev[i] is a release operation.
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      // Another node was linked in after prev[i] at this level.  Nodes
+      // are never removed, so prev[i] still precedes key and we can
+      // resume the search from there.
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
@@ -365,4 +365,74 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+namespace {
+
+const int kInserterThreads = 4;
+const int kInsertsPerThread = 20000;
+
+struct ConcurrentInsertState {
+  ConcurrentInsertState() : list(Comparator(), &arena) {}
+
+  Arena arena;
+  SkipList<Key, Comparator> list;
+  std::atomic<int> threads_done{0};
+};
+
+struct ConcurrentInserter {
+  ConcurrentInsertState* state;
+  int id;
+};
+
+// Inserts random keys congruent to the thread id, so that threads never
+// insert the same key but constantly race for the same predecessors.
+void ConcurrentInserterBody(void* arg) {
+  ConcurrentInserter* inserter = reinterpret_cast<ConcurrentInserter*>(arg);
+  Random rnd(test::RandomSeed() + inserter->id);
+  std::set<Key> inserted;
+  while (inserted.size() < static_cast<size_t>(kInsertsPerThread)) {
+    Key key = rnd.Uniform(1 << 24) * kInserterThreads + inserter->id;
+    if (inserted.insert(key).second) {
+      inserter->state->list.InsertConcurrently(key);
+    }
+  }
+  inserter->state->threads_done.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST(SkipTest, InsertConcurrently) {
+  ConcurrentInsertState state;
+  ConcurrentInserter inserters[kInserterThreads];
+  for (int id = 0; id < kInserterThreads; id++) {
+    inserters[id].state = &state;
+    inserters[id].id = id;
+    Env::Default()->StartThread(ConcurrentInserterBody, &inserters[id]);
+  }
+  while (state.threads_done.load(std::memory_order_acquire) <
+         kInserterThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  // Every key must be linked in, in order.
+  SkipList<Key, Comparator>::Iterator iter(&state.list);
+  int count = 0;
+  Key prev = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    if (count > 0) {
+      ASSERT_LT(prev, iter.key());
+    }
+    ASSERT_TRUE(state.list.Contains(iter.key()));
+    prev = iter.key();
+    count++;
+  }
+  ASSERT_EQ(kInserterThreads * kInsertsPerThread, count);
+
+  // Backward iteration walks the upper levels as well.
+  count = 0;
+  for (iter.SeekToLast(); iter.Valid(); iter.Prev()) {
+    count++;
+  }
+  ASSERT_EQ(kInserterThreads * kInsertsPerThread, count);
+}
+
 }  // namespace leveldb
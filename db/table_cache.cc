@@ -4,8 +4,13 @@
 
 #include "db/table_cache.h"
 
+#include <atomic>
+#include <vector>
+
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
 
@@ -14,10 +19,201 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  // The table's range tombstones, fragmented once when the table is
+  // opened; nullptr if it has none.
+  RangeDelAggregator* range_del;
+  // The table's share of TableCache::memory_usage_.
+  size_t memory_usage;
+  std::atomic<size_t>* total_memory_usage;
+};
+
+namespace {
+
+// Presents the user keys of an ingested table as internal keys that all
+// carry the table's global sequence number.  Since an ingested table holds
+// each user key once, this preserves the order of its entries.
+class IngestedTableIterator : public Iterator {
+ public:
+  IngestedTableIterator(const InternalKeyComparator* icmp, Iterator* iter,
+                        SequenceNumber global_seqno)
+      : icmp_(icmp), iter_(iter), global_seqno_(global_seqno) {}
+
+  ~IngestedTableIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    iter_->Seek(ExtractUserKey(target));
+    SaveKey();
+    // Our entry for target's user key sorts before target if it is newer.
+    if (Valid() && icmp_->Compare(key_, target) < 0) {
+      Next();
+    }
+  }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    SaveKey();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    SaveKey();
+  }
+  void Next() override {
+    iter_->Next();
+    SaveKey();
+  }
+  void Prev() override {
+    iter_->Prev();
+    SaveKey();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return key_;
+  }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void SaveKey() {
+    key_.clear();
+    if (iter_->Valid()) {
+      AppendInternalKey(
+          &key_, ParsedInternalKey(iter_->key(), global_seqno_, kTypeValue));
+    }
+  }
+
+  const InternalKeyComparator* const icmp_;
+  Iterator* const iter_;
+  const SequenceNumber global_seqno_;
+  std::string key_;
 };
 
+// Used by iterators confined to one prefix: a Seek() whose prefix the
+// table's filter rules out leaves the iterator invalid without reading a
+// data block.  Every other call is forwarded as is.
+class PrefixFilterIterator : public Iterator {
+ public:
+  PrefixFilterIterator(const Table* table,
+                       const SliceTransform* prefix_extractor, Iterator* iter)
+      : table_(table),
+        prefix_extractor_(prefix_extractor),
+        iter_(iter),
+        filtered_(false) {}
+
+  ~PrefixFilterIterator() override { delete iter_; }
+
+  bool Valid() const override { return !filtered_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    const Slice user_key = ExtractUserKey(target);
+    if (prefix_extractor_->InDomain(user_key)) {
+      // The filter policy strips the trailer again.
+      filter_key_.clear();
+      AppendInternalKey(
+          &filter_key_,
+          ParsedInternalKey(prefix_extractor_->Transform(user_key),
+                            kMaxSequenceNumber, kValueTypeForSeek));
+      if (!table_->PrefixMayMatch(target, filter_key_)) {
+        filtered_ = true;
+        return;
+      }
+    }
+    filtered_ = false;
+    iter_->Seek(target);
+  }
+  void SeekToFirst() override {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return iter_->key();
+  }
+  Slice value() const override {
+    assert(Valid());
+    return iter_->value();
+  }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  const Table* const table_;
+  const SliceTransform* const prefix_extractor_;
+  Iterator* const iter_;
+  bool filtered_;  // The last Seek() was ruled out by the filter
+  std::string filter_key_;
+};
+
+// Forwards the results of a lookup in an ingested table as if it held
+// internal keys.  A lookup key older than the table does not see its entry.
+struct IngestedLookup {
+  const Comparator* ucmp;
+  SequenceNumber global_seqno;
+  const Slice* lookup_keys;  // Internal keys, one per MultiGet() index
+  void* arg;
+  void (*get_result)(void*, const Slice&, const Slice&);
+  void (*multi_get_result)(void*, size_t, const Slice&, const Slice&);
+
+  // Store the internal form of "user_key" in *result.  Returns false if
+  // the entry is not visible to lookup_keys[i].
+  bool Translate(size_t i, const Slice& user_key, std::string* result) const {
+    const Slice lookup = lookup_keys[i];
+    if (ucmp->Compare(user_key, ExtractUserKey(lookup)) == 0 &&
+        global_seqno > DecodeFixed64(lookup.data() + lookup.size() - 8) >> 8) {
+      return false;
+    }
+    AppendInternalKey(result,
+                      ParsedInternalKey(user_key, global_seqno, kTypeValue));
+    return true;
+  }
+};
+
+void SaveIngestedGet(void* arg, const Slice& k, const Slice& v) {
+  IngestedLookup* lookup = reinterpret_cast<IngestedLookup*>(arg);
+  std::string ikey;
+  if (lookup->Translate(0, k, &ikey)) {
+    (*lookup->get_result)(lookup->arg, ikey, v);
+  }
+}
+
+void SaveIngestedMultiGet(void* arg, size_t i, const Slice& k,
+                          const Slice& v) {
+  IngestedLookup* lookup = reinterpret_cast<IngestedLookup*>(arg);
+  std::string ikey;
+  if (lookup->Translate(i, k, &ikey)) {
+    (*lookup->multi_get_result)(lookup->arg, i, ikey, v);
+  }
+}
+
+}  // namespace
+
+Options IngestedTableOptions(const Options& options) {
+  Options result = options;
+  result.comparator =
+      static_cast<const InternalKeyComparator*>(options.comparator)
+          ->user_comparator();
+  if (options.filter_policy != nullptr) {
+    result.filter_policy =
+        static_cast<const InternalFilterPolicy*>(options.filter_policy)
+            ->user_policy();
+  }
+  return result;
+}
+
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  tf->total_memory_usage->fetch_sub(tf->memory_usage,
+                                    std::memory_order_relaxed);
+  delete tf->range_del;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -34,11 +230,24 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(NewLRUCache(entries)),
+      memory_usage_(0),
+      persistent_cache_id_(options.persistent_cache
+                               ? options.persistent_cache->NewId()
+                               : 0) {}
 
 TableCache::~TableCache() { delete cache_; }
 
+Status TableCache::OpenTableFile(const std::string& fname,
+                                 RandomAccessFile** file) {
+  if (options_.use_direct_reads) {
+    return env_->NewDirectRandomAccessFile(fname, file);
+  }
+  return env_->NewRandomAccessFile(fname, file);
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             SequenceNumber global_seqno,
                              Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
@@ -49,15 +258,41 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
+    s = OpenTableFile(fname, &file);
     if (!s.ok()) {
       std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
+      if (OpenTableFile(old_fname, &file).ok()) {
         s = Status::OK();
       }
     }
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
+      if (global_seqno != 0) {
+        s = Table::Open(IngestedTableOptions(options_), file, file_size,
+                        &table);
+      } else {
+        s = Table::Open(options_, file, file_size, &table);
+      }
+      if (s.ok()) {
+        table->SetPersistentCacheKey(persistent_cache_id_, file_number);
+      }
+    }
+    RangeDelAggregator* range_del = nullptr;
+    if (s.ok()) {
+      Iterator* iter = table->NewRangeTombstoneIterator();
+      if (iter != nullptr) {
+        const Comparator* ucmp =
+            static_cast<const InternalKeyComparator*>(options_.comparator)
+                ->user_comparator();
+        range_del = new RangeDelAggregator(ucmp);
+        s = range_del->AddTombstones(iter);
+        range_del->Finish();
+        delete iter;
+        if (!s.ok()) {
+          delete range_del;
+          delete table;
+          table = nullptr;
+        }
+      }
     }
 
     if (!s.ok()) {
@@ -69,6 +304,10 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_del = range_del;
+      tf->memory_usage = table->ApproximateMemoryUsage();
+      tf->total_memory_usage = &memory_usage_;
+      memory_usage_.fetch_add(tf->memory_usage, std::memory_order_relaxed);
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -77,19 +316,30 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
+                                  SequenceNumber global_seqno,
                                   Table** tableptr) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, global_seqno, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
+  if (global_seqno != 0) {
+    result = new IngestedTableIterator(
+        static_cast<const InternalKeyComparator*>(options_.comparator), result,
+        global_seqno);
+  } else if (options.prefix_same_as_start &&
+             options_.filter_policy != nullptr &&
+             options_.prefix_extractor != nullptr) {
+    // Only our own tables have filters that record prefixes.
+    result = new PrefixFilterIterator(table, options_.prefix_extractor, result);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -98,14 +348,97 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 }
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint64_t file_size, SequenceNumber global_seqno,
+                       const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&)) {
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, global_seqno, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (global_seqno != 0) {
+      IngestedLookup lookup;
+      lookup.ucmp =
+          static_cast<const InternalKeyComparator*>(options_.comparator)
+              ->user_comparator();
+      lookup.global_seqno = global_seqno;
+      lookup.lookup_keys = &k;
+      lookup.arg = arg;
+      lookup.get_result = handle_result;
+      lookup.multi_get_result = nullptr;
+      s = t->InternalGet(options, ExtractUserKey(k), &lookup,
+                         &SaveIngestedGet);
+    } else {
+      s = t->InternalGet(options, k, arg, handle_result);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, SequenceNumber global_seqno,
+                            const Slice* k, size_t n, void* arg,
+                            void (*handle_result)(void*, size_t, const Slice&,
+                                                  const Slice&)) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, global_seqno, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    if (global_seqno != 0) {
+      std::vector<Slice> user_keys(n);
+      for (size_t i = 0; i < n; i++) {
+        user_keys[i] = ExtractUserKey(k[i]);
+      }
+      IngestedLookup lookup;
+      lookup.ucmp =
+          static_cast<const InternalKeyComparator*>(options_.comparator)
+              ->user_comparator();
+      lookup.global_seqno = global_seqno;
+      lookup.lookup_keys = k;
+      lookup.arg = arg;
+      lookup.get_result = nullptr;
+      lookup.multi_get_result = handle_result;
+      s = t->InternalMultiGet(options, user_keys.data(), n, &lookup,
+                              &SaveIngestedMultiGet);
+    } else {
+      s = t->InternalMultiGet(options, k, n, arg, handle_result);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MaxCoveringTombstone(uint64_t file_number,
+                                        uint64_t file_size,
+                                        const Slice& user_key,
+                                        SequenceNumber snapshot,
+                                        SequenceNumber* seq) {
+  *seq = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, 0, &handle);
+  if (s.ok()) {
+    const RangeDelAggregator* range_del =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_del;
+    if (range_del != nullptr) {
+      *seq = range_del->MaxCoveringSequence(user_key, snapshot);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                                      SequenceNumber snapshot,
+                                      RangeDelAggregator* agg) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, 0, &handle);
+  if (s.ok()) {
+    const RangeDelAggregator* range_del =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_del;
+    if (range_del != nullptr) {
+      agg->AddAll(*range_del, snapshot);
+    }
     cache_->Release(handle);
   }
   return s;
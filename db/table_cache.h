@@ -7,6 +7,7 @@
 #ifndef STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -18,7 +19,15 @@
 namespace leveldb {
 
 class Env;
+class RangeDelAggregator;
 
+// Return the options for reading a table added by DB::IngestExternalFile(),
+// whose keys are user keys, given the sanitized options of its database.
+Options IngestedTableOptions(const Options& options);
+
+// Tables are identified by their file number and size.  A nonzero
+// "global_seqno" marks an ingested table (see FileMetaData): the cache then
+// presents its user keys as internal keys carrying that sequence number.
 class TableCache {
  public:
   TableCache(const std::string& dbname, const Options& options, int entries);
@@ -34,26 +43,66 @@ class TableCache {
   // underlying the returned iterator, or to nullptr if no Table object
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
-  // returned iterator is live.
+  // returned iterator is live.  The keys of an ingested "*tableptr" are
+  // user keys.  If options.prefix_same_as_start is set, a Seek() may leave
+  // the iterator invalid when the table holds no key with the target's
+  // prefix, even though it holds later keys.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, SequenceNumber global_seqno,
+                        Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  Entries of an
+  // ingested table that are newer than "k" are not reported.
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
+             uint64_t file_size, SequenceNumber global_seqno, const Slice& k,
+             void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Batched form of Get() for the sorted internal keys k[0,n-1].  For
+  // each i whose seek finds an entry, calls
+  // (*handle_result)(arg, i, found_key, found_value).
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, SequenceNumber global_seqno,
+                  const Slice* k, size_t n, void* arg,
+                  void (*handle_result)(void*, size_t, const Slice&,
+                                        const Slice&));
+
+  // Store in *seq the largest sequence number not above "snapshot" of the
+  // range tombstones in the specified file that cover "user_key", or zero
+  // if there is none.
+  Status MaxCoveringTombstone(uint64_t file_number, uint64_t file_size,
+                              const Slice& user_key, SequenceNumber snapshot,
+                              SequenceNumber* seq);
+
+  // Add the range tombstones of the specified file that are not newer
+  // than "snapshot" to *agg.  Ingested tables have no range tombstones.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            SequenceNumber snapshot, RangeDelAggregator* agg);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Returns the approximate number of bytes of memory held by the open
+  // tables, not counting blocks charged to the block cache.
+  size_t ApproximateMemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size,
+                   SequenceNumber global_seqno, Cache::Handle**);
+
+  // Opens the table file "fname", with direct I/O if the options ask for it.
+  Status OpenTableFile(const std::string& fname, RandomAccessFile** file);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  std::atomic<size_t> memory_usage_;
+  // Key prefix of this DB's tables in options_.persistent_cache
+  const uint64_t persistent_cache_id_;
 };
 
 }  // namespace leveldb
@@ -20,7 +20,9 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewFileWithRangeDel = 10,  // kNewFile for a table with range tombstones
+  kNewIngestedFile = 11       // kNewFile followed by the global seqno
 };
 
 void VersionEdit::Clear() {
@@ -75,12 +77,19 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    if (f.global_seqno != 0) {
+      PutVarint32(dst, kNewIngestedFile);
+    } else {
+      PutVarint32(dst, f.has_range_deletions ? kNewFileWithRangeDel : kNewFile);
+    }
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_seqno != 0) {
+      PutVarint64(dst, f.global_seqno);
+    }
   }
 }
 
@@ -176,16 +185,32 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDel:
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_deletions = (tag == kNewFileWithRangeDel);
+          f.global_seqno = 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kNewIngestedFile:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.global_seqno) && f.global_seqno != 0) {
+          f.has_range_deletions = false;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "ingested-file entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +275,14 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_deletions) {
+      r.append(" (range deletions)");
+    }
+    if (f.global_seqno != 0) {
+      r.append(" (ingested @");
+      AppendNumberTo(&r, f.global_seqno);
+      r.append(")");
+    }
   }
   r.append("\n}\n");
   return r;
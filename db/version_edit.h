@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 #define STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 
+#include <cassert>
 #include <set>
 #include <utility>
 #include <vector>
@@ -16,7 +17,13 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        being_compacted(false),
+        has_range_deletions(false),
+        global_seqno(0) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +31,11 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  bool being_compacted;  // Input of a running compaction (under DB mutex)
+  bool has_range_deletions;  // Table holds range tombstones
+  // Nonzero for a table added by DB::IngestExternalFile().  Its keys are
+  // plain user keys that all carry this sequence number.
+  SequenceNumber global_seqno;
 };
 
 class VersionEdit {
@@ -59,14 +71,21 @@ class VersionEdit {
 
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
-  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file,
+  // including the bounds of any range tombstones
+  // REQUIRES: !has_range_deletions || global_seqno == 0
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               bool has_range_deletions = false,
+               SequenceNumber global_seqno = 0) {
+    assert(!has_range_deletions || global_seqno == 0);
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
+    f.global_seqno = global_seqno;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -8,6 +8,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include <algorithm>
 #include <cstdio>
@@ -19,6 +20,7 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -44,9 +46,9 @@ static double MaxBytesForLevel(const Options* options, int level) {
   // the level-0 compaction threshold based on number of files.
 
   // Result for both level-0 and level-1
-  double result = 10. * 1048576.0;
+  double result = static_cast<double>(options->max_bytes_for_level_base);
   while (level > 1) {
-    result *= 10;
+    result *= options->max_bytes_for_level_multiplier;
     level--;
   }
   return result;
@@ -165,23 +167,49 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 // is the largest key that occurs in the file, and value() is an
 // 16-byte value containing the file number and file size, both
 // encoded using EncodeFixed64.
+//
+// If "upper_bound" is non-null, Next() stops at the first file whose keys
+// are all >= *upper_bound.  If "prefix_extractor" is non-null, Next() also
+// stops at the first file whose keys all lie past the prefix of the last
+// Seek() target.  Seeks are never cut short, so a caller moving backwards
+// may still see keys beyond these bounds.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
-      : icmp_(icmp), flist_(flist), index_(flist->size()) {  // Marks as invalid
-  }
+                       const std::vector<FileMetaData*>* flist,
+                       const SliceTransform* prefix_extractor = nullptr,
+                       const Slice* upper_bound = nullptr)
+      : icmp_(icmp),
+        flist_(flist),
+        prefix_extractor_(prefix_extractor),
+        upper_bound_(upper_bound),
+        index_(flist->size()),  // Marks as invalid
+        has_prefix_(false) {}
   bool Valid() const override { return index_ < flist_->size(); }
   void Seek(const Slice& target) override {
     index_ = FindFile(icmp_, *flist_, target);
+    const Slice user_key = ExtractUserKey(target);
+    has_prefix_ = prefix_extractor_ != nullptr &&
+                  prefix_extractor_->InDomain(user_key);
+    if (has_prefix_) {
+      Slice prefix = prefix_extractor_->Transform(user_key);
+      prefix_.assign(prefix.data(), prefix.size());
+    }
+  }
+  void SeekToFirst() override {
+    index_ = 0;
+    has_prefix_ = false;
   }
-  void SeekToFirst() override { index_ = 0; }
   void SeekToLast() override {
     index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    has_prefix_ = false;
   }
   void Next() override {
     assert(Valid());
     index_++;
+    if (Valid() && PastBounds((*flist_)[index_])) {
+      index_ = flist_->size();  // Marks as invalid
+    }
   }
   void Prev() override {
     assert(Valid());
@@ -199,36 +227,60 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
 
  private:
+  // Is every key of "f" beyond the bounds?  Next() only reaches files
+  // that start after the last Seek() target, so a file whose first key
+  // has another prefix holds no key with the target's prefix.
+  bool PastBounds(const FileMetaData* f) const {
+    const Slice smallest = f->smallest.user_key();
+    if (upper_bound_ != nullptr &&
+        icmp_.user_comparator()->Compare(smallest, *upper_bound_) >= 0) {
+      return true;
+    }
+    return has_prefix_ && prefix_extractor_->InDomain(smallest) &&
+           prefix_extractor_->Transform(smallest) != Slice(prefix_);
+  }
+
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const SliceTransform* const prefix_extractor_;
+  const Slice* const upper_bound_;
   uint32_t index_;
+  bool has_prefix_;     // prefix_ holds the prefix of the last Seek() target
+  std::string prefix_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? vset_->options_->prefix_extractor
+                                   : nullptr;
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      new LevelFileNumIterator(vset_->icmp_, &files_[level], prefix_extractor,
+                               options.iterate_upper_bound),
+      &GetFileIterator, vset_->table_cache_, options);
 }
 
 void Version::AddIterators(const ReadOptions& options,
@@ -236,7 +288,8 @@ void Version::AddIterators(const ReadOptions& options,
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+        options, files_[0][i]->number, files_[0][i]->file_size,
+        files_[0][i]->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -249,6 +302,38 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+Status Version::GetRangeTombstones(
+    std::shared_ptr<const RangeDelAggregator>* result) {
+  MutexLock l(&range_del_mutex_);
+  if (!range_del_built_) {
+    RangeDelAggregator* agg =
+        new RangeDelAggregator(vset_->icmp_.user_comparator());
+    Status s;
+    for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+      for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+        const FileMetaData* f = files_[level][i];
+        if (f->has_range_deletions) {
+          s = vset_->table_cache_->AddRangeTombstones(
+              f->number, f->file_size, kMaxSequenceNumber, agg);
+        }
+      }
+    }
+    if (!s.ok()) {
+      delete agg;
+      return s;  // Not cached, so the next call tries again
+    }
+    agg->Finish();
+    if (agg->empty()) {
+      delete agg;
+    } else {
+      range_del_.reset(agg);
+    }
+    range_del_built_ = true;
+  }
+  *result = range_del_;
+  return Status::OK();
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -262,6 +347,9 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  // Newest visible range tombstone covering user_key in the files probed
+  // so far; entries older than it are deleted.
+  SequenceNumber covering_seq;
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -271,7 +359,10 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->state = (parsed_key.type == kTypeValue &&
+                  parsed_key.sequence > s->covering_seq)
+                     ? kFound
+                     : kDeleted;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
       }
@@ -335,6 +426,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
     GetStats* stats;
     const ReadOptions* options;
     Slice ikey;
+    SequenceNumber snapshot;
     FileMetaData* last_file_read;
     int last_file_read_level;
 
@@ -355,9 +447,21 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      if (f->has_range_deletions) {
+        SequenceNumber seq;
+        state->s = state->vset->table_cache_->MaxCoveringTombstone(
+            f->number, f->file_size, state->saver.user_key, state->snapshot,
+            &seq);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+        state->saver.covering_seq = std::max(state->saver.covering_seq, seq);
+      }
+
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, f->global_seqno,
+          state->ikey, &state->saver, SaveValue);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -391,18 +495,198 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
   state.options = &options;
   state.ikey = k.internal_key();
+  state.snapshot = k.sequence();
   state.vset = vset_;
 
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.covering_seq = 0;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+namespace {
+// Callback state for a batch of lookups handed to TableCache::MultiGet().
+// batch[i] is the index of the Saver that receives the result for the
+// i-th key of the batch.
+struct BatchSaver {
+  Saver* savers;
+  const std::vector<size_t>* batch;
+};
+}  // namespace
+static void SaveBatchValue(void* arg, size_t index, const Slice& ikey,
+                           const Slice& v) {
+  BatchSaver* b = reinterpret_cast<BatchSaver*>(arg);
+  SaveValue(&b->savers[(*b->batch)[index]], ikey, v);
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& values,
+                       std::vector<Status>* statuses,
+                       std::vector<GetStats>* stats) {
+  struct State {
+    const ReadOptions* options;
+    const std::vector<const LookupKey*>* keys;
+    std::vector<Status>* statuses;
+    std::vector<GetStats>* stats;
+    VersionSet* vset;
+
+    std::vector<Saver> savers;
+    std::vector<FileMetaData*> last_file_read;
+    std::vector<int> last_file_read_level;
+    std::vector<bool> done;
+    size_t num_done;
+
+    // Look up every key of "batch" in "f" with a single table cache call
+    // and record which of them are now resolved.
+    void Probe(int level, FileMetaData* f, const std::vector<size_t>& batch) {
+      std::vector<Slice> ikeys;
+      ikeys.reserve(batch.size());
+      for (size_t i = 0; i < batch.size(); i++) {
+        const size_t k = batch[i];
+        GetStats* st = &(*stats)[k];
+        if (st->seek_file == nullptr && last_file_read[k] != nullptr) {
+          // We have had more than one seek for this key.  Charge the 1st file.
+          st->seek_file = last_file_read[k];
+          st->seek_file_level = last_file_read_level[k];
+        }
+        last_file_read[k] = f;
+        last_file_read_level[k] = level;
+        ikeys.push_back((*keys)[k]->internal_key());
+      }
+
+      Status s;
+      if (f->has_range_deletions) {
+        for (size_t i = 0; i < batch.size() && s.ok(); i++) {
+          const size_t k = batch[i];
+          SequenceNumber seq;
+          s = vset->table_cache_->MaxCoveringTombstone(
+              f->number, f->file_size, savers[k].user_key,
+              (*keys)[k]->sequence(), &seq);
+          savers[k].covering_seq = std::max(savers[k].covering_seq, seq);
+        }
+      }
+
+      if (s.ok()) {
+        BatchSaver bs;
+        bs.savers = &savers[0];
+        bs.batch = &batch;
+        s = vset->table_cache_->MultiGet(*options, f->number, f->file_size,
+                                         f->global_seqno, &ikeys[0],
+                                         ikeys.size(), &bs, SaveBatchValue);
+      }
+      for (size_t i = 0; i < batch.size(); i++) {
+        const size_t k = batch[i];
+        if (!s.ok()) {
+          (*statuses)[k] = s;
+        } else {
+          switch (savers[k].state) {
+            case kNotFound:
+              continue;  // Keep searching in other files
+            case kFound:
+              (*statuses)[k] = Status::OK();
+              break;
+            case kDeleted:
+              break;
+            case kCorrupt:
+              (*statuses)[k] =
+                  Status::Corruption("corrupted key for ", savers[k].user_key);
+              break;
+          }
+        }
+        done[k] = true;
+        num_done++;
+      }
+    }
+  };
+
+  const size_t n = keys.size();
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  statuses->assign(n, Status::NotFound(Slice()));
+  stats->resize(n);
+
+  State state;
+  state.options = &options;
+  state.keys = &keys;
+  state.statuses = statuses;
+  state.stats = stats;
+  state.vset = vset_;
+  state.savers.resize(n);
+  state.last_file_read.assign(n, nullptr);
+  state.last_file_read_level.assign(n, -1);
+  state.done.assign(n, false);
+  state.num_done = 0;
+  for (size_t i = 0; i < n; i++) {
+    (*stats)[i].seek_file = nullptr;
+    (*stats)[i].seek_file_level = -1;
+    state.savers[i].state = kNotFound;
+    state.savers[i].ucmp = ucmp;
+    state.savers[i].user_key = keys[i]->user_key();
+    state.savers[i].value = values[i];
+    state.savers[i].covering_seq = 0;
+  }
+
+  // Search level-0 in order from newest to oldest.  Each key still sees
+  // the files that overlap it in the same order as Get() would.
+  std::vector<FileMetaData*> level0(files_[0]);
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  std::vector<size_t> batch;
+  for (size_t i = 0; i < level0.size() && state.num_done < n; i++) {
+    FileMetaData* f = level0[i];
+    batch.clear();
+    for (size_t k = 0; k < n; k++) {
+      const Slice user_key = keys[k]->user_key();
+      if (!state.done[k] &&
+          ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(k);
+      }
+    }
+    if (!batch.empty()) {
+      state.Probe(0, f, batch);
+    }
+  }
+
+  // Search other levels.  Files in a level are disjoint and sorted, and so
+  // are the keys, so a single forward pass assigns every key to the only
+  // file that may contain it and groups keys that share a file.
+  for (int level = 1; level < config::kNumLevels && state.num_done < n;
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    FileMetaData* batch_file = nullptr;
+    batch.clear();
+    for (size_t k = 0; k < n; k++) {
+      if (state.done[k]) continue;
+      const int index = FindFile(vset_->icmp_, files, keys[k]->internal_key());
+      if (index >= static_cast<int>(files.size())) {
+        break;  // This and all later keys are past the end of the level
+      }
+      FileMetaData* f = files[index];
+      if (ucmp->Compare(keys[k]->user_key(), f->smallest.user_key()) < 0) {
+        continue;  // All of "f" is past any data for this key
+      }
+      if (f != batch_file) {
+        if (!batch.empty()) {
+          state.Probe(level, batch_file, batch);
+          batch.clear();
+        }
+        batch_file = f;
+      }
+      batch.push_back(k);
+    }
+    if (!batch.empty()) {
+      state.Probe(level, batch_file, batch);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -480,7 +764,7 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    while (level < vset_->options_->max_mem_compaction_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
@@ -498,6 +782,45 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+int Version::PickLevelForIngestedFile(const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  int level = 0;
+  while (level + 1 < config::kNumLevels &&
+         !OverlapInLevel(level, &smallest_user_key, &largest_user_key) &&
+         !OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+    // A compaction into level + 1 may write its outputs anywhere between
+    // the bounds of its inputs, including gaps between files that we
+    // would not overlap.  Stay clear of the span of all busy inputs.
+    const FileMetaData* busy_smallest = nullptr;
+    const FileMetaData* busy_largest = nullptr;
+    for (int which = level; which <= level + 1; which++) {
+      for (FileMetaData* f : files_[which]) {
+        if (!f->being_compacted) continue;
+        if (busy_smallest == nullptr ||
+            ucmp->Compare(f->smallest.user_key(),
+                          busy_smallest->smallest.user_key()) < 0) {
+          busy_smallest = f;
+        }
+        if (busy_largest == nullptr ||
+            ucmp->Compare(f->largest.user_key(),
+                          busy_largest->largest.user_key()) > 0) {
+          busy_largest = f;
+        }
+      }
+    }
+    if (busy_smallest != nullptr &&
+        ucmp->Compare(largest_user_key, busy_smallest->smallest.user_key()) >=
+            0 &&
+        ucmp->Compare(smallest_user_key, busy_largest->largest.user_key()) <=
+            0) {
+      break;
+    }
+    level++;
+  }
+  return level;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -1039,9 +1362,29 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 // - level 0: number of files
 // - others: total size of files
 void VersionSet::Finalize(Version* v) {
+  double* max_bytes = v->max_bytes_for_level_;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    max_bytes[level] = MaxBytesForLevel(options_, level);
+  }
+  if (options_->level_compaction_dynamic_level_bytes) {
+    // Size every level above the deepest non-empty one backward from the
+    // amount of data that level actually holds.
+    int bottom = config::kNumLevels - 1;
+    while (bottom > 1 && v->files_[bottom].empty()) {
+      bottom--;
+    }
+    double target = static_cast<double>(TotalFileSize(v->files_[bottom]));
+    for (int level = bottom - 1; level >= 1; level--) {
+      target /= options_->max_bytes_for_level_multiplier;
+      max_bytes[level] = std::max(
+          target, static_cast<double>(options_->max_bytes_for_level_base));
+    }
+  }
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
+  uint64_t debt = 0;
 
   for (int level = 0; level < config::kNumLevels - 1; level++) {
     double score;
@@ -1058,14 +1401,20 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
+              static_cast<double>(options_->level0_file_num_compaction_trigger);
+      if (score >= 1) {
+        debt += TotalFileSize(v->files_[level]);
+      }
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / max_bytes[level];
+      if (score > 1) {
+        debt += level_bytes - static_cast<uint64_t>(max_bytes[level]);
+      }
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1074,6 +1423,7 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+  v->compaction_debt_ = debt;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1097,7 +1447,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->has_range_deletions, f->global_seqno);
     }
   }
 
@@ -1145,9 +1496,12 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size,
+            files[i]->global_seqno, &tableptr);
         if (tableptr != nullptr) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
+          // Ingested tables are keyed by user key.
+          result += tableptr->ApproximateOffsetOf(
+              files[i]->global_seqno != 0 ? ikey.user_key() : ikey.Encode());
         }
         delete iter;
       }
@@ -1236,6 +1590,7 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.readahead_size = options_->compaction_readahead_size;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1250,7 +1605,8 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+                                                  files[i]->file_size,
+                                                  files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
@@ -1271,41 +1627,80 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 // - find the first file that comes after compact_pointer_[level] that largest
 // key is bigger than compact_pointer_[level]
 // - if no such file, return the first file in the level
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+namespace {
+
+bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
 
+}  // namespace
+
+Compaction* VersionSet::PickCompaction() {
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    // implement
-    for (int i = 0; i < current_->files_[level].size(); ++i) {
-      FileMetaData* file = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(file->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(file);
-        break;
+  // the compactions triggered by seeks.  Levels are tried from the
+  // highest score down, so that a level whose files are all busy does
+  // not hold up compactions elsewhere.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  const Version* v = current_;
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [v](int a, int b) {
+                     return v->level_scores_[a] > v->level_scores_[b];
+                   });
+
+  for (int i = 0; i < config::kNumLevels - 1; i++) {
+    const int level = levels[i];
+    if (current_->level_scores_[level] < 1) {
+      break;
+    }
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    if (level == 0 && AnyBeingCompacted(files)) {
+      // Level-0 files may overlap each other, so run one level-0
+      // compaction at a time.
+      continue;
+    }
+
+    // Pick the first file that comes after compact_pointer_[level],
+    // wrapping around to the start of the level, that can be compacted
+    // right now.
+    size_t start = 0;
+    while (start < files.size() && !compact_pointer_[level].empty() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    for (size_t j = 0; j < files.size(); j++) {
+      FileMetaData* f = files[(start + j) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = PickFileCompaction(level, f);
+      if (c != nullptr) {
+        return c;
       }
     }
-    if (c->inputs_[0].size() == 0) {
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+
+  FileMetaData* f = current_->file_to_compact_;
+  if (f != nullptr && !f->being_compacted) {
+    const int level = current_->file_to_compact_level_;
+    if (level != 0 || !AnyBeingCompacted(current_->files_[0])) {
+      return PickFileCompaction(level, f);
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
+  return nullptr;
+}
 
+Compaction* VersionSet::PickFileCompaction(int level, FileMetaData* f) {
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(f);
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1320,8 +1715,11 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);
-
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
+  c->MarkInputs(true);
   return c;
 }
 
@@ -1405,7 +1803,7 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
   }
 }
 
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
 
@@ -1415,6 +1813,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   current_->GetOverlappingInputs(level + 1, &smallest, &largest,
                                  &c->inputs_[1]);
   AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
@@ -1431,7 +1832,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(options_) &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1466,6 +1868,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // key range next time.
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+  return true;
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1497,7 +1900,11 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
+  c->MarkInputs(true);
   return c;
 }
 
@@ -1505,17 +1912,23 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      inputs_marked_(false) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
+Compaction::~Compaction() { ReleaseInputs(); }
+
+void Compaction::MarkInputs(bool value) {
+  inputs_marked_ = value;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      inputs_[which][i]->being_compacted = value;
+    }
   }
 }
 
@@ -1537,13 +1950,14 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1552,38 +1966,94 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
          icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                       grandparents_[cursor->grandparent_index]
+                           ->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+void Compaction::GetShardBoundaries(
+    int max_shards, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (max_shards <= 1) {
+    return;
+  }
+
+  // Candidate boundaries: the smallest user key of every input file.
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  std::vector<Slice> candidates;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      candidates.push_back(inputs_[which][i]->smallest.user_key());
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [user_cmp](const Slice& a, const Slice& b) {
+              return user_cmp->Compare(a, b) < 0;
+            });
+  // The smallest candidate would only produce an empty first range.
+  std::vector<Slice> distinct;
+  for (size_t i = 1; i < candidates.size(); i++) {
+    if (user_cmp->Compare(candidates[i], candidates[i - 1]) != 0) {
+      distinct.push_back(candidates[i]);
+    }
+  }
+
+  // Pick evenly spaced candidates so that each range starts at roughly
+  // the same number of input files.
+  const size_t num_shards =
+      std::min(distinct.size() + 1, static_cast<size_t>(max_shards));
+  for (size_t i = 1; i < num_shards; i++) {
+    const Slice& b = distinct[i * distinct.size() / num_shards];
+    if (boundaries->empty() ||
+        user_cmp->Compare(b, Slice(boundaries->back())) != 0) {
+      boundaries->push_back(b.ToString());
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
+    // The input version keeps the input files alive until it is unreffed.
+    if (inputs_marked_) {
+      MarkInputs(false);
+    }
     input_version_->Unref();
     input_version_ = nullptr;
   }
@@ -16,6 +16,7 @@
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -33,6 +34,7 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeDelAggregator;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -69,12 +71,28 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Store in *result the range tombstones of every file in this Version,
+  // or nullptr if there are none.  They are gathered on the first call and
+  // cached for the life of the Version.
+  // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  Status GetRangeTombstones(std::shared_ptr<const RangeDelAggregator>* result);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
   // REQUIRES: lock is not held
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Batched form of Get().  "keys" must be sorted by user key and share a
+  // single snapshot.  For each i, looks up keys[i], storing the value (if
+  // found) in *values[i] and the outcome in (*statuses)[i].  Every file
+  // that may contain several of the keys is probed once for all of them.
+  // Fills (*stats)[i] for each key.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& values,
+                std::vector<Status>* statuses, std::vector<GetStats>* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -109,6 +127,13 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the deepest level at which an ingested file covering
+  // [smallest_user_key,largest_user_key] overlaps no file at that level or
+  // above it, nor the output of a running compaction.  Level-0 if there is
+  // none.
+  int PickLevelForIngestedFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   int NumFiles(int level) const { return files_[level].size(); }
 
   // Return a human readable string that describes this version's contents.
@@ -125,10 +150,19 @@ class Version {
         next_(this),
         prev_(this),
         refs_(0),
+        range_del_built_(false),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        compaction_debt_(0) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      level_scores_[level] = -1;
+    }
+    for (int level = 0; level < config::kNumLevels; level++) {
+      max_bytes_for_level_[level] = 0;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -150,6 +184,12 @@ class Version {
   Version* prev_;     // Previous version in linked list
   int refs_;          // Number of live refs to this version
 
+  // Cached result of GetRangeTombstones().
+  port::Mutex range_del_mutex_;
+  bool range_del_built_ GUARDED_BY(range_del_mutex_);
+  std::shared_ptr<const RangeDelAggregator> range_del_
+      GUARDED_BY(range_del_mutex_);
+
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
@@ -162,6 +202,17 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level that can be compacted, so that
+  // another level can be picked while the best one is busy.
+  double level_scores_[config::kNumLevels - 1];
+
+  // Size target of every level.  Initialized by Finalize().
+  double max_bytes_for_level_[config::kNumLevels];
+
+  // Estimated number of bytes compactions must rewrite before every
+  // level is back within its target.  Initialized by Finalize().
+  uint64_t compaction_debt_;
 };
 
 class VersionSet {
@@ -208,6 +259,17 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the size target of the specified level in the current version.
+  double LevelMaxBytes(int level) const {
+    return current_->max_bytes_for_level_[level];
+  }
+
+  // Return an estimate of the bytes that compactions still have to
+  // rewrite to bring the current version within its level targets.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->compaction_debt_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -228,15 +290,19 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
-  // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // compaction that is needed would share files with a compaction that
+  // is still running.  Otherwise returns a pointer to a heap-allocated
+  // object that describes the compaction, whose input files are marked
+  // as being compacted until it is deleted or its inputs are released.
+  // Caller should delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction is running.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
@@ -286,7 +352,13 @@ class VersionSet {
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest, InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Try to compact the file "f" of "level", returning nullptr if that
+  // would share files with a running compaction.
+  Compaction* PickFileCompaction(int level, FileMetaData* f);
+
+  // Returns false, without side effects, if the inputs of "c" would
+  // overlap a running compaction.
+  bool SetupOtherInputs(Compaction* c);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -318,6 +390,27 @@ class VersionSet {
 // A Compaction encapsulates information about a compaction.
 class Compaction {
  public:
+  // Position of one output stream in the key space, used by
+  // IsBaseLevelForKey() and ShouldStopBefore() to avoid rescanning the
+  // higher levels for every key.  Both only ever move forward, so every
+  // key-range shard of a compaction needs its own cursor.
+  struct Cursor {
+    Cursor();
+
+    // Index in grandparents_ of the earliest file that may overlap the
+    // current output.
+    size_t grandparent_index;
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
@@ -347,14 +440,26 @@ class Compaction {
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Like IsBaseLevelForKey(), for every user key in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Split the key space of this compaction into at most "max_shards"
+  // disjoint ranges that can be compacted independently.  Fills
+  // *boundaries with the sorted user keys at which a new range starts;
+  // the first range starts before all keys and the last one ends after
+  // all keys.  Boundaries are taken from the smallest keys of the input
+  // files, so every user key falls entirely within one range.
+  void GetShardBoundaries(int max_shards,
+                          std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also clears the being_compacted mark of the inputs.
   void ReleaseInputs();
 
  private:
@@ -363,6 +468,9 @@ class Compaction {
 
   Compaction(const Options* options, int level);
 
+  // Set the being_compacted mark of every input file to "value".
+  void MarkInputs(bool value);
+
   int level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
@@ -371,21 +479,12 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of overlapping grandparent files
+  // Used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+
+  // True while this compaction owns the being_compacted marks of its inputs
+  bool inputs_marked_;
 };
 
 }  // namespace leveldb
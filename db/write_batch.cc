@@ -8,7 +8,8 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -34,6 +35,8 @@ WriteBatch::~WriteBatch() = default;
 
 WriteBatch::Handler::~Handler() = default;
 
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -67,6 +70,13 @@ Status WriteBatch::Iterate(Handler* handler) const {
         return Status::Corruption("bad put format");
       }
       handler->Delete(key);
+    } else if (tag == kTypeRangeDeletion) {
+      Slice begin, end;
+      if (!GetLengthPrefixedSlice(&input, &begin) ||
+          !GetLengthPrefixedSlice(&input, &end)) {
+        return Status::Corruption("bad range deletion format");
+      }
+      handler->DeleteRange(begin, end);
     } else {
       // Error type
       return Status::Corruption("error type");
@@ -115,6 +125,15 @@ void WriteBatch::Delete(const Slice& key) {
   WriteBatchInternal::SetCount(this, count + 1);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  this->rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&this->rep_, begin);
+  PutLengthPrefixedSlice(&this->rep_, end);
+  // update count
+  int count = WriteBatchInternal::Count(this);
+  WriteBatchInternal::SetCount(this, count + 1);
+}
+
 void WriteBatch::Append(const WriteBatch& source) {
   WriteBatchInternal::Append(this, &source);
 }
@@ -127,13 +146,25 @@ class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
   MemTable* mem_;
+  bool concurrent_;
 
   void Put(const Slice& key, const Slice& value) override {
-    mem_->Add(sequence_, kTypeValue, key, value);
-    sequence_++;
+    Add(kTypeValue, key, value);
   }
   void Delete(const Slice& key) override {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    Add(kTypeDeletion, key, Slice());
+  }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    Add(kTypeRangeDeletion, begin, end);
+  }
+
+ private:
+  void Add(ValueType type, const Slice& key, const Slice& value) {
+    if (concurrent_) {
+      mem_->AddConcurrently(sequence_, type, key, value);
+    } else {
+      mem_->Add(sequence_, type, key, value);
+    }
     sequence_++;
   }
 };
@@ -143,6 +174,16 @@ Status WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
   inserter.mem_ = memtable;
+  inserter.concurrent_ = false;
+  return b->Iterate(&inserter);
+}
+
+Status WriteBatchInternal::InsertIntoConcurrently(const WriteBatch* b,
+                                                  MemTable* memtable) {
+  MemTableInserter inserter;
+  inserter.sequence_ = WriteBatchInternal::Sequence(b);
+  inserter.mem_ = memtable;
+  inserter.concurrent_ = true;
   return b->Iterate(&inserter);
 }
 
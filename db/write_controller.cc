@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+const uint64_t WriteController::kMinDelayedWriteRate;
+const uint64_t WriteController::kMicrosPerRefill;
+
+WriteController::WriteController(uint64_t max_delayed_write_rate)
+    : max_delayed_write_rate_(
+          std::max(max_delayed_write_rate, kMinDelayedWriteRate)),
+      delayed_write_rate_(0),
+      next_free_micros_(0) {}
+
+void WriteController::SetDelayedWriteRate(uint64_t bytes_per_second) {
+  if (bytes_per_second == 0) {
+    delayed_write_rate_ = 0;
+    next_free_micros_ = 0;
+    return;
+  }
+  delayed_write_rate_ = std::min(
+      std::max(bytes_per_second, kMinDelayedWriteRate),
+      max_delayed_write_rate_);
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t bytes) {
+  if (delayed_write_rate_ == 0) {
+    return 0;
+  }
+  // Unused budget does not accumulate, so an idle period is not followed
+  // by an unthrottled burst.
+  if (next_free_micros_ < now_micros) {
+    next_free_micros_ = now_micros;
+  }
+  next_free_micros_ += bytes * 1000000 / delayed_write_rate_;
+  if (next_free_micros_ <= now_micros + kMicrosPerRefill) {
+    return 0;
+  }
+  return next_free_micros_ - now_micros;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+// WriteController paces writes while compactions are falling behind.
+// It is a token bucket: writes are admitted at delayed_write_rate() bytes
+// per second and each write is charged for its own size, so the delay is
+// spread across writers in proportion to what they write instead of
+// every write sleeping for a fixed period.
+//
+// A WriteController is not thread-safe; DBImpl guards it with its mutex.
+class WriteController {
+ public:
+  // Writes are never admitted below this rate.
+  static const uint64_t kMinDelayedWriteRate = 16 * 1024;
+
+  explicit WriteController(uint64_t max_delayed_write_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Set the current rate in bytes per second; zero stops delaying writes.
+  // Non-zero values are clipped to [kMinDelayedWriteRate,
+  // max_delayed_write_rate()].
+  void SetDelayedWriteRate(uint64_t bytes_per_second);
+
+  // Current rate in bytes per second, or zero if writes are not delayed.
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+  uint64_t max_delayed_write_rate() const { return max_delayed_write_rate_; }
+  bool IsDelayed() const { return delayed_write_rate_ != 0; }
+
+  // Charge a write of "bytes" issued at "now_micros" and return how long
+  // the writer should sleep, in microseconds.  Delays shorter than one
+  // refill period are deferred to later writes rather than slept.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t bytes);
+
+ private:
+  static const uint64_t kMicrosPerRefill = 1000;
+
+  const uint64_t max_delayed_write_rate_;
+  uint64_t delayed_write_rate_;
+
+  // Time at which all bytes charged so far have been paid for.
+  uint64_t next_free_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
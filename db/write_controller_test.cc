@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller(1 << 20);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1 << 30));
+}
+
+TEST(WriteControllerTest, RateIsClipped) {
+  WriteController controller(1 << 20);
+  controller.SetDelayedWriteRate(1 << 30);
+  ASSERT_EQ(1 << 20, controller.delayed_write_rate());
+  controller.SetDelayedWriteRate(1);
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            controller.delayed_write_rate());
+  controller.SetDelayedWriteRate(0);
+  ASSERT_TRUE(!controller.IsDelayed());
+}
+
+TEST(WriteControllerTest, SpreadsDelay) {
+  WriteController controller(1 << 20);
+  controller.SetDelayedWriteRate(1000000);  // One byte per microsecond
+  uint64_t now = 5000000;
+
+  // Small writes within the first refill period are not delayed.
+  ASSERT_EQ(0, controller.GetDelay(now, 500));
+  ASSERT_EQ(0, controller.GetDelay(now, 500));
+
+  // Further writes pay for everything charged so far.
+  ASSERT_EQ(2000, controller.GetDelay(now, 1000));
+  now += 2000;
+  ASSERT_EQ(0, controller.GetDelay(now, 100));
+
+  // Over a long run the admitted rate matches the configured rate.
+  uint64_t slept = 0;
+  for (int i = 0; i < 1000; i++) {
+    uint64_t delay = controller.GetDelay(now, 1000);
+    now += delay;
+    slept += delay;
+  }
+  ASSERT_GE(slept, 990000);
+  ASSERT_LE(slept, 1001000);
+}
+
+TEST(WriteControllerTest, IdleTimeDoesNotAccumulate) {
+  WriteController controller(1 << 20);
+  controller.SetDelayedWriteRate(1000000);
+  ASSERT_EQ(0, controller.GetDelay(1000000, 100));
+
+  // A long idle period does not build up budget beyond one refill period.
+  const uint64_t now = 60000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 1000));
+  ASSERT_EQ(2000, controller.GetDelay(now, 1000));
+}
+
+}  // namespace leveldb
@@ -19,18 +19,58 @@
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
+#include "leveldb/status.h"
 
 namespace leveldb {
 
 class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a least-recently-used eviction policy.  Half of the
+// capacity is available to high priority entries (see below).
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Same as above, but split into 2^num_shard_bits shards instead of 16.
+// Each shard has its own lock and an equal share of the capacity, so more
+// shards mean less lock contention but coarser eviction.
+//
+// By default an insert always succeeds, and the cache may grow beyond its
+// capacity while entries that clients still hold cannot be evicted.  If
+// strict_capacity_limit is true, TryInsert() fails instead, and Insert()
+// returns a handle to an entry that is not cached.
+//
+// Entries inserted with Cache::kHighPriority are evicted only once no
+// entry of low priority is left to evict, as long as they take up at most
+// high_pri_pool_ratio of the capacity.  Beyond that the oldest of them are
+// evicted first.  With a ratio of zero, priorities are ignored.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                                  bool strict_capacity_limit,
+                                  double high_pri_pool_ratio);
+
+// Same as above, with half of the capacity available to high priority
+// entries.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                                  bool strict_capacity_limit);
+
+// Create a new cache with a fixed size capacity that uses the CLOCK
+// eviction policy.  Lookups and releases do not take any lock, so the
+// cache scales better than the LRU cache when many threads read from it.
+//
+// The cache keeps a fixed number of slots, enough for
+// capacity / estimated_entry_charge entries.  If the actual entries are
+// much smaller, fewer of them are cached than the capacity would allow.
+// Entries of high priority start out with more chances to survive
+// eviction, but no share of the capacity is reserved for them.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                    size_t estimated_entry_charge);
+
+// Same as above, for entries of about the default block size.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +85,11 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // Hint for the eviction policy: entries of high priority, such as the
+  // index and filter blocks of tables, should outlive those of low
+  // priority.
+  enum Priority { kLowPriority, kHighPriority };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +102,28 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert(), but with the specified priority.  The default
+  // implementation ignores the priority.
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
+  // Like InsertWithPriority(), but may fail if the cache has no room for
+  // the entry, e.g. because of a strict capacity limit.  On success,
+  // stores the handle in *handle and returns OK.  Otherwise returns a
+  // non-OK status and leaves "value" to the caller; the deleter is not
+  // called.  The default implementation never fails.
+  virtual Status TryInsert(const Slice& key, void* value, size_t charge,
+                           void (*deleter)(const Slice& key, void* value),
+                           Priority priority, Handle** handle) {
+    *handle = InsertWithPriority(key, value, charge, deleter, priority);
+    return Status::OK();
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -96,6 +163,26 @@ class LEVELDB_EXPORT Cache {
   // Return an estimate of the combined charges of all elements stored in the
   // cache.
   virtual size_t TotalCharge() const = 0;
+
+  // Return an estimate of the combined charges of the elements of high
+  // priority stored in the cache.  The default implementation returns 0.
+  virtual size_t HighPriorityCharge() const { return 0; }
+
+  // Usage and hit counts of one shard of a cache.
+  struct ShardStats {
+    size_t capacity;
+    size_t usage;         // Combined charge of the entries in the shard
+    size_t pinned_usage;  // Part of usage held by clients
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t failed_inserts;  // Inserts refused for lack of room
+  };
+
+  // Store the statistics of each shard in *stats.  The default
+  // implementation stores none.
+  virtual void GetShardStats(std::vector<ShardStats>* stats) const {
+    stats->clear();
+  }
 };
 
 }  // namespace leveldb
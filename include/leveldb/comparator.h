@@ -52,6 +52,12 @@ class LEVELDB_EXPORT Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Returns the part of "key" that a point lookup must match exactly.
+  // Tables built with Options::data_block_hash_index locate the entries
+  // for a lookup by hashing it, so keys that compare equal must have
+  // byte-wise equal hash keys.  The default implementation returns "key".
+  virtual Slice HashKey(const Slice& key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -72,6 +74,14 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for every key in [begin, end).
+  // The range is recorded as a single tombstone, so the cost does not
+  // depend on the number of keys removed.  Returns OK on success, and a
+  // non-OK status on error.  It is not an error if the range is empty.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +97,20 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up every key in "keys" as if by Get(), but against a single
+  // consistent view of the database.  On return, values and statuses
+  // have keys.size() entries: (*statuses)[i] holds the result for keys[i]
+  // and, if it is OK, (*values)[i] holds the corresponding value.
+  // Entries of *values whose status is not OK are left empty.
+  //
+  // Batching lets the implementation visit each table file (and each
+  // block within it) once for all of the keys it may contain, which is
+  // considerably cheaper than issuing the lookups one at a time.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses) = 0;
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +145,23 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.block-cache-usage" - returns the total charge of the entries
+  //     in the block cache.
+  //  "leveldb.block-cache-index-and-filter-usage" - returns the part of
+  //     the block cache charge held by index and filter blocks (see
+  //     Options::cache_index_and_filter_blocks).
+  //  "leveldb.block-cache-stats" - returns a multi-line string with the
+  //     capacity, usage, pinned usage, lookups, hits and failed inserts of
+  //     each shard of the block cache, if the cache keeps statistics.
+  //  "leveldb.persistent-cache-stats" - returns the lookups, hits, hit
+  //     rate, inserts and usage of Options::persistent_cache, if set.
+  //  "leveldb.table-readers-memory" - returns the approximate number of
+  //     bytes held by open tables outside the block cache.
+  //  "leveldb.delayed-write-rate" - returns the rate in bytes per second at
+  //     which writes are currently admitted, or 0 if they are not delayed.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns an estimate of
+  //     the bytes compactions must rewrite to bring every level within
+  //     its target size.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -145,6 +186,37 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Drop every table file whose keys all lie in [*begin,*end] without
+  // reading or rewriting it.  Files that only partly overlap the range,
+  // level-0 files and files that are inputs of a running compaction are
+  // left alone, so some keys in the range may survive; follow up with
+  // DeleteRange() or CompactRange() if that matters.  Unlike DeleteRange(),
+  // this ignores snapshots and may uncover older versions of dropped keys
+  // that live in files it keeps.
+  //
+  // begin==nullptr is treated as a key before all keys in the database.
+  // end==nullptr is treated as a key after all keys in the database.
+  //
+  // The default implementation returns a NotSupported error.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+
+  // Add the table files named by "paths" to the database as they are,
+  // without passing their contents through the log, the memtable or
+  // compactions.  Each file must have been written by a TableBuilder using
+  // the database's comparator (and, for its filter to be used, the same
+  // filter policy), hold strictly increasing keys and no range tombstones,
+  // and the key ranges of the files must not overlap.  Files that do not
+  // are rejected with an InvalidArgument error before anything changes.
+  //
+  // The ingested entries become visible at once and replace any existing
+  // entries for their keys; snapshots taken earlier do not see them.
+  // Each file is placed in the deepest level that has no overlapping data
+  // above it.  Writes are held back while the files are installed.
+  //
+  // The default implementation returns a NotSupported error.
+  virtual Status IngestExternalFile(const std::vector<std::string>& paths,
+                                    const IngestExternalFileOptions& options);
 };
 
 // Destroy the contents of the specified database.
@@ -110,6 +110,24 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), but the returned file reads with direct
+  // I/O, bypassing the operating system's page cache, if the Env and the
+  // file system support it.  Such reads are not cached anywhere below
+  // leveldb, and RandomAccessFile::Prefetch() has no effect on them.
+  //
+  // The default implementation returns NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but the returned file writes with direct I/O
+  // if the Env and the file system support it.  Data appended to such a
+  // file may stay in its buffer until the next Sync() or Close(), even
+  // after Flush().
+  //
+  // The default implementation returns NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -168,6 +186,12 @@ class LEVELDB_EXPORT Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Create "target" as a hard link to the existing file "src".  Fails if
+  // "target" exists or lives on a different file system than "src".
+  //
+  // The default implementation returns a NotSupported error.
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores nullptr in
   // *lock and returns non-OK.
@@ -197,6 +221,21 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Background work runs in one of two thread pools.  Work scheduled at
+  // kHighPriority (such as memtable flushes) never queues behind work
+  // scheduled at kLowPriority (such as compactions).  Schedule() uses
+  // the kLowPriority pool.
+  enum Priority { kLowPriority, kHighPriority };
+
+  // Like Schedule(), but runs "(*function)(arg)" in the pool for "pri".
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                                    Priority pri);
+
+  // Allow the pool for "pri" to run at least "number" functions at once.
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -269,6 +308,34 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Hint that the "n" bytes starting at "offset" will be read soon, so
+  // the implementation may start fetching them in the background.  Reads
+  // are correct whether or not this is called.  The default
+  // implementation does nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status Prefetch(uint64_t offset, size_t n) const;
+
+  // One of the reads of a MultiRead() call.
+  struct ReadRequest {
+    uint64_t offset;
+    size_t n;
+    char* scratch;  // Room for "n" bytes
+    Slice result;   // Set by MultiRead(), as by Read()
+    Status status;  // Set by MultiRead()
+  };
+
+  // Performs the "num" reads in "requests" as if by calling
+  //   Read(offset, n, &result, scratch)
+  // for each of them, and stores the result and status of each read in
+  // its request.  Returns OK if all of them succeeded, and the status of a
+  // failed one otherwise.  Implementations may issue the reads at once,
+  // so that devices that serve several requests in parallel finish them
+  // sooner.  The default implementation reads them one after another.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* requests, size_t num) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -355,6 +422,14 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -377,6 +452,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) override {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) override {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) override {
     return target_->LockFile(f, l);
   }
@@ -384,6 +462,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a, Priority pri) override {
+    return target_->ScheduleWithPriority(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    return target_->SetBackgroundThreads(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
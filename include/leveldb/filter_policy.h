@@ -67,6 +67,30 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a bloom filter whose probes for a
+// key all fall into a single 64-byte cache line.  A lookup then costs at
+// most one cache miss, which makes lookups of absent keys noticeably
+// faster on filters that do not fit in the CPU caches.  Its false positive
+// rate is close to that of NewBloomFilterPolicy() for the same
+// bits_per_key, but filters built by the two policies are not
+// interchangeable.  The same caveats and ownership rules as for
+// NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewCacheLocalBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses a binary fuse filter, a static
+// relative of the xor filter.  Each key stores a fingerprint of
+// bits_per_fingerprint bits (1 to 16), giving a false positive rate of
+// about 2^-bits_per_fingerprint at roughly 1.13 * bits_per_fingerprint
+// bits per key for large filters.  A good value is 7, which yields a ~0.8%
+// false positive rate in 8 bits per key where a bloom filter needs 10.
+// Small filters carry more overhead, so this policy pays off most with
+// Options::full_file_filter.  Building a filter is slower than for a
+// bloom filter.  The same caveats and ownership rules as for
+// NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewBinaryFuseFilterPolicy(
+    int bits_per_fingerprint);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
@@ -16,6 +17,10 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class PersistentCache;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -94,6 +99,20 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, use the specified cache for blocks as they are stored in
+  // the file, i.e. compressed.  A block that misses block_cache is then
+  // uncompressed from memory instead of read from the file again, which
+  // makes this cache hold about as many blocks as a larger block_cache.
+  // Uncompressed blocks, and blocks of files that the Env memory-maps,
+  // are not added to it.
+  Cache* block_cache_compressed = nullptr;
+
+  // If non-null, blocks that miss the caches above are looked up in this
+  // cache on a faster device before they are read from the table file,
+  // and blocks read from table files are added to it.  Blocks of files
+  // that the Env memory-maps are not added to it.
+  PersistentCache* persistent_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -105,6 +124,17 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, each data block of new tables gets a small hash index from
+  // the keys of its entries to their restart points, which lets point
+  // lookups skip the binary search over the restart points.  It costs
+  // about one byte per entry.  The hash index holds the user keys of the
+  // database, so it must only be used with comparators under which keys
+  // compare equal only if they are byte-wise equal.  Blocks with a hash
+  // index cannot be read by older versions of this library.
+  //
+  // Default: false
+  bool data_block_hash_index = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -115,6 +145,122 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // Number of level-0 files that triggers a level-0 compaction.
+  //
+  // Default: 4
+  int level0_file_num_compaction_trigger = 4;
+
+  // Soft limit on the number of level-0 files.  Once this many files are
+  // present writes are admitted at no more than delayed_write_rate,
+  // spreading the cost of catching up over many writers instead of
+  // stalling one.  Must be at least level0_file_num_compaction_trigger.
+  //
+  // Default: 8
+  int level0_slowdown_writes_trigger = 8;
+
+  // Write rate, in bytes per second, while writes are being slowed down.
+  // The rate is lowered further while compaction debt keeps growing and
+  // raised back towards this value as compactions catch up.  The rate in
+  // effect is reported by the "leveldb.delayed-write-rate" property.
+  //
+  // Default: 16MB/s
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // Hard limit on the number of level-0 files.  Writes stop until a
+  // compaction brings the count below this.  Must be at least
+  // level0_slowdown_writes_trigger.
+  //
+  // Default: 12
+  int level0_stop_writes_trigger = 12;
+
+  // Maximum level to which a flushed memtable is pushed if it does not
+  // overlap any existing data.  Pushing past level 0 avoids the
+  // relatively expensive level 0=>1 compactions, but pushing too far can
+  // waste space when the same key range is overwritten repeatedly.
+  //
+  // Default: 2
+  int max_mem_compaction_level = 2;
+
+  // Target total size of level 1.  Each further level may hold
+  // max_bytes_for_level_multiplier times as much as the one above it.
+  //
+  // Default: 10MB
+  uint64_t max_bytes_for_level_base = 10 * 1048576;
+
+  // Size ratio between adjacent levels.  Larger values lower write
+  // amplification at the cost of more space and read amplification.
+  //
+  // Default: 10
+  double max_bytes_for_level_multiplier = 10;
+
+  // If true, level targets are derived from the actual size of the
+  // deepest non-empty level: each level above it may hold that size
+  // divided by max_bytes_for_level_multiplier once per level of
+  // distance (but never less than max_bytes_for_level_base).  This keeps
+  // most data in the deepest level and reduces space amplification for
+  // databases that have not grown to their configured level sizes.
+  //
+  // Default: false
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // Maximum number of background jobs (memtable flushes and compactions)
+  // that may run at once.  With more than one job, one of them is
+  // reserved for flushing the memtable in Env's high-priority thread
+  // pool, so flushes never wait behind a long compaction, and the rest
+  // run compactions over disjoint sets of files.  With a single job,
+  // flushes and compactions take turns.  More than one job only helps with
+  // an Env that runs high-priority jobs in their own threads (see
+  // Env::ScheduleWithPriority), and the DB then sets the size of the Env's
+  // thread pools.
+  //
+  // Default: 1
+  int max_background_jobs = 1;
+
+  // Maximum number of key-range shards a single compaction is split into.
+  // Each shard is compacted by its own thread and builds its own output
+  // files; the outputs of all shards are installed together.  Values
+  // above 1 let large compactions use more than one core.
+  //
+  // Default: 1 (no splitting)
+  int max_subcompactions = 1;
+
+  // Number of bytes that compactions read ahead of the blocks they read
+  // from their input files; see ReadOptions::readahead_size.  Compactions
+  // read their inputs from start to end, so reading far ahead lets the
+  // device serve them in large requests.
+  //
+  // Default: 2MB
+  size_t compaction_readahead_size = 2 * 1024 * 1024;
+
+  // If true, table files are read with direct I/O (see
+  // Env::NewDirectRandomAccessFile), so that their blocks are cached only in
+  // block_cache rather than in the operating system's page cache as well.
+  // Compactions read their inputs through the same files.  Without the page
+  // cache, reading ahead has no effect, and blocks that miss block_cache
+  // are always read from the device, so block_cache should be sized
+  // accordingly.  Falls back to normal reads where the file system does not
+  // support direct I/O.
+  //
+  // Default: false
+  bool use_direct_reads = false;
+
+  // If true, table files written by memtable flushes and compactions are
+  // written with direct I/O (see Env::NewDirectWritableFile), so that they
+  // do not evict hot data from the operating system's page cache.  Falls
+  // back to normal writes where the file system does not support direct
+  // I/O.
+  //
+  // Default: false
+  bool use_direct_io_for_flush_and_compaction = false;
+
+  // If non-null, table files written by memtable flushes and compactions
+  // pass through this limiter, flushes at high priority and compactions
+  // at low priority.  Write-ahead log writes are never throttled.  The
+  // limit can be changed at any time with RateLimiter::SetBytesPerSecond.
+  //
+  // Default: nullptr (no limit)
+  RateLimiter* rate_limiter = nullptr;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -141,10 +287,74 @@ struct LEVELDB_EXPORT Options {
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If true, group commit is split into two pipelined stages: once a
+  // batch group has been appended to the log, the next group may start
+  // logging while the previous one is still being applied to the
+  // memtable.  Sequence numbers still become visible to readers in order.
+  // This mainly helps workloads with many concurrent writers, especially
+  // when WriteOptions::sync is set.
+  //
+  // Default: false
+  bool enable_pipelined_write = false;
+
+  // If true, the writers of a batch group insert their own batches into
+  // the memtable in parallel, instead of the group leader inserting the
+  // whole group by itself.  Helps bulk-write workloads with many
+  // concurrent writers on machines with several cores.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write = false;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, new tables get a single filter over all of their keys instead
+  // of one filter per 2KB of data.  A lookup then checks the filter once,
+  // before consulting the table's index, which saves work on lookups of
+  // absent keys.  The filter of a table is built in memory from all of its
+  // keys when the table is finished.  Tables of either kind can be read
+  // regardless of this setting.
+  //
+  // Default: false
+  bool full_file_filter = false;
+
+  // If true, new tables split their index into partitions of about
+  // block_size bytes below a small top-level index, and keep one filter
+  // per index partition in place of the filters selected above.  Only the
+  // top-level index stays in memory while a table is open; partitions are
+  // read through block_cache when needed, so the memory used for indexes
+  // and filters follows the working set rather than the amount of data.
+  // A lookup that misses the cache may need two extra block reads.
+  //
+  // Tables written with this option cannot be read by versions of leveldb
+  // that predate it.  Tables of either kind can be read regardless of this
+  // setting.
+  //
+  // Default: false
+  bool partition_index_and_filters = false;
+
+  // If true, the index and filter blocks of open tables are kept in
+  // block_cache with Cache::kHighPriority, instead of in memory that each
+  // open table holds on its own.  The memory used by the read path then
+  // is bounded by the capacity of the cache, at the cost of reading these
+  // blocks again after they have been evicted.  Range tombstones still
+  // stay with each table, as do the blocks of memory-mapped files, which
+  // are never cached.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks = false;
+
+  // If non-null, the filters built with filter_policy also record the
+  // prefix of every key under this transform, which lets iterators created
+  // with ReadOptions::prefix_same_as_start skip tables that hold no key
+  // with the prefix they seek to.  Keys that share a prefix must be
+  // adjacent in the order of the comparator, as they are for
+  // NewFixedPrefixTransform() and the default comparator.  Tables written
+  // under a different transform are still read correctly, but are not
+  // skipped until they have been rewritten by a compaction.
+  const SliceTransform* prefix_extractor = nullptr;
 };
 
 // Options that control read operations
@@ -162,6 +372,25 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and Options::prefix_extractor is set, an iterator only yields
+  // keys that share the prefix of the key it was positioned at by Seek()
+  // or SeekToFirst(), and tables whose filters rule that prefix out are
+  // not read.  Such an iterator only moves forward: Prev() and
+  // SeekToLast() make it invalid with a NotSupported() status.
+  bool prefix_same_as_start = false;
+
+  // If non-null, an iterator stops before the first key that is >=
+  // *iterate_upper_bound, and does not open tables that only hold such
+  // keys.  The bound must remain live while the iterator is in use.
+  const Slice* iterate_upper_bound = nullptr;
+
+  // Number of bytes that an iterator asks the Env to fetch ahead of each
+  // data block it has to read from a table file (see
+  // RandomAccessFile::Prefetch()).  If zero, an iterator starts reading
+  // ahead once it has read a few blocks of a file in a row, and reads
+  // further ahead the longer the scan goes on, up to 256KB.
+  size_t readahead_size = 0;
 };
 
 // Options that control write operations
@@ -185,6 +414,15 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  // If false, the files are copied into the database directory and left
+  // untouched.  If true, they are hard-linked where possible (and copied
+  // otherwise), and the original files are removed once they have been
+  // ingested.
+  bool move_files = false;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
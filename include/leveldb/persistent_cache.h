@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache keeps copies of table blocks on a storage device that
+// is faster than the one holding the database, such as a local SSD in
+// front of a network volume.  Tables look blocks up in it after they miss
+// the in-memory block cache, and add the blocks they read from the file.
+// A PersistentCache has internal synchronization and may be shared by
+// several DBs.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT PersistentCache {
+ public:
+  PersistentCache() = default;
+
+  PersistentCache(const PersistentCache&) = delete;
+  PersistentCache& operator=(const PersistentCache&) = delete;
+
+  virtual ~PersistentCache();
+
+  // Store a copy of "data" under "key".  The cache may drop it at any
+  // time, or not store it at all.  Inserting a key that is already
+  // cached has no effect.
+  virtual Status Insert(const Slice& key, const Slice& data) = 0;
+
+  // If the cache holds "key", store its data in *data and return OK.
+  // Otherwise return a NotFound status, or another non-OK status if the
+  // data could not be read back.
+  virtual Status Lookup(const Slice& key, std::string* data) = 0;
+
+  // Return a new numeric id, for clients to prepend to their keys as for
+  // Cache::NewId().
+  virtual uint64_t NewId() = 0;
+
+  struct Stats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t usage;  // Bytes of cached data, including record headers
+  };
+
+  // Return the statistics of the cache since it was created.
+  virtual Stats GetStats() const = 0;
+};
+
+// Create a persistent cache that appends blocks to files in the directory
+// "dir" of "env" and keeps an index of them in memory.  Once the files
+// hold more than "capacity" bytes, the least recently used of them is
+// deleted.  The index does not survive the cache, so the cache starts
+// out empty and deletes any cache files it finds in "dir".
+//
+// On success, stores a pointer to the new cache in *result and returns
+// OK.  The caller should delete the cache when it is no longer needed,
+// after the DBs that use it.
+LEVELDB_EXPORT Status NewFilePersistentCache(Env* env, const std::string& dir,
+                                             uint64_t capacity,
+                                             PersistentCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which background work (memtable
+// flushes and compactions) writes to disk, so that it does not starve
+// foreground reads of device bandwidth.  Write-ahead log writes are never
+// rate limited.  A RateLimiter has internal synchronization and may be
+// shared by several DBs.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  RateLimiter() = default;
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  virtual ~RateLimiter();
+
+  // Change the limit.  Takes effect from the next refill period on and
+  // may be called at any time from any thread.
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the current limit in bytes per second.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Block until "bytes" may be written.  Pending high priority requests
+  // (memtable flushes) are granted before low priority ones (compactions).
+  virtual void Request(int64_t bytes, Env::Priority priority) = 0;
+
+  // Return the number of bytes granted so far at "priority".
+  virtual int64_t GetTotalBytesThrough(Env::Priority priority) const = 0;
+};
+
+// Create a token-bucket RateLimiter admitting "bytes_per_second".  The
+// bucket is refilled every "refill_period_micros"; shorter periods give
+// smoother traffic at a slightly higher CPU cost.  "env" supplies the
+// clock and must outlive the limiter.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t bytes_per_second, int64_t refill_period_micros = 100 * 1000,
+    Env* env = Env::Default());
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
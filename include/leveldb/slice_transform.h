@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to a shorter key, typically one of its
+// prefixes.  A database configured with a prefix extractor (see
+// Options::prefix_extractor) records the prefixes of its keys in its
+// filters, so that iterators confined to one prefix (see
+// ReadOptions::prefix_same_as_start) can skip tables that hold no key
+// with that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  The name is recorded with the
+  // filters built from it, so it must change whenever Transform() or
+  // InDomain() change their results for any key.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must refer to the bytes of
+  // "key".  Requires: InDomain(key).
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix under this transform.  Keys outside
+  // the domain are never skipped by prefix filtering.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform that maps every key of at least "prefix_len"
+// bytes to its first "prefix_len" bytes.  Shorter keys are outside its
+// domain.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
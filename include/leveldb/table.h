@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_TABLE_H_
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
+#include <cstddef>
 #include <cstdint>
 
 #include "leveldb/export.h"
@@ -50,6 +51,11 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones stored in the table,
+  // or nullptr if the table has none.  Keys and values are those passed
+  // to TableBuilder::AddRangeTombstone().
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -58,6 +64,17 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns false if the filter shows that the first entry at or after
+  // "target" lies in a data block that holds no key matching "filter_key".
+  // Used to skip a table when only keys with a given prefix are wanted.
+  // Does not read any data block.
+  bool PrefixMayMatch(const Slice& target, const Slice& filter_key) const;
+
+  // Returns the approximate number of bytes of memory held by the table
+  // itself, i.e. the index and filter blocks that are not left to the
+  // block cache.
+  size_t ApproximateMemoryUsage() const;
+
  private:
   friend class TableCache;
   struct Rep;
@@ -66,6 +83,11 @@ class LEVELDB_EXPORT Table {
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
+  // Keys the table's blocks in options.persistent_cache by "cache_id" and
+  // "file_number" rather than by a fresh id, so that the blocks it cached
+  // stay reachable when the file is opened again.
+  void SetPersistentCacheKey(uint64_t cache_id, uint64_t file_number);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
@@ -73,8 +95,18 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // Batched form of InternalGet() for the keys k[0,n-1], which must be
+  // sorted.  Calls (*handle_result)(arg, i, ...) with the entry found
+  // after a call to Seek(k[i]).  Keys that fall into the same data block
+  // share a single block read.
+  Status InternalMultiGet(const ReadOptions&, const Slice* k, size_t n,
+                          void* arg,
+                          void (*handle_result)(void* arg, size_t i,
+                                                const Slice& k,
+                                                const Slice& v));
+
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
 
   Rep* const rep_;
 };
@@ -38,6 +38,8 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
 
   WriteBatch();
@@ -54,6 +56,11 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in [begin, end).  The whole range is
+  // recorded as a single entry, however many keys it covers.  Does nothing
+  // if "begin" is not before "end".
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -13,30 +13,44 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  size_t trailer_size = sizeof(uint32_t);
+  num_restarts_ = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  if (num_restarts_ & kBlockHashIndexFlag) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (size_ < 2 * sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
+    }
+    num_buckets_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+    trailer_size += sizeof(uint32_t) + num_buckets_;
+    if (num_buckets_ > size_ || trailer_size > size_ ||
+        num_restarts_ > kBlockHashMaxRestarts) {
+      size_ = 0;
+      return;
     }
   }
+  size_t max_restarts_allowed = (size_ - trailer_size) / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = size_ - trailer_size - num_restarts_ * sizeof(uint32_t);
+  }
 }
 
 Block::~Block() {
@@ -80,6 +94,8 @@ class Block::Iter : public Iterator {
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const uint8_t* const buckets_;  // Hash index used by Seek(), or nullptr
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -114,11 +130,13 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* buckets, uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        buckets_(buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -162,6 +180,10 @@ class Block::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
+    if (buckets_ != nullptr && HashSeek(target)) {
+      return;
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -239,6 +261,45 @@ class Block::Iter : public Iterator {
   }
 
  private:
+  void MarkInvalid() {
+    current_ = restarts_;
+    restart_index_ = num_restarts_;
+    key_.clear();
+    value_.clear();
+  }
+
+  // Looks up the restart interval of target's hash key in the hash index
+  // and seeks within it.  Returns false if the index cannot tell where
+  // the key is, after a collision.
+  bool HashSeek(const Slice& target) {
+    const Slice hash_key = comparator_->HashKey(target);
+    const uint32_t bucket =
+        buckets_[Hash(hash_key.data(), hash_key.size(), kBlockHashSeed) %
+                 num_buckets_];
+    if (bucket == kBlockHashCollision) {
+      return false;
+    }
+    if (bucket >= num_restarts_) {
+      // No entry has target's hash key.
+      MarkInvalid();
+      return true;
+    }
+    // All entries with target's hash key are in this restart interval.
+    const uint32_t limit =
+        bucket + 1 < num_restarts_ ? GetRestartPoint(bucket + 1) : restarts_;
+    SeekToRestartPoint(bucket);
+    while (ParseNextKey()) {
+      if (Compare(key_, target) >= 0) {
+        return true;
+      }
+      if (NextEntryOffset() >= limit) {
+        MarkInvalid();
+        return true;
+      }
+    }
+    return true;
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
@@ -277,15 +338,21 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* comparator) {
+Iterator* Block::NewIterator(const Comparator* comparator,
+                             bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    const uint8_t* buckets = nullptr;
+    if (point_lookup && num_buckets_ > 0) {
+      buckets = reinterpret_cast<const uint8_t*>(
+          data_ + restart_offset_ + num_restarts_ * sizeof(uint32_t));
+    }
+    return new Iter(comparator, data_, restart_offset_, num_restarts_,
+                    buckets, num_buckets_);
   }
 }
 
@@ -26,16 +26,22 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
+
+  // If "point_lookup" is true and the block has a hash index, Seek()
+  // goes straight to the entries with the target's hash key.  It may then
+  // leave the iterator invalid although there are later entries, if none
+  // of them shares the target's hash key.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool point_lookup = false);
 
  private:
   class Iter;
 
-  uint32_t NumRestarts() const;
-
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  uint32_t num_restarts_;
+  uint32_t num_buckets_;     // Size of the hash index, or zero
   bool owned_;               // Block owns data_[]
 };
 
@@ -25,6 +25,16 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// A block with a hash index has the trailer:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[Hash(hash key) % num_buckets] holds the index of the one restart
+// interval with entries of that hash, kBlockHashNoEntry if there are none,
+// or kBlockHashCollision if they are spread over several intervals.
+// Blocks with more than kBlockHashMaxRestarts restart points get no index.
 
 #include "table/block_builder.h"
 
@@ -34,14 +44,20 @@
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
 
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 #include "iostream"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
+    : options_(options),
+      hash_index_(hash_index),
+      restarts_(),
+      counter_(0),
+      finished_(false) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -53,12 +69,24 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   restarts_.clear();
   restarts_.push_back(0);
+  hashes_.clear();
   finished_ = false;
 }
 
+size_t BlockBuilder::NumHashBuckets() const {
+  if (hashes_.empty() || restarts_.size() > kBlockHashMaxRestarts) {
+    return 0;
+  }
+  // Keep the buckets at most 3/4 full.
+  return std::min<size_t>(hashes_.size() * 4 / 3 + 1, 65536);
+}
+
 size_t BlockBuilder::CurrentSizeEstimate() const {
+  const size_t num_buckets = NumHashBuckets();
   return (buffer_.size() +                       // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +  // Restart array
+          (num_buckets > 0 ? num_buckets + sizeof(uint32_t)
+                           : 0) +                // Hash index
           sizeof(uint32_t));                     // Restart array length
 }
 
@@ -76,7 +104,26 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  const size_t num_buckets = NumHashBuckets();
+  if (num_buckets == 0) {
+    PutFixed32(&buffer_, restarts_.size());
+    finished_ = true;
+    return Slice(buffer_);
+  }
+
+  std::string buckets(num_buckets, static_cast<char>(kBlockHashNoEntry));
+  for (const auto& entry : hashes_) {
+    char& bucket = buckets[entry.first % num_buckets];
+    const char restart_index = static_cast<char>(entry.second);
+    if (bucket == static_cast<char>(kBlockHashNoEntry)) {
+      bucket = restart_index;
+    } else if (bucket != restart_index) {
+      bucket = static_cast<char>(kBlockHashCollision);
+    }
+  }
+  buffer_.append(buckets);
+  PutFixed32(&buffer_, num_buckets);
+  PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -121,6 +168,12 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   std::cout << "shard:" << shared << std::endl;*/
   assert(Slice(last_key_) == key);
   counter_++;
+  if (hash_index_) {
+    const Slice hash_key = options_->comparator->HashKey(key);
+    hashes_.emplace_back(
+        Hash(hash_key.data(), hash_key.size(), kBlockHashSeed),
+        restarts_.size() - 1);
+  }
 }
 
 }  // namespace leveldb
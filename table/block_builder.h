@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -16,7 +17,10 @@ struct Options;
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // If "hash_index" is true, the block gets a hash index that maps the
+  // hash keys (see Comparator::HashKey) of its entries to their restart
+  // points, for Block::NewIterator(..., true).
+  explicit BlockBuilder(const Options* options, bool hash_index = false);
 
   BlockBuilder(const BlockBuilder&) = delete;
   BlockBuilder& operator=(const BlockBuilder&) = delete;
@@ -41,9 +45,15 @@ class BlockBuilder {
   bool empty() const { return buffer_.empty(); }
 
  private:
+  // Number of buckets of the hash index for the entries added so far.
+  size_t NumHashBuckets() const;
+
   const Options* options_;
+  const bool hash_index_;
   std::string buffer_;              // Destination buffer
   std::vector<uint32_t> restarts_;  // Restart points
+  // Hash and restart index of each entry, if hash_index_
+  std::vector<std::pair<uint32_t, uint32_t>> hashes_;
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
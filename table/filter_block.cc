@@ -103,4 +103,41 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy)
+    : policy_(policy) {}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  result_.clear();
+  const size_t num_keys = start_.size();
+  if (num_keys > 0) {
+    start_.push_back(keys_.size());  // Simplify length computation
+    std::vector<Slice> tmp_keys(num_keys);
+    for (size_t i = 0; i < num_keys; i++) {
+      tmp_keys[i] = Slice(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+    }
+    policy_->CreateFilter(tmp_keys.data(), static_cast<int>(num_keys),
+                          &result_);
+    keys_.clear();
+    start_.clear();
+  }
+  return Slice(result_);
+}
+
+FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy,
+                                             const Slice& contents)
+    : policy_(policy), filter_(contents) {}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) const {
+  if (filter_.empty()) {
+    // The table has no keys
+    return false;
+  }
+  return policy_->KeyMayMatch(key, filter_);
+}
+
 }  // namespace leveldb
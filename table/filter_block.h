@@ -4,7 +4,8 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  A full filter block instead holds one
+// filter over every key in the table.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -63,6 +64,40 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// A FullFilterBlockBuilder constructs a single filter over all of the
+// keys of a Table, or over those of one index partition.  Each Finish()
+// returns the filter over the keys added since the previous one, and
+// the result stays valid until the next call.  The sequence of calls
+// must match the regexp:
+//      (AddKey* Finish)*
+class FullFilterBlockBuilder {
+ public:
+  explicit FullFilterBlockBuilder(const FilterPolicy*);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  std::string keys_;           // Flattened key contents
+  std::vector<size_t> start_;  // Starting index in keys_ of each key
+  std::string result_;         // Filter data
+};
+
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  bool KeyMayMatch(const Slice& key) const;
+
+ private:
+  const FilterPolicy* policy_;
+  Slice filter_;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -119,4 +119,32 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullFilterEmpty) {
+  FullFilterBlockBuilder builder(&policy_);
+  Slice block = builder.Finish();
+  ASSERT_EQ("", EscapeString(block));
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(!reader.KeyMayMatch("foo"));
+}
+
+TEST_F(FilterBlockTest, FullFilter) {
+  FullFilterBlockBuilder builder(&policy_);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  builder.AddKey("box");
+  builder.AddKey("box");
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+
+  // One hash per key, with no offset array or trailer.
+  ASSERT_EQ(5 * 4, block.size());
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(reader.KeyMayMatch("bar"));
+  ASSERT_TRUE(reader.KeyMayMatch("box"));
+  ASSERT_TRUE(reader.KeyMayMatch("hello"));
+  ASSERT_TRUE(!reader.KeyMayMatch("missing"));
+  ASSERT_TRUE(!reader.KeyMayMatch("other"));
+}
+
 }  // namespace leveldb
@@ -34,8 +34,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic =
+      partitioned_index_ ? kPartitionedTableMagicNumber : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -50,9 +52,10 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber && magic != kPartitionedTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  partitioned_index_ = (magic == kPartitionedTableMagicNumber);
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
@@ -66,24 +69,31 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
+Status ReadRawBlock(RandomAccessFile* file, const ReadOptions& options,
+                    const BlockHandle& handle, Slice* raw, char** buf) {
+  *buf = nullptr;
 
   // Read the block contents as well as the type/crc footer.
   // See table_builder.cc for the code that built this structure.
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
+  char* scratch = new char[n + kBlockTrailerSize];
   Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  Status s =
+      file->Read(handle.offset(), n + kBlockTrailerSize, &contents, scratch);
   if (!s.ok()) {
-    delete[] buf;
+    delete[] scratch;
     return s;
   }
+  return ParseRawBlock(options, handle, contents, scratch, raw, buf);
+}
+
+Status ParseRawBlock(const ReadOptions& options, const BlockHandle& handle,
+                     const Slice& contents, char* scratch, Slice* raw,
+                     char** buf) {
+  *buf = nullptr;
+  size_t n = static_cast<size_t>(handle.size());
   if (contents.size() != n + kBlockTrailerSize) {
-    delete[] buf;
+    delete[] scratch;
     return Status::Corruption("truncated block read");
   }
 
@@ -93,19 +103,33 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
-      delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      delete[] scratch;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
+  if (data != scratch) {
+    // File implementation gave us pointer to some other data.
+    // Use it directly under the assumption that it will be live
+    // while the file is open.
+    delete[] scratch;
+  } else {
+    *buf = scratch;
+  }
+  *raw = Slice(data, n + 1);
+  return Status::OK();
+}
+
+Status UncompressBlock(const Slice& raw, char* buf, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  const char* data = raw.data();
+  const size_t n = raw.size() - 1;
   switch (data[n]) {
     case kNoCompression:
-      if (data != buf) {
-        // File implementation gave us pointer to some other data.
-        // Use it directly under the assumption that it will be live
-        // while the file is open.
-        delete[] buf;
+      if (buf == nullptr) {
         result->data = Slice(data, n);
         result->heap_allocated = false;
         result->cachable = false;  // Do not double-cache
@@ -161,4 +185,19 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  Slice raw;
+  char* buf;
+  Status s = ReadRawBlock(file, options, handle, &raw, &buf);
+  if (!s.ok()) {
+    return s;
+  }
+  return UncompressBlock(raw, buf, result);
+}
+
 }  // namespace leveldb
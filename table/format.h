@@ -58,16 +58,24 @@ class Footer {
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
   void set_metaindex_handle(const BlockHandle& h) { metaindex_handle_ = h; }
 
-  // The block handle for the index block of the table
+  // The block handle for the index block of the table.  If the index is
+  // partitioned, this is the top-level index, whose values are the
+  // handles of the index partitions.
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the index is partitioned.  Recorded through the magic number,
+  // so that readers which do not know about partitions reject the table.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool p) { partitioned_index_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,9 +83,34 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables with a partitioned index.
+static const uint64_t kPartitionedTableMagicNumber = 0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the block holding a table's range tombstones.
+static const char kRangeDelBlockName[] = "rangedel";
+
+// Metaindex key prefix marking a table whose filters are stored per index
+// partition; followed by the name of the filter policy.  The handles of
+// the filters are stored in the top-level index, so this entry's value
+// is unused.
+static const char kPartitionedFilterPrefix[] = "partitionedfilter.";
+
+// A block whose restart count has this bit set carries a hash index (see
+// block_builder.cc).  Readers without support for it see an impossible
+// restart count and reject the block as corrupt.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+
+// Values of the hash index buckets other than restart indices.
+static const uint8_t kBlockHashNoEntry = 255;
+static const uint8_t kBlockHashCollision = 254;
+static const uint32_t kBlockHashMaxRestarts = 253;
+
+// Seed for hashing the keys of the hash index.
+static const uint32_t kBlockHashSeed = 0x5f3a9c21;
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -89,6 +122,26 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Like ReadBlock(), but leaves the block compressed.  On success, *raw
+// holds the block as stored in the file, i.e. its contents followed by
+// the compression type byte.  *buf is set to the new[] array that holds
+// *raw, or to nullptr if the file returned a pointer to its own data.
+Status ReadRawBlock(RandomAccessFile* file, const ReadOptions& options,
+                    const BlockHandle& handle, Slice* raw, char** buf);
+
+// Finish a read of the block at "handle" as ReadRawBlock() would, given
+// that "contents" holds the bytes read for it (the block and its trailer)
+// into the new[] array "scratch".  Takes ownership of "scratch".
+Status ParseRawBlock(const ReadOptions& options, const BlockHandle& handle,
+                     const Slice& contents, char* scratch, Slice* raw,
+                     char** buf);
+
+// Uncompress the block "raw", as returned by ReadRawBlock(), into *result.
+// Takes ownership of "buf", which is either nullptr or the new[] array
+// that holds "raw".  If it is nullptr, "raw" must outlive *result unless
+// the block is compressed.
+Status UncompressBlock(const Slice& raw, char* buf, BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
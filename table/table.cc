@@ -4,11 +4,17 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -17,24 +23,187 @@
 
 namespace leveldb {
 
+// The readahead state of an iterator over the data blocks of a table.
+struct Readahead {
+  Readahead(const Table* table, size_t fixed_size)
+      : table(table),
+        fixed_size(fixed_size),
+        size(0),
+        sequential_reads(0),
+        next_offset(0),
+        limit(0) {}
+
+  // An iterator cleanup function.
+  static void Delete(void* arg, void* ignored) {
+    delete reinterpret_cast<Readahead*>(arg);
+  }
+
+  const Table* const table;
+  const size_t fixed_size;  // ReadOptions::readahead_size
+  size_t size;              // Bytes to read ahead next time
+  int sequential_reads;     // Blocks read in a row, each after the last
+  uint64_t next_offset;     // Offset after the block read last
+  uint64_t limit;           // End of the bytes read ahead so far
+};
+
+// A filter, as held in the block cache.
+struct CachedFilter {
+  CachedFilter(const FilterPolicy* policy, const BlockContents& contents,
+               bool full)
+      : data(contents.heap_allocated ? contents.data.data() : nullptr),
+        filter(full ? nullptr : new FilterBlockReader(policy, contents.data)),
+        full_filter(full ? new FullFilterBlockReader(policy, contents.data)
+                         : nullptr) {}
+  ~CachedFilter() {
+    delete filter;
+    delete full_filter;
+    delete[] data;
+  }
+
+  const char* data;  // Owned contents, or nullptr
+  FilterBlockReader* filter;
+  FullFilterBlockReader* full_filter;  // Set instead of filter
+};
+
+// The filter of a table while a lookup uses it.
+struct FilterRef {
+  FilterBlockReader* filter = nullptr;
+  FullFilterBlockReader* full_filter = nullptr;
+  Cache::Handle* cache_handle = nullptr;  // To release when done
+  CachedFilter* owned = nullptr;          // To delete when done
+};
+
 struct Table::Rep {
   ~Rep() {
     delete filter;
+    delete full_filter;
     delete[] filter_data;
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  uint64_t compressed_cache_id;  // Key prefix in block_cache_compressed
+  // With the file number, the key prefix in persistent_cache.
+  uint64_t persistent_cache_id;
+  uint64_t file_number;
   FilterBlockReader* filter;
+  FullFilterBlockReader* full_filter;  // Set instead of filter, if at all
   const char* filter_data;
+  size_t filter_size;
+
+  // With options.cache_index_and_filter_blocks, the index block and the
+  // filter are left to the block cache, and index_block and the filters
+  // above are nullptr.
+  bool cache_index_and_filters;
+  BlockHandle index_handle;
+  bool cached_filter;  // The filter is in the cache at filter_handle
+  BlockHandle filter_handle;
+  bool cached_filter_is_full;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  Block* index_block;  // The top-level index if partitioned_index
+  Block* range_del_block;  // nullptr if the table has no range tombstones
+  bool partitioned_index;
+  bool partitioned_filter;  // Each index partition has a filter
+
+  void ReadRangeDel(const Slice& range_del_handle_value);
+
+  // Called before an iterator reads the data block at "handle".  Asks the
+  // file to prefetch the blocks after it once the iterator's reads call
+  // for it.
+  void ReadAhead(Readahead* readahead, const BlockHandle& handle) const;
+
+  // Like ReadRawBlock(), but reads the block from the persistent cache if
+  // it holds the block, and adds it to that cache otherwise.
+  Status FetchRawBlock(const ReadOptions&, const BlockHandle& handle,
+                       Slice* raw, char** buf) const;
+
+  // Reads the block at "handle", from the compressed block cache if it
+  // holds the block, and adds it to that cache otherwise.
+  Status ReadBlockContents(const ReadOptions&, const BlockHandle& handle,
+                           BlockContents* contents) const;
+
+  // Returns an iterator over the block at "handle", looking it up in and
+  // adding it to the block cache if there is one.  High priority blocks
+  // are evicted last and are cached even if !ReadOptions::fill_cache.
+  // A point lookup iterator may use the hash index of the block; see
+  // Block::NewIterator().
+  Iterator* ReadBlockIterator(const ReadOptions&, const BlockHandle& handle,
+                              bool high_priority,
+                              bool point_lookup = false) const;
+
+  // Returns an iterator over the block at "handle" if the block cache
+  // holds it, and nullptr otherwise.  Requires a block cache.
+  Iterator* CachedBlockIterator(const BlockHandle& handle,
+                                bool point_lookup) const;
+
+  // Returns an iterator over a block read from "handle" into "contents",
+  // adding the block to the block cache as ReadBlockIterator() does.
+  Iterator* NewBlockIterator(const ReadOptions&, const BlockHandle& handle,
+                             const BlockContents& contents, bool high_priority,
+                             bool point_lookup) const;
+
+  // Stores in (*iters)[i] an iterator for point lookups over the data
+  // block at handles[i], as ReadBlockIterator() would.  The blocks that
+  // miss the block cache are read from the file with one MultiRead() call.
+  void ReadDataBlocks(const ReadOptions&,
+                      const std::vector<BlockHandle>& handles,
+                      std::vector<Iterator*>* iters) const;
+
+  // Returns an iterator over the index block, which may have to be read
+  // back into the block cache.
+  Iterator* NewIndexBlockIterator(const ReadOptions&) const;
+
+  // Returns an iterator over the index entries of all data blocks, which
+  // for a partitioned index reads the partitions as needed.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Makes the table's filter available to a lookup until UnpinFilter().
+  void PinFilter(const ReadOptions&, FilterRef* ref) const;
+  void UnpinFilter(FilterRef* ref) const;
+
+  // Returns false if the filter of the index partition whose top-level
+  // index value is "partition_value" rules out "key".
+  bool PartitionMayMatch(const ReadOptions&, const Slice& partition_value,
+                         const Slice& key) const;
+
+  // Like Table::BlockReader(), but take the Rep as their argument.
+  static Iterator* PointLookupReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* PartitionReader(void*, const ReadOptions&, const Slice&);
 };
 
+// Automatic readahead starts after this many blocks have been read in a
+// row, with kInitialAutoReadahead bytes, and doubles every time up to
+// kMaxAutoReadahead bytes.
+static const int kAutoReadaheadMinReads = 2;
+static const size_t kInitialAutoReadahead = 8 * 1024;
+static const size_t kMaxAutoReadahead = 256 * 1024;
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedFilter*>(value);
+}
+
+static void DeleteCachedRawBlock(const Slice& key, void* value) {
+  delete[] reinterpret_cast<char*>(value);
+}
+
+// Fills "buffer" with the block cache key of the block at "offset".
+static Slice BlockCacheKey(uint64_t cache_id, uint64_t offset,
+                           char (&buffer)[16]) {
+  EncodeFixed64(buffer, cache_id);
+  EncodeFixed64(buffer + 8, offset);
+  return Slice(buffer, sizeof(buffer));
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -70,22 +239,59 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->compressed_cache_id = (options.block_cache_compressed
+                                    ? options.block_cache_compressed->NewId()
+                                    : 0);
+    rep->persistent_cache_id =
+        (options.persistent_cache ? options.persistent_cache->NewId() : 0);
+    rep->file_number = 0;
     rep->filter_data = nullptr;
+    rep->filter_size = 0;
     rep->filter = nullptr;
+    rep->full_filter = nullptr;
+    rep->cache_index_and_filters =
+        options.cache_index_and_filter_blocks && options.block_cache != nullptr;
+    rep->index_handle = footer.index_handle();
+    rep->cached_filter = false;
+    rep->cached_filter_is_full = false;
+    if (rep->cache_index_and_filters && index_block_contents.cachable) {
+      // Hand the index over to the cache, which may evict it later.  If
+      // the cache has no room for it, the table keeps it.
+      char cache_key_buffer[16];
+      Cache* cache = options.block_cache;
+      Cache::Handle* handle;
+      Status insert_status = cache->TryInsert(
+          BlockCacheKey(rep->cache_id, rep->index_handle.offset(),
+                        cache_key_buffer),
+          index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::kHighPriority, &handle);
+      if (insert_status.ok()) {
+        cache->Release(handle);
+        rep->index_block = nullptr;
+      }
+    }
+    rep->range_del_block = nullptr;
+    rep->partitioned_index = footer.partitioned_index();
+    rep->partitioned_filter = false;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
+    s = rep->status;
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+  // An empty block holds just its restart array: one restart point plus
+  // the restart count.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return;  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -98,17 +304,35 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr && rep_->partitioned_index) {
+    std::string key = kPartitionedFilterPrefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    rep_->partitioned_filter = iter->Valid() && iter->key() == Slice(key);
+  } else if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), false);
+    } else {
+      key = "fullfilter.";
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      }
+    }
+  }
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    rep_->ReadRangeDel(iter->value());
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -125,21 +349,76 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  if (rep_->cache_index_and_filters && block.cachable) {
+    char cache_key_buffer[16];
+    Cache* cache = rep_->options.block_cache;
+    CachedFilter* filter =
+        new CachedFilter(rep_->options.filter_policy, block, full);
+    Cache::Handle* handle;
+    Status insert_status = cache->TryInsert(
+        BlockCacheKey(rep_->cache_id, filter_handle.offset(),
+                      cache_key_buffer),
+        filter, block.data.size(), &DeleteCachedFilter, Cache::kHighPriority,
+        &handle);
+    if (insert_status.ok()) {
+      cache->Release(handle);
+      rep_->cached_filter = true;
+      rep_->filter_handle = filter_handle;
+      rep_->cached_filter_is_full = full;
+      return;
+    }
+    // The cache has no room for the filter: the table keeps it instead.
+    rep_->filter_data = filter->data;
+    rep_->filter = filter->filter;
+    rep_->full_filter = filter->full_filter;
+    filter->data = nullptr;
+    filter->filter = nullptr;
+    filter->full_filter = nullptr;
+    delete filter;
+    return;
+  }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
+    rep_->filter_size = block.data.size();
+  }
+  if (full) {
+    rep_->full_filter =
+        new FullFilterBlockReader(rep_->options.filter_policy, block.data);
+  } else {
+    rep_->filter =
+        new FilterBlockReader(rep_->options.filter_policy, block.data);
+  }
+}
+
+void Table::Rep::ReadRangeDel(const Slice& range_del_handle_value) {
+  Slice v = range_del_handle_value;
+  BlockHandle range_del_handle;
+  if (!range_del_handle.DecodeFrom(&v).ok()) {
+    return;
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+
+  // Unlike the filter, the tombstones are needed for correct reads, so
+  // they are always verified.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  Status s = ReadBlock(file, opt, range_del_handle, &block);
+  if (!s.ok()) {
+    status = s;
+    return;
+  }
+  range_del_block = new Block(block);
 }
 
 Table::~Table() { delete rep_; }
 
-static void DeleteBlock(void* arg, void* ignored) {
-  delete reinterpret_cast<Block*>(arg);
+void Table::SetPersistentCacheKey(uint64_t cache_id, uint64_t file_number) {
+  rep_->persistent_cache_id = cache_id;
+  rep_->file_number = file_number;
 }
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+static void DeleteBlock(void* arg, void* ignored) {
+  delete reinterpret_cast<Block*>(arg);
 }
 
 static void ReleaseBlock(void* arg, void* h) {
@@ -148,84 +427,444 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+void Table::Rep::ReadAhead(Readahead* readahead,
+                           const BlockHandle& handle) const {
+  const uint64_t offset = handle.offset();
+  const uint64_t end = offset + handle.size() + kBlockTrailerSize;
+  if (offset == readahead->next_offset && readahead->sequential_reads > 0) {
+    readahead->sequential_reads++;
+  } else {
+    // A seek, or a step backward: start over.
+    readahead->sequential_reads = 1;
+    readahead->limit = 0;
+    readahead->size = readahead->fixed_size > 0 ? readahead->fixed_size
+                                                : kInitialAutoReadahead;
+  }
+  readahead->next_offset = end;
+
+  if (end <= readahead->limit || (readahead->fixed_size == 0 &&
+                                  readahead->sequential_reads <=
+                                      kAutoReadaheadMinReads)) {
+    return;
+  }
+  // Failing to read ahead is harmless.
+  file->Prefetch(offset, end - offset + readahead->size);
+  readahead->limit = end + readahead->size;
+  if (readahead->fixed_size == 0) {
+    readahead->size = std::min(2 * readahead->size, kMaxAutoReadahead);
+  }
+}
+
+Status Table::Rep::FetchRawBlock(const ReadOptions& read_options,
+                                 const BlockHandle& handle, Slice* raw,
+                                 char** buf) const {
+  PersistentCache* cache = options.persistent_cache;
+  if (cache == nullptr) {
+    return ReadRawBlock(file, read_options, handle, raw, buf);
+  }
+
+  char cache_key_buffer[24];
+  EncodeFixed64(cache_key_buffer, persistent_cache_id);
+  EncodeFixed64(cache_key_buffer + 8, file_number);
+  EncodeFixed64(cache_key_buffer + 16, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  std::string data;
+  if (cache->Lookup(key, &data).ok() && data.size() == handle.size() + 1) {
+    *buf = new char[data.size()];
+    std::memcpy(*buf, data.data(), data.size());
+    *raw = Slice(*buf, data.size());
+    return Status::OK();
+  }
+
+  Status s = ReadRawBlock(file, read_options, handle, raw, buf);
+  if (s.ok() && *buf != nullptr && read_options.fill_cache) {
+    cache->Insert(key, *raw);  // Failing to cache the block is harmless
+  }
+  return s;
+}
+
+Status Table::Rep::ReadBlockContents(const ReadOptions& read_options,
+                                     const BlockHandle& handle,
+                                     BlockContents* contents) const {
+  Cache* cache = options.block_cache_compressed;
+  if (cache == nullptr) {
+    Slice raw;
+    char* buf;
+    Status s = FetchRawBlock(read_options, handle, &raw, &buf);
+    if (!s.ok()) {
+      return s;
+    }
+    return UncompressBlock(raw, buf, contents);
+  }
+
+  // The cache holds blocks as ReadRawBlock() returns them, whose size
+  // follows from the handle.
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(compressed_cache_id, handle.offset(),
+                            cache_key_buffer);
+  Cache::Handle* cache_handle = cache->Lookup(key);
+  if (cache_handle != nullptr) {
+    Slice raw(reinterpret_cast<char*>(cache->Value(cache_handle)),
+              handle.size() + 1);
+    Status s = UncompressBlock(raw, nullptr, contents);
+    cache->Release(cache_handle);
+    return s;
+  }
+
+  Slice raw;
+  char* buf;
+  Status s = FetchRawBlock(read_options, handle, &raw, &buf);
+  if (!s.ok()) {
+    return s;
+  }
+  // Only compressed blocks are worth caching in this form, and only if
+  // they are not memory-mapped.
+  if (buf == nullptr || raw[raw.size() - 1] == kNoCompression ||
+      !read_options.fill_cache) {
+    return UncompressBlock(raw, buf, contents);
+  }
+  s = cache->TryInsert(key, buf, raw.size(), &DeleteCachedRawBlock,
+                       Cache::kLowPriority, &cache_handle);
+  if (!s.ok()) {
+    return UncompressBlock(raw, buf, contents);
+  }
+  s = UncompressBlock(raw, nullptr, contents);
+  cache->Release(cache_handle);
+  return s;
+}
+
+Iterator* Table::Rep::ReadBlockIterator(const ReadOptions& read_options,
+                                        const BlockHandle& handle,
+                                        bool high_priority,
+                                        bool point_lookup) const {
+  Cache* block_cache = options.block_cache;
+  if (block_cache != nullptr) {
+    Iterator* iter = CachedBlockIterator(handle, point_lookup);
+    if (iter != nullptr) {
+      return iter;
+    }
+  }
+  BlockContents contents;
+  Status s = ReadBlockContents(read_options, handle, &contents);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return NewBlockIterator(read_options, handle, contents, high_priority,
+                          point_lookup);
+}
+
+Iterator* Table::Rep::CachedBlockIterator(const BlockHandle& handle,
+                                          bool point_lookup) const {
+  Cache* block_cache = options.block_cache;
+  char cache_key_buffer[16];
+  Cache::Handle* cache_handle = block_cache->Lookup(
+      BlockCacheKey(cache_id, handle.offset(), cache_key_buffer));
+  if (cache_handle == nullptr) {
+    return nullptr;
+  }
+  Block* block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+  Iterator* iter = block->NewIterator(options.comparator, point_lookup);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
+}
+
+Iterator* Table::Rep::NewBlockIterator(const ReadOptions& read_options,
+                                       const BlockHandle& handle,
+                                       const BlockContents& contents,
+                                       bool high_priority,
+                                       bool point_lookup) const {
+  Cache* block_cache = options.block_cache;
+  Block* block = new Block(contents);
+  Cache::Handle* cache_handle = nullptr;
+  // The table does not keep its own copy of high priority blocks, so they
+  // go back into the cache even for !fill_cache reads.  If the cache has
+  // no room, the block is used uncached.
+  if (block_cache != nullptr && contents.cachable &&
+      (read_options.fill_cache || high_priority)) {
+    char cache_key_buffer[16];
+    Status insert_status = block_cache->TryInsert(
+        BlockCacheKey(cache_id, handle.offset(), cache_key_buffer),
+        block, block->size(), &DeleteCachedBlock,
+        high_priority ? Cache::kHighPriority : Cache::kLowPriority,
+        &cache_handle);
+    if (!insert_status.ok()) {
+      cache_handle = nullptr;
+    }
+  }
+
+  Iterator* iter = block->NewIterator(options.comparator, point_lookup);
+  if (cache_handle == nullptr) {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  } else {
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  }
+  return iter;
+}
+
+void Table::Rep::ReadDataBlocks(const ReadOptions& read_options,
+                                const std::vector<BlockHandle>& handles,
+                                std::vector<Iterator*>* iters) const {
+  const size_t n = handles.size();
+  iters->assign(n, nullptr);
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < n; i++) {
+    if (options.block_cache != nullptr) {
+      (*iters)[i] = CachedBlockIterator(handles[i], true);
+    }
+    if ((*iters)[i] == nullptr) {
+      misses.push_back(i);
+    }
+  }
+
+  // The other caches are consulted block by block, so leave the reads to
+  // ReadBlockIterator() when there are any.
+  if (misses.size() < 2 || options.block_cache_compressed != nullptr ||
+      options.persistent_cache != nullptr) {
+    for (size_t i : misses) {
+      (*iters)[i] = ReadBlockIterator(read_options, handles[i], false, true);
+    }
+    return;
+  }
+
+  std::vector<RandomAccessFile::ReadRequest> requests(misses.size());
+  for (size_t r = 0; r < misses.size(); r++) {
+    const BlockHandle& handle = handles[misses[r]];
+    requests[r].offset = handle.offset();
+    requests[r].n = static_cast<size_t>(handle.size()) + kBlockTrailerSize;
+    requests[r].scratch = new char[requests[r].n];
+  }
+  // Failed reads are reported through their own status.
+  file->MultiRead(requests.data(), requests.size());
+  for (size_t r = 0; r < misses.size(); r++) {
+    const size_t i = misses[r];
+    Status s = requests[r].status;
+    Slice raw;
+    char* buf = nullptr;
+    if (s.ok()) {
+      s = ParseRawBlock(read_options, handles[i], requests[r].result,
+                        requests[r].scratch, &raw, &buf);
+    } else {
+      delete[] requests[r].scratch;
+    }
+    BlockContents contents;
+    if (s.ok()) {
+      s = UncompressBlock(raw, buf, &contents);
+    }
+    (*iters)[i] = s.ok() ? NewBlockIterator(read_options, handles[i], contents,
+                                            false, true)
+                         : NewErrorIterator(s);
+  }
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = nullptr;
-  Cache::Handle* cache_handle = nullptr;
-
+  Readahead* readahead = reinterpret_cast<Readahead*>(arg);
+  const Table* table = readahead->table;
   BlockHandle handle;
   Slice input = index_value;
   Status s = handle.DecodeFrom(&input);
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  table->rep_->ReadAhead(readahead, handle);
+  return table->rep_->ReadBlockIterator(options, handle, false);
+}
 
-  if (s.ok()) {
+// Like BlockReader(), but for the lookup of a single key, which may use
+// the hash index of the block.
+Iterator* Table::Rep::PointLookupReader(void* arg,
+                                        const ReadOptions& options,
+                                        const Slice& index_value) {
+  Rep* rep = reinterpret_cast<Rep*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return rep->ReadBlockIterator(options, handle, false, true);
+}
+
+// Like BlockReader(), but for the partitions of a partitioned index.
+Iterator* Table::Rep::PartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Rep* rep = reinterpret_cast<Rep*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return rep->ReadBlockIterator(options, handle, rep->cache_index_and_filters);
+}
+
+Iterator* Table::Rep::NewIndexBlockIterator(
+    const ReadOptions& read_options) const {
+  if (index_block != nullptr) {
+    return index_block->NewIterator(options.comparator);
+  }
+  return ReadBlockIterator(read_options, index_handle, true);
+}
+
+Iterator* Table::Rep::NewIndexIterator(const ReadOptions& read_options) const {
+  Iterator* iter = NewIndexBlockIterator(read_options);
+  if (partitioned_index) {
+    iter = NewTwoLevelIterator(iter, &Rep::PartitionReader,
+                               const_cast<Rep*>(this), read_options);
+  }
+  return iter;
+}
+
+void Table::Rep::PinFilter(const ReadOptions& read_options,
+                           FilterRef* ref) const {
+  ref->filter = filter;
+  ref->full_filter = full_filter;
+  if (!cached_filter) {
+    return;
+  }
+
+  Cache* block_cache = options.block_cache;
+  char cache_key_buffer[16];
+  Slice key = BlockCacheKey(cache_id, filter_handle.offset(),
+                            cache_key_buffer);
+  CachedFilter* cached;
+  ref->cache_handle = block_cache->Lookup(key);
+  if (ref->cache_handle != nullptr) {
+    cached = reinterpret_cast<CachedFilter*>(
+        block_cache->Value(ref->cache_handle));
+  } else {
     BlockContents contents;
-    if (block_cache != nullptr) {
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != nullptr) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
-          }
-        }
-      }
-    } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
-      }
+    if (!ReadBlockContents(read_options, filter_handle, &contents).ok()) {
+      return;  // Read without the filter
     }
+    cached = new CachedFilter(options.filter_policy, contents,
+                              cached_filter_is_full);
+    Status insert_status = Status::NotSupported("not cachable");
+    if (contents.cachable) {
+      insert_status = block_cache->TryInsert(
+          key, cached, contents.data.size(), &DeleteCachedFilter,
+          Cache::kHighPriority, &ref->cache_handle);
+    }
+    if (!insert_status.ok()) {
+      ref->cache_handle = nullptr;
+      ref->owned = cached;
+    }
+  }
+  ref->filter = cached->filter;
+  ref->full_filter = cached->full_filter;
+}
+
+void Table::Rep::UnpinFilter(FilterRef* ref) const {
+  if (ref->cache_handle != nullptr) {
+    options.block_cache->Release(ref->cache_handle);
   }
+  delete ref->owned;
+}
 
-  Iterator* iter;
-  if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == nullptr) {
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+bool Table::Rep::PartitionMayMatch(const ReadOptions& read_options,
+                                   const Slice& partition_value,
+                                   const Slice& key) const {
+  Slice input = partition_value;
+  BlockHandle partition_handle, partition_filter_handle;
+  if (!partition_handle.DecodeFrom(&input).ok() ||
+      !partition_filter_handle.DecodeFrom(&input).ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  Cache* block_cache = options.block_cache;
+  char cache_key_buffer[16];
+  Slice cache_key = BlockCacheKey(cache_id, partition_filter_handle.offset(),
+                                  cache_key_buffer);
+  if (block_cache != nullptr) {
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      CachedFilter* cached =
+          reinterpret_cast<CachedFilter*>(block_cache->Value(cache_handle));
+      const bool may_match = cached->full_filter->KeyMayMatch(key);
+      block_cache->Release(cache_handle);
+      return may_match;
+    }
+  }
+
+  BlockContents contents;
+  if (!ReadBlockContents(read_options, partition_filter_handle, &contents)
+           .ok()) {
+    return true;
+  }
+  CachedFilter* cached =
+      new CachedFilter(options.filter_policy, contents, true);
+  const bool may_match = cached->full_filter->KeyMayMatch(key);
+  const bool high_priority = cache_index_and_filters;
+  Cache::Handle* cache_handle = nullptr;
+  if (block_cache != nullptr && contents.cachable &&
+      (read_options.fill_cache || high_priority)) {
+    Status insert_status = block_cache->TryInsert(
+        cache_key, cached, contents.data.size(), &DeleteCachedFilter,
+        high_priority ? Cache::kHighPriority : Cache::kLowPriority,
+        &cache_handle);
+    if (!insert_status.ok()) {
+      cache_handle = nullptr;
     }
+  }
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
   } else {
-    iter = NewErrorIterator(s);
+    delete cached;
   }
-  return iter;
+  return may_match;
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  Readahead* readahead = new Readahead(this, options.readahead_size);
+  Iterator* iter = NewTwoLevelIterator(
+      rep_->NewIndexIterator(options), &Table::BlockReader, readahead, options);
+  iter->RegisterCleanup(&Readahead::Delete, readahead, nullptr);
+  return iter;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  FilterRef filter;
+  rep_->PinFilter(options, &filter);
+  if (filter.full_filter != nullptr && !filter.full_filter->KeyMayMatch(k)) {
+    rep_->UnpinFilter(&filter);
+    return s;  // Not found
+  }
+  if (rep_->partitioned_filter) {
+    Iterator* top = rep_->NewIndexBlockIterator(options);
+    top->Seek(k);
+    const bool may_match =
+        !top->Valid() || rep_->PartitionMayMatch(options, top->value(), k);
+    delete top;
+    if (!may_match) {
+      rep_->UnpinFilter(&filter);
+      return s;  // Not found
+    }
+  }
+  Iterator* iiter = rep_->NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (filter.filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
+        !filter.filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter =
+          Rep::PointLookupReader(rep_, options, iiter->value());
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
@@ -238,12 +877,154 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
     s = iiter->status();
   }
   delete iiter;
+  rep_->UnpinFilter(&filter);
   return s;
 }
 
+Status Table::InternalMultiGet(const ReadOptions& options, const Slice* k,
+                               size_t n, void* arg,
+                               void (*handle_result)(void*, size_t,
+                                                     const Slice&,
+                                                     const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  FilterRef filter;
+  rep_->PinFilter(options, &filter);
+  Iterator* iiter = rep_->NewIndexIterator(options);
+  Iterator* top =
+      rep_->partitioned_filter ? rep_->NewIndexBlockIterator(options) : nullptr;
+  // First find the data block of every key that the filters let through,
+  // so that the blocks can be read together.  Keys are sorted, so keys in
+  // the same block are next to each other.
+  std::vector<BlockHandle> handles;
+  std::vector<std::pair<size_t, size_t>> lookups;  // Key index, block index
+  for (size_t i = 0; i < n && s.ok(); i++) {
+    if (filter.full_filter != nullptr &&
+        !filter.full_filter->KeyMayMatch(k[i])) {
+      continue;  // Not found
+    }
+    if (top != nullptr) {
+      if (!top->Valid() || cmp->Compare(top->key(), k[i]) < 0) {
+        top->Seek(k[i]);
+      }
+      if (top->Valid() &&
+          !rep_->PartitionMayMatch(options, top->value(), k[i])) {
+        continue;  // Not found
+      }
+    }
+    // Since the keys are sorted, the index entry found for the previous
+    // key is still the right one as long as it is not before k[i].
+    if (!iiter->Valid() || cmp->Compare(iiter->key(), k[i]) < 0) {
+      iiter->Seek(k[i]);
+      if (!iiter->Valid()) {
+        break;  // This and all later keys are past the end of the table
+      }
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      break;
+    }
+    if (filter.filter != nullptr &&
+        !filter.filter->KeyMayMatch(handle.offset(), k[i])) {
+      // Not found
+      continue;
+    }
+    if (handles.empty() || handle.offset() != handles.back().offset()) {
+      handles.push_back(handle);
+    }
+    lookups.emplace_back(i, handles.size() - 1);
+  }
+  delete top;
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  rep_->UnpinFilter(&filter);
+
+  if (s.ok() && !handles.empty()) {
+    std::vector<Iterator*> block_iters;
+    rep_->ReadDataBlocks(options, handles, &block_iters);
+    for (size_t l = 0; l < lookups.size() && s.ok(); l++) {
+      const size_t i = lookups[l].first;
+      Iterator* block_iter = block_iters[lookups[l].second];
+      block_iter->Seek(k[i]);
+      if (block_iter->Valid()) {
+        (*handle_result)(arg, i, block_iter->key(), block_iter->value());
+      }
+      s = block_iter->status();
+    }
+    for (Iterator* block_iter : block_iters) {
+      delete block_iter;
+    }
+  }
+  return s;
+}
+
+bool Table::PrefixMayMatch(const Slice& target,
+                           const Slice& filter_key) const {
+  const ReadOptions options;
+  if (rep_->partitioned_filter) {
+    // As below, but for the partitions holding those blocks.
+    Iterator* top = rep_->NewIndexBlockIterator(options);
+    top->Seek(target);
+    bool may_match = false;
+    for (int i = 0; i < 2 && top->Valid() && !may_match; i++) {
+      may_match = rep_->PartitionMayMatch(options, top->value(), filter_key);
+      top->Next();
+    }
+    if (!top->status().ok()) {
+      may_match = true;  // Let the read report the error
+    }
+    delete top;
+    return may_match;
+  }
+  FilterRef filter;
+  rep_->PinFilter(options, &filter);
+  if (filter.full_filter != nullptr) {
+    const bool may_match = filter.full_filter->KeyMayMatch(filter_key);
+    rep_->UnpinFilter(&filter);
+    return may_match;
+  }
+  if (filter.filter == nullptr) {
+    rep_->UnpinFilter(&filter);
+    return true;
+  }
+  // The first entry at or after target is in the block found by the index
+  // or, if target falls between that block's last key and its separator,
+  // at the start of the next one.
+  Iterator* iiter = rep_->NewIndexBlockIterator(options);
+  iiter->Seek(target);
+  bool may_match = false;
+  for (int i = 0; i < 2 && iiter->Valid() && !may_match; i++) {
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    may_match = !handle.DecodeFrom(&handle_value).ok() ||
+                filter.filter->KeyMayMatch(handle.offset(), filter_key);
+    iiter->Next();
+  }
+  if (!iiter->status().ok()) {
+    may_match = true;  // Let the read report the error
+  }
+  delete iiter;
+  rep_->UnpinFilter(&filter);
+  return may_match;
+}
+
+size_t Table::ApproximateMemoryUsage() const {
+  size_t usage = sizeof(Rep) + rep_->filter_size;
+  if (rep_->index_block != nullptr) {
+    usage += rep_->index_block->size();
+  }
+  if (rep_->range_del_block != nullptr) {
+    usage += rep_->range_del_block->size();
+  }
+  return usage;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = rep_->NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
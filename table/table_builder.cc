@@ -24,15 +24,30 @@ struct TableBuilder::Rep {
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, opt.data_block_hash_index),
         index_block(&index_block_options),
+        range_del_block(&index_block_options),
         num_entries(0),
+        num_range_tombstones(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
-                         ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+        filter_block(nullptr),
+        full_filter_block(nullptr),
+        top_level_index(nullptr),
+        partition_filter_block(nullptr),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
+    if (opt.partition_index_and_filters) {
+      top_level_index = new BlockBuilder(&index_block_options);
+    }
+    if (opt.filter_policy == nullptr) {
+      // No filters
+    } else if (opt.partition_index_and_filters) {
+      partition_filter_block = new FullFilterBlockBuilder(opt.filter_policy);
+    } else if (opt.full_file_filter) {
+      full_filter_block = new FullFilterBlockBuilder(opt.filter_policy);
+    } else {
+      filter_block = new FilterBlockBuilder(opt.filter_policy);
+    }
   }
 
   Options options;
@@ -42,10 +57,19 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
+  int64_t num_range_tombstones;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  FullFilterBlockBuilder* full_filter_block;  // Used instead of filter_block
+
+  // With partition_index_and_filters, index_block holds the current index
+  // partition, and top_level_index maps the last key of each partition to
+  // the handles of the partition and of its filter, if any.
+  BlockBuilder* top_level_index;
+  FullFilterBlockBuilder* partition_filter_block;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -72,6 +96,9 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
+  delete rep_->top_level_index;
+  delete rep_->partition_filter_block;
   delete rep_;
 }
 
@@ -106,10 +133,18 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->top_level_index != nullptr &&
+        r->index_block.CurrentSizeEstimate() >= r->options.block_size) {
+      FlushIndexPartition();
+    }
   }
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
+  } else if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+  } else if (r->partition_filter_block != nullptr) {
+    r->partition_filter_block->AddKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -122,6 +157,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+  r->num_range_tombstones++;
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -138,6 +181,24 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  if (!ok() || r->index_block.empty()) return;
+  // The partition ends with the entry just added, so the last key is an
+  // upper bound for all of its keys and below those of later partitions.
+  BlockHandle partition_handle;
+  WriteBlock(&r->index_block, &partition_handle);
+  std::string handles_encoding;
+  partition_handle.EncodeTo(&handles_encoding);
+  if (ok() && r->partition_filter_block != nullptr) {
+    BlockHandle filter_handle;
+    WriteRawBlock(r->partition_filter_block->Finish(), kNoCompression,
+                  &filter_handle);
+    filter_handle.EncodeTo(&handles_encoding);
+  }
+  r->top_level_index->Add(r->last_key, handles_encoding);
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -216,17 +277,30 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_del_block_handle,
+      metaindex_block_handle, index_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+  } else if (ok() && r->full_filter_block != nullptr) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
+
+  // Write range deletion block
+  if (ok() && r->num_range_tombstones > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    // Meta block names are ordered bytewise, as Table::ReadMeta() reads
+    // them, whatever comparator orders the table's keys.
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != nullptr) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -234,6 +308,31 @@ Status TableBuilder::Finish() {
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
+    } else if (r->full_filter_block != nullptr) {
+      // Add mapping from "fullfilter.Name" to location of filter data
+      std::string key = "fullfilter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (r->partition_filter_block != nullptr) {
+      // Only marks the filters as present; their handles are in the index
+      std::string key = kPartitionedFilterPrefix;
+      key.append(r->options.filter_policy->Name());
+      BlockHandle none;
+      none.set_offset(0);
+      none.set_size(0);
+      std::string handle_encoding;
+      none.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (r->num_range_tombstones > 0) {
+      // "rangedel" sorts after the "filter.*", "fullfilter.*" and
+      // "partitionedfilter.*" keys, as the block builder requires
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -249,7 +348,14 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (r->top_level_index != nullptr) {
+      FlushIndexPartition();
+      if (ok()) {
+        WriteBlock(r->top_level_index, &index_block_handle);
+      }
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
+    }
   }
 
   // Write footer
@@ -257,6 +363,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->top_level_index != nullptr);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -275,6 +382,10 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_tombstones;
+}
+
 uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 }  // namespace leveldb
@@ -6,11 +6,14 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -19,6 +22,7 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -182,7 +186,7 @@ class BlockConstructor : public Constructor {
   Status FinishImpl(const Options& options, const KVMap& data) override {
     delete block_;
     block_ = nullptr;
-    BlockBuilder builder(&options);
+    BlockBuilder builder(&options, options.data_block_hash_index);
 
     for (const auto& kvp : data) {
       builder.Add(kvp.first, kvp.second);
@@ -371,7 +375,14 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
+  BLOCK_TEST,
+  HASH_INDEX_BLOCK_TEST,
+  MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
@@ -387,6 +398,10 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Index partitions share the table's block size
+    {PARTITIONED_TABLE_TEST, false, 16},
+    {PARTITIONED_TABLE_TEST, true, 16},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -394,6 +409,11 @@ static const TestArgs kTestArgList[] = {
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
 
+    // Small restart intervals exceed the restart limit of the hash index
+    {HASH_INDEX_BLOCK_TEST, false, 16},
+    {HASH_INDEX_BLOCK_TEST, true, 16},
+    {HASH_INDEX_BLOCK_TEST, false, 1},
+
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
     {MEMTABLE_TEST, true, 16},
@@ -424,9 +444,17 @@ class Harness : public testing::Test {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        options_.partition_index_and_filters = true;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
+      case HASH_INDEX_BLOCK_TEST:
+        options_.data_block_hash_index = true;
+        constructor_ = new BlockConstructor(options_.comparator);
+        break;
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
@@ -722,6 +750,78 @@ TEST_F(Harness, RandomizedLongDB) {
   ASSERT_GT(files, 0);
 }
 
+static Block* BuildBlock(const Options& options, int n, std::string* data) {
+  BlockBuilder builder(&options, true);
+  char key[20];
+  for (int i = 0; i < n; i++) {
+    std::snprintf(key, sizeof(key), "k%06d", 2 * i);
+    builder.Add(key, std::string(i % 7, 'v'));
+  }
+  *data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = *data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  return new Block(contents);
+}
+
+TEST(BlockTest, HashIndexPointLookups) {
+  Options options;
+  std::string data;
+  Block* block = BuildBlock(options, 500, &data);
+  ASSERT_NE(0, DecodeFixed32(data.data() + data.size() - 4) &
+                   kBlockHashIndexFlag);
+
+  Iterator* iter = block->NewIterator(BytewiseComparator(), true);
+  char key[20];
+  for (int i = 0; i < 1000; i++) {
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    iter->Seek(key);
+    if (i % 2 == 0) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(key, iter->key().ToString());
+      ASSERT_EQ(std::string((i / 2) % 7, 'v'), iter->value().ToString());
+    } else {
+      // Absent keys leave the iterator invalid or at a later key.
+      ASSERT_TRUE(!iter->Valid() || iter->key().ToString() > key);
+    }
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+
+  // Other iterators ignore the hash index.
+  iter = block->NewIterator(BytewiseComparator());
+  iter->Seek("k000001");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k000002", iter->key().ToString());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(500, count);
+  delete iter;
+  delete block;
+}
+
+TEST(BlockTest, HashIndexRestartLimit) {
+  // One restart point per entry exceeds what the index can address.
+  Options options;
+  options.block_restart_interval = 1;
+  std::string data;
+  Block* block = BuildBlock(options, 300, &data);
+  ASSERT_EQ(300, DecodeFixed32(data.data() + data.size() - 4));
+
+  Iterator* iter = block->NewIterator(BytewiseComparator(), true);
+  iter->Seek("k000200");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k000200", iter->key().ToString());
+  iter->Seek("k000201");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k000202", iter->key().ToString());
+  delete iter;
+  delete block;
+}
+
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* memtable = new MemTable(cmp);
@@ -839,4 +939,184 @@ TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// A StringSource that counts its reads.
+class CountingSource : public StringSource {
+ public:
+  CountingSource(const Slice& contents) : StringSource(contents), reads_(0) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    reads_++;
+    return StringSource::Read(offset, n, result, scratch);
+  }
+
+  int reads() const { return reads_; }
+
+ private:
+  mutable int reads_;
+};
+
+// Builds a table of compressible values, opens it with a block cache
+// that caches nothing and the given compressed block cache, and scans it
+// twice.  Returns the number of file reads made by the second scan.
+static int RereadsWithCompressedCache(CompressionType type,
+                                      Cache* compressed_cache) {
+  Random rnd(301);
+  StringSink sink;
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  TableBuilder builder(options, &sink);
+  std::string value;
+  for (int i = 0; i < 100; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, test::CompressibleString(&rnd, 0.25, 300, &value));
+  }
+  EXPECT_LEVELDB_OK(builder.Finish());
+
+  CountingSource source(sink.contents());
+  options.block_cache = NewLRUCache(0);
+  options.block_cache_compressed = compressed_cache;
+  Table* table;
+  EXPECT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &table));
+  int reads = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    reads = source.reads();
+    Iterator* iter = table->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    EXPECT_EQ(100, count);
+    delete iter;
+  }
+  reads = source.reads() - reads;
+  delete table;
+  delete options.block_cache;
+  return reads;
+}
+
+TEST_P(CompressionTableTest, CompressedBlockCache) {
+  CompressionType type = ::testing::get<0>(GetParam());
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
+  }
+
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  ASSERT_EQ(0, RereadsWithCompressedCache(type, compressed_cache));
+  ASSERT_GT(compressed_cache->TotalCharge(), 0);
+  delete compressed_cache;
+
+  ASSERT_GT(RereadsWithCompressedCache(type, nullptr), 0);
+}
+
+TEST(TableTest, CompressedBlockCacheSkipsUncompressedBlocks) {
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  ASSERT_GT(RereadsWithCompressedCache(kNoCompression, compressed_cache), 0);
+  ASSERT_EQ(0, compressed_cache->TotalCharge());
+  delete compressed_cache;
+}
+
+// Records the ranges that a table asks it to prefetch.
+class PrefetchRecordingSource : public StringSource {
+ public:
+  PrefetchRecordingSource(const Slice& contents) : StringSource(contents) {}
+
+  Status Prefetch(uint64_t offset, size_t n) const override {
+    prefetches_.emplace_back(offset, n);
+    return Status::OK();
+  }
+
+  mutable std::vector<std::pair<uint64_t, size_t>> prefetches_;
+};
+
+class ReadaheadTest : public testing::Test {
+ public:
+  ReadaheadTest() : table_(nullptr) {
+    // About 100 data blocks of 1KB.
+    StringSink sink;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kNoCompression;
+    TableBuilder builder(options, &sink);
+    for (int i = 0; i < 300; i++) {
+      builder.Add(Key(i), std::string(300, 'v'));
+    }
+    EXPECT_LEVELDB_OK(builder.Finish());
+    source_ = new PrefetchRecordingSource(sink.contents());
+    EXPECT_LEVELDB_OK(
+        Table::Open(options, source_, sink.contents().size(), &table_));
+  }
+
+  ~ReadaheadTest() {
+    delete table_;
+    delete source_;
+  }
+
+  static std::string Key(int i) {
+    char buf[20];
+    std::snprintf(buf, sizeof(buf), "k%04d", i);
+    return std::string(buf);
+  }
+
+  // Scans the table from "start" to the end, or if "backward", to the
+  // start.  Returns the number of entries seen.
+  int Scan(const ReadOptions& options, int start, bool backward = false) {
+    Iterator* iter = table_->NewIterator(options);
+    int count = 0;
+    for (iter->Seek(Key(start)); iter->Valid();
+         backward ? iter->Prev() : iter->Next()) {
+      count++;
+    }
+    EXPECT_LEVELDB_OK(iter->status());
+    delete iter;
+    return count;
+  }
+
+  PrefetchRecordingSource* source_;
+  Table* table_;
+};
+
+TEST_F(ReadaheadTest, AutomaticReadaheadGrows) {
+  ASSERT_EQ(300, Scan(ReadOptions(), 0));
+  const auto& prefetches = source_->prefetches_;
+  ASSERT_GE(prefetches.size(), 4);
+  // Readahead starts after a few blocks, and is issued ahead of the scan.
+  ASSERT_GT(prefetches[0].first, 2000);
+  for (size_t i = 1; i < prefetches.size(); i++) {
+    ASSERT_GT(prefetches[i].first, prefetches[i - 1].first);
+    ASSERT_LE(prefetches[i].first,
+              prefetches[i - 1].first + prefetches[i - 1].second);
+    if (i < 3) {
+      ASSERT_GT(prefetches[i].second, prefetches[i - 1].second);
+    }
+  }
+}
+
+TEST_F(ReadaheadTest, NoAutomaticReadaheadForShortReads) {
+  ReadOptions options;
+  Iterator* iter = table_->NewIterator(options);
+  for (int i = 0; i < 300; i += 30) {
+    iter->Seek(Key(i));
+    ASSERT_TRUE(iter->Valid());
+  }
+  delete iter;
+  ASSERT_EQ(300, Scan(options, 299, true));
+  ASSERT_TRUE(source_->prefetches_.empty());
+}
+
+TEST_F(ReadaheadTest, FixedReadahead) {
+  ReadOptions options;
+  options.readahead_size = 16 * 1024;
+  ASSERT_EQ(150, Scan(options, 150));
+  const auto& prefetches = source_->prefetches_;
+  ASSERT_GE(prefetches.size(), 2);
+  ASSERT_LE(prefetches.size(), 4);
+  for (size_t i = 0; i < prefetches.size(); i++) {
+    ASSERT_GT(prefetches[i].second, options.readahead_size);
+  }
+}
+
 }  // namespace leveldb
@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 class Arena {
@@ -28,6 +31,12 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Variants of Allocate() and AllocateAligned() that may be called by
+  // several threads at once.  They must not race with calls to the
+  // unsynchronized variants above.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -50,6 +59,11 @@ class Arena {
   // TODO(costan): This member is accessed via atomics, but the others are
   //               accessed without any locking. Is this OK?
   std::atomic<size_t> memory_usage_;
+
+  // Serializes the *Concurrently() allocation paths.  Held only for the
+  // few instructions it takes to bump alloc_ptr_ (or, rarely, to carve
+  // out a new block).
+  port::Mutex concurrent_mu_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -66,6 +80,16 @@ inline char* Arena::Allocate(size_t bytes) {
   return AllocateFallback(bytes);
 }
 
+inline char* Arena::AllocateConcurrently(size_t bytes) {
+  MutexLock l(&concurrent_mu_);
+  return Allocate(bytes);
+}
+
+inline char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  MutexLock l(&concurrent_mu_);
+  return AllocateAligned(bytes);
+}
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_ARENA_H_
@@ -4,7 +4,10 @@
 
 #include "util/arena.h"
 
+#include <atomic>
+
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -58,4 +61,65 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+namespace {
+
+struct ConcurrentArenaState {
+  Arena arena;
+  std::atomic<int> thread_done[4];
+  std::vector<std::pair<size_t, char*>> allocated[4];
+};
+
+struct ConcurrentArenaThread {
+  ConcurrentArenaState* state;
+  int id;
+};
+
+void ConcurrentArenaBody(void* arg) {
+  ConcurrentArenaThread* t = reinterpret_cast<ConcurrentArenaThread*>(arg);
+  ConcurrentArenaState* state = t->state;
+  Random rnd(1000 + t->id);
+  for (int i = 0; i < 20000; i++) {
+    size_t s = rnd.OneIn(1000) ? 1 + rnd.Uniform(3000) : 1 + rnd.Uniform(40);
+    char* r = rnd.OneIn(2) ? state->arena.AllocateAlignedConcurrently(s)
+                           : state->arena.AllocateConcurrently(s);
+    for (size_t b = 0; b < s; b++) {
+      r[b] = static_cast<char>(t->id);
+    }
+    state->allocated[t->id].push_back(std::make_pair(s, r));
+  }
+  state->thread_done[t->id].store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST(ArenaTest, Concurrent) {
+  ConcurrentArenaState state;
+  ConcurrentArenaThread thread[4];
+  for (int id = 0; id < 4; id++) {
+    state.thread_done[id].store(false, std::memory_order_relaxed);
+    thread[id].state = &state;
+    thread[id].id = id;
+    Env::Default()->StartThread(ConcurrentArenaBody, &thread[id]);
+  }
+  for (int id = 0; id < 4; id++) {
+    while (!state.thread_done[id].load(std::memory_order_acquire)) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+
+  // No allocation may have been handed out twice.
+  size_t bytes = 0;
+  for (int id = 0; id < 4; id++) {
+    for (size_t i = 0; i < state.allocated[id].size(); i++) {
+      size_t num_bytes = state.allocated[id][i].first;
+      const char* p = state.allocated[id][i].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(id, p[b]);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(state.arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
@@ -4,6 +4,10 @@
 
 #include "leveldb/filter_policy.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
@@ -83,10 +87,147 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// A bloom filter whose probes for a key all land in one 64-byte cache
+// line, so that a lookup touches a single line of the filter however many
+// probes it makes.  The filter is a whole number of lines followed by one
+// byte holding the number of probes.  Within a line, probe j of a key
+// tests bit (s * m^(j+1)) >> 23 for a seed s derived from the key's hash.
+class CacheLocalBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit CacheLocalBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  const char* Name() const override {
+    return "leveldb.CacheLocalBloomFilter";
+  }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    size_t lines = (n * bits_per_key_ + kLineBits - 1) / kLineBits;
+    if (lines == 0) lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineIndex(h, lines) * kLineBytes;
+      uint32_t probe = ProbeSeed(h);
+      for (size_t j = 0; j < k_; j++) {
+        probe *= kProbeMultiplier;
+        const uint32_t bitpos = probe >> 23;  // 9 bits: one of 512
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    const size_t len = bloom_filter.size();
+    if (len < 2) return false;
+    if ((len - 1) % kLineBytes != 0) {
+      // Not a filter we know how to read.  Consider it a match.
+      return true;
+    }
+
+    const char* array = bloom_filter.data();
+    const size_t k = array[len - 1];
+    if (k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const size_t lines = (len - 1) / kLineBytes;
+    return LineMayMatch(array + LineIndex(h, lines) * kLineBytes,
+                        ProbeSeed(h), k);
+  }
+
+ private:
+  static const size_t kLineBytes = 64;
+  static const size_t kLineBits = kLineBytes * 8;
+  static const uint32_t kProbeMultiplier = 0x9e3779b9;  // Odd: 2^32 / phi
+
+  // Map the hash onto [0,lines) without a division.
+  static size_t LineIndex(uint32_t h, size_t lines) {
+    return static_cast<size_t>((static_cast<uint64_t>(h) * lines) >> 32);
+  }
+
+  // The line was picked by the high bits of the hash, so rotate the low
+  // bits up before deriving the probes from it.
+  static uint32_t ProbeSeed(uint32_t h) { return (h >> 17) | (h << 15); }
+
+#if defined(__AVX2__)
+  static constexpr uint32_t Power(uint32_t m, int n) {
+    return n == 0 ? 1 : m * Power(m, n - 1);
+  }
+
+  // Tests up to eight probes at a time.  The line is held in two
+  // registers of eight 32-bit words each, and each probe picks its word
+  // with a permute rather than a gather.
+  static bool LineMayMatch(const char* line, uint32_t seed, size_t k) {
+    const __m256i lo =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+    const __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+    const __m256i powers = _mm256_setr_epi32(
+        Power(kProbeMultiplier, 1), Power(kProbeMultiplier, 2),
+        Power(kProbeMultiplier, 3), Power(kProbeMultiplier, 4),
+        Power(kProbeMultiplier, 5), Power(kProbeMultiplier, 6),
+        Power(kProbeMultiplier, 7), Power(kProbeMultiplier, 8));
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i seeds = _mm256_set1_epi32(static_cast<int>(seed));
+    for (size_t done = 0; done < k; done += 8) {
+      const __m256i bitpos =
+          _mm256_srli_epi32(_mm256_mullo_epi32(seeds, powers), 23);
+      const __m256i word_index = _mm256_srli_epi32(bitpos, 5);
+      const __m256i words = _mm256_blendv_epi8(
+          _mm256_permutevar8x32_epi32(lo, word_index),
+          _mm256_permutevar8x32_epi32(hi, word_index),
+          _mm256_cmpgt_epi32(word_index, _mm256_set1_epi32(7)));
+      const __m256i bits = _mm256_sllv_epi32(
+          one, _mm256_and_si256(bitpos, _mm256_set1_epi32(31)));
+      const __m256i in_use = _mm256_cmpgt_epi32(
+          _mm256_set1_epi32(static_cast<int>(k - done)), lane);
+      const __m256i missing =
+          _mm256_and_si256(_mm256_andnot_si256(words, bits), in_use);
+      if (!_mm256_testz_si256(missing, missing)) {
+        return false;
+      }
+      seeds = _mm256_mullo_epi32(
+          seeds, _mm256_set1_epi32(
+                     static_cast<int>(Power(kProbeMultiplier, 8))));
+    }
+    return true;
+  }
+#else
+  static bool LineMayMatch(const char* line, uint32_t seed, size_t k) {
+    uint32_t probe = seed;
+    for (size_t j = 0; j < k; j++) {
+      probe *= kProbeMultiplier;
+      const uint32_t bitpos = probe >> 23;
+      if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    }
+    return true;
+  }
+#endif  // defined(__AVX2__)
+
+  size_t bits_per_key_;
+  size_t k_;
+};
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewCacheLocalBloomFilterPolicy(int bits_per_key) {
+  return new CacheLocalBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
@@ -19,7 +19,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest() : BloomTest(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -106,7 +107,11 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST_F(BloomTest, VaryingLengths) {
+// Check the false positive rate of filters over a range of key counts.
+// Filters may exceed 10 bits per key by "slack" bytes, and only a few
+// filters may have a false positive rate above "good_rate".
+static void CheckVaryingLengths(BloomTest* t, size_t slack, double max_rate,
+                                double good_rate) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -114,30 +119,30 @@ TEST_F(BloomTest, VaryingLengths) {
   int good_filters = 0;
 
   for (int length = 1; length <= 10000; length = NextLength(length)) {
-    Reset();
+    t->Reset();
     for (int i = 0; i < length; i++) {
-      Add(Key(i, buffer));
+      t->Add(Key(i, buffer));
     }
-    Build();
+    t->Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+    ASSERT_LE(t->FilterSize(), static_cast<size_t>(length * 10 / 8) + slack)
         << length;
 
     // All added keys must match
     for (int i = 0; i < length; i++) {
-      ASSERT_TRUE(Matches(Key(i, buffer)))
+      ASSERT_TRUE(t->Matches(Key(i, buffer)))
           << "Length " << length << "; key " << i;
     }
 
     // Check false positive rate
-    double rate = FalsePositiveRate();
+    double rate = t->FalsePositiveRate();
     if (kVerbose >= 1) {
       std::fprintf(stderr,
                    "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
-                   rate * 100.0, length, static_cast<int>(FilterSize()));
+                   rate * 100.0, length, static_cast<int>(t->FilterSize()));
     }
-    ASSERT_LE(rate, 0.02);  // Must not be over 2%
-    if (rate > 0.0125)
+    ASSERT_LE(rate, max_rate);
+    if (rate > good_rate)
       mediocre_filters++;  // Allowed, but not too often
     else
       good_filters++;
@@ -149,6 +154,88 @@ TEST_F(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
-// Different bits-per-byte
+TEST_F(BloomTest, VaryingLengths) {
+  CheckVaryingLengths(this, 40, 0.02, 0.0125);
+}
+
+class CacheLocalBloomTest : public BloomTest {
+ public:
+  CacheLocalBloomTest() : BloomTest(NewCacheLocalBloomFilterPolicy(10)) {}
+};
+
+TEST_F(CacheLocalBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(CacheLocalBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(CacheLocalBloomTest, VaryingLengths) {
+  // Filters are a whole number of 64-byte lines plus the probe count.
+  CheckVaryingLengths(this, 65, 0.025, 0.015);
+}
+
+class BinaryFuseTest : public BloomTest {
+ public:
+  BinaryFuseTest() : BloomTest(NewBinaryFuseFilterPolicy(7)) {}
+};
+
+TEST_F(BinaryFuseTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BinaryFuseTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BinaryFuseTest, DuplicateKeys) {
+  Add("hello");
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+}
+
+TEST_F(BinaryFuseTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Small filters need extra slots to be built reliably, so only large
+    // ones get close to 8 bits per key.
+    const int bits_per_key = length < 1000 ? 16 : length < 10000 ? 11 : 9;
+    ASSERT_LE(FilterSize(), static_cast<size_t>(length * bits_per_key / 8) + 80)
+        << length;
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.0125);
+  }
+}
 
 }  // namespace leveldb
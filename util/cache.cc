@@ -4,6 +4,7 @@
 
 #include "leveldb/cache.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -26,14 +27,18 @@ namespace {
 // entry being passed to its "deleter" are via Erase(), via Insert() when
 // an element with a duplicate key is inserted, or on destruction of the cache.
 //
-// The cache keeps two linked lists of items in the cache.  All items in the
-// cache are in one list or the other, and never both.  Items still referenced
-// by clients but erased from the cache are in neither list.  The lists are:
+// The cache keeps three linked lists of items in the cache.  All items in the
+// cache are in exactly one of them.  Items still referenced by clients but
+// erased from the cache are in none.  The lists are:
 // - in-use:  contains the items currently referenced by clients, in no
 //   particular order.  (This list is used for invariant checking.  If we
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
-// - LRU:  contains the items not currently referenced by clients, in LRU order
+// - LRU:  contains the items not currently referenced by clients, in LRU
+//   order, other than those on the high-priority LRU list
+// - high-priority LRU:  likewise for the items of high priority, if the
+//   cache reserves a share of its capacity for them.  They are evicted only
+//   once the LRU list is empty, unless they take up more than their share.
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
@@ -48,10 +53,11 @@ struct LRUHandle {
   LRUHandle* prev;
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
-  bool in_cache;     // Whether entry is in the cache.
-  uint32_t refs;     // References, including cache reference, if present.
-  uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
-  char key_data[1];  // Beginning of key
+  bool in_cache;       // Whether entry is in the cache.
+  bool high_priority;  // Whether entry was inserted with high priority.
+  uint32_t refs;       // References, including cache reference, if present.
+  uint32_t hash;       // Hash of key(); used for fast sharding and comparisons
+  char key_data[1];    // Beginning of key
 
   Slice key() const {
     // next is only equal to this if the LRU handle is the list head of an
@@ -154,12 +160,20 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, size_t high_pri_capacity,
+                   bool strict_capacity_limit) {
+    capacity_ = capacity;
+    high_pri_capacity_ = high_pri_capacity;
+    strict_capacity_limit_ = strict_capacity_limit;
+  }
 
-  // Like Cache methods, but with an extra "hash" parameter.
+  // Like Cache methods, but with an extra "hash" parameter.  If the entry
+  // does not fit under a strict capacity limit, returns nullptr when
+  // "fail_if_full" is set, and a handle to an uncached entry otherwise.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority, bool fail_if_full);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -168,6 +182,11 @@ class LRUCache {
     MutexLock l(&mutex_);
     return usage_;
   }
+  size_t HighPriorityCharge() const {
+    MutexLock l(&mutex_);
+    return high_pri_usage_;
+  }
+  Cache::ShardStats GetStats() const;
 
  private:
   void LRU_Remove(LRUHandle* e);
@@ -175,19 +194,32 @@ class LRUCache {
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  LRUHandle* NextVictim() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Evicts entries until "charge" more fits, or no entry can be evicted.
+  void EvictFor(size_t charge) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool HasHighPriorityPool() const { return high_pri_capacity_ > 0; }
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;  // Zero disables the high-priority list
+  bool strict_capacity_limit_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);  // Charge of high priority items
+  uint64_t lookups_ GUARDED_BY(mutex_);
+  uint64_t hits_ GUARDED_BY(mutex_);
+  uint64_t failed_inserts_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of the high-priority LRU list, ordered like lru_.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -195,28 +227,40 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_capacity_(0),
+      strict_capacity_limit_(false),
+      usage_(0),
+      high_pri_usage_(0),
+      lookups_(0),
+      hits_(0),
+      failed_inserts_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ lists.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
 void LRUCache::Ref(LRUHandle* e) {
-  if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+  if (e->refs == 1 && e->in_cache) {  // If on an lru_ list, move to in_use_.
     LRU_Remove(e);
     LRU_Append(&in_use_, e);
   }
@@ -231,9 +275,11 @@ void LRUCache::Unref(LRUHandle* e) {
     (*e->deleter)(e->key(), e->value);
     free(e);
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to the lru_ list of its priority.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Append(HasHighPriorityPool() && e->high_priority ? &high_pri_lru_
+                                                         : &lru_,
+               e);
   }
 }
 
@@ -253,7 +299,9 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
+  lookups_++;
   if (e != nullptr) {
+    hits_++;
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -266,10 +314,25 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
-                                void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                void (*deleter)(const Slice& key, void* value),
+                                Cache::Priority priority,
+                                bool fail_if_full) {
   MutexLock l(&mutex_);
 
+  // Under a strict limit, make room first: entries held by clients may
+  // leave too little of it.
+  bool fits = capacity_ > 0;
+  if (strict_capacity_limit_) {
+    EvictFor(charge);
+    fits = fits && usage_ + charge <= capacity_;
+    if (!fits) {
+      failed_inserts_++;
+      if (fail_if_full) {
+        return nullptr;
+      }
+    }
+  }
+
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
   e->value = value;
@@ -278,29 +341,50 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_priority = (priority == Cache::kHighPriority);
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
-  if (capacity_ > 0) {
+  if (fits) {
     e->refs++;  // for the cache's reference.
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (e->high_priority) {
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  EvictFor(0);
+
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void LRUCache::EvictFor(size_t charge) {
+  LRUHandle* old;
+  while (usage_ + charge > capacity_ && (old = NextVictim()) != nullptr) {
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
       assert(erased);
     }
   }
+}
 
-  return reinterpret_cast<Cache::Handle*>(e);
+// Return the oldest entry of low priority, unless entries of high priority
+// take up more than their share, or nullptr if no entry can be evicted.
+LRUHandle* LRUCache::NextVictim() {
+  const bool has_high_pri = high_pri_lru_.next != &high_pri_lru_;
+  if (has_high_pri && high_pri_usage_ > high_pri_capacity_) {
+    return high_pri_lru_.next;
+  }
+  if (lru_.next != &lru_) {
+    return lru_.next;
+  }
+  return has_high_pri ? high_pri_lru_.next : nullptr;
 }
 
 // If e != nullptr, finish removing *e from the cache; it has already been
@@ -311,6 +395,9 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->high_priority) {
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
@@ -323,8 +410,8 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
+  LRUHandle* e;
+  while ((e = NextVictim()) != nullptr) {
     assert(e->refs == 1);
     bool erased = FinishErase(table_.Remove(e->key(), e->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -333,12 +420,28 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+Cache::ShardStats LRUCache::GetStats() const {
+  MutexLock l(&mutex_);
+  Cache::ShardStats stats;
+  stats.capacity = capacity_;
+  stats.usage = usage_;
+  stats.pinned_usage = 0;
+  for (LRUHandle* e = in_use_.next; e != &in_use_; e = e->next) {
+    stats.pinned_usage += e->charge;
+  }
+  stats.lookups = lookups_;
+  stats.hits = hits_;
+  stats.failed_inserts = failed_inserts_;
+  return stats;
+}
+
+static const int kDefaultNumShardBits = 4;
+static const int kMaxNumShardBits = 16;
 
 class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  const int num_shard_bits_;
+  LRUCache* const shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -346,20 +449,50 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t Shard(uint32_t hash) const {
+    // A shift by 32 bits would be undefined.
+    return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
+  }
+
+  int NumShards() const { return 1 << num_shard_bits_; }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  ShardedLRUCache(size_t capacity, int num_shard_bits,
+                  bool strict_capacity_limit, double high_pri_pool_ratio)
+      : num_shard_bits_(std::min(std::max(num_shard_bits, 0),
+                                 kMaxNumShardBits)),
+        shard_(new LRUCache[1 << num_shard_bits_]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (NumShards() - 1)) / NumShards();
+    const size_t high_pri_per_shard = static_cast<size_t>(
+        per_shard * std::min(std::max(high_pri_pool_ratio, 0.0), 1.0));
+    for (int s = 0; s < NumShards(); s++) {
+      shard_[s].SetCapacity(per_shard, high_pri_per_shard,
+                            strict_capacity_limit);
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedLRUCache() override { delete[] shard_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return InsertWithPriority(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority, false);
+  }
+  Status TryInsert(const Slice& key, void* value, size_t charge,
+                   void (*deleter)(const Slice& key, void* value),
+                   Priority priority, Handle** handle) override {
+    const uint32_t hash = HashSlice(key);
+    *handle = shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                         priority, true);
+    if (*handle == nullptr) {
+      return Status::Incomplete("cache is full");
+    }
+    return Status::OK();
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -381,21 +514,47 @@ class ShardedLRUCache : public Cache {
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       shard_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
+  size_t HighPriorityCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < NumShards(); s++) {
+      total += shard_[s].HighPriorityCharge();
+    }
+    return total;
+  }
+  void GetShardStats(std::vector<ShardStats>* stats) const override {
+    stats->clear();
+    for (int s = 0; s < NumShards(); s++) {
+      stats->push_back(shard_[s].GetStats());
+    }
+  }
 };
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                   bool strict_capacity_limit, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, num_shard_bits, strict_capacity_limit,
+                             high_pri_pool_ratio);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                   bool strict_capacity_limit) {
+  return NewLRUCache(capacity, num_shard_bits, strict_capacity_limit, 0.5);
+}
+
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, kDefaultNumShardBits, false);
+}
 
 }  // namespace leveldb
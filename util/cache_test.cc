@@ -4,6 +4,8 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -54,6 +56,12 @@ class CacheTest : public testing::Test {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->InsertWithPriority(
+        EncodeKey(key), EncodeValue(value), charge, &CacheTest::Deleter,
+        Cache::kHighPriority));
+  }
+
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
                           &CacheTest::Deleter);
@@ -150,6 +158,50 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
+TEST_F(CacheTest, HighPriorityEvictedLast) {
+  for (int i = 0; i < 10; i++) {
+    InsertHighPriority(i, 100 + i);
+  }
+  ASSERT_EQ(10, cache_->HighPriorityCharge());
+
+  // Entries of low priority make room for each other first.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(100 + i, Lookup(i));
+  }
+  ASSERT_EQ(10, cache_->HighPriorityCharge());
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + 16);  // Shards round up
+}
+
+TEST_F(CacheTest, HighPriorityPoolLimit) {
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    InsertHighPriority(i, 100 + i);
+  }
+  // With nothing else in the cache, high priority entries may fill it.
+  ASSERT_GT(cache_->HighPriorityCharge(), kCacheSize / 2);
+
+  // Beyond their half of the capacity they are evicted first.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 2000 + i);
+  }
+  ASSERT_LE(cache_->HighPriorityCharge(), kCacheSize / 2 + 16);
+}
+
+TEST_F(CacheTest, PrioritiesIgnoredWithoutPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 4, false, 0.0);
+
+  InsertHighPriority(1, 100);
+  ASSERT_EQ(1, cache_->HighPriorityCharge());
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(0, cache_->HighPriorityCharge());
+}
+
 TEST_F(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
@@ -221,4 +273,272 @@ TEST_F(CacheTest, ZeroSizeCache) {
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_F(CacheTest, StrictCapacityLimit) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, true);
+
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < kCacheSize; i++) {
+    h.push_back(InsertAndReturnHandle(i, 1000 + i));
+  }
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->TotalCharge());
+
+  // Every entry is pinned, so there is no room left.
+  Cache::Handle* handle;
+  Status s = cache_->TryInsert(EncodeKey(kCacheSize), EncodeValue(1), 1,
+                               &CacheTest::Deleter, Cache::kLowPriority,
+                               &handle);
+  ASSERT_TRUE(s.IsIncomplete());
+  ASSERT_EQ(0, deleted_keys_.size());  // The caller keeps the value
+
+  // A plain insert hands back an entry that is not cached.
+  handle = InsertAndReturnHandle(kCacheSize, 2000);
+  ASSERT_EQ(2000, DecodeValue(cache_->Value(handle)));
+  ASSERT_EQ(-1, Lookup(kCacheSize));
+  cache_->Release(handle);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->TotalCharge());
+
+  // Released entries can be evicted again.
+  cache_->Release(h[0]);
+  s = cache_->TryInsert(EncodeKey(kCacheSize), EncodeValue(3000), 1,
+                        &CacheTest::Deleter, Cache::kLowPriority, &handle);
+  ASSERT_TRUE(s.ok());
+  cache_->Release(handle);
+  ASSERT_EQ(3000, Lookup(kCacheSize));
+  ASSERT_EQ(-1, Lookup(0));
+  ASSERT_EQ(static_cast<size_t>(kCacheSize), cache_->TotalCharge());
+
+  for (size_t i = 1; i < h.size(); i++) {
+    cache_->Release(h[i]);
+  }
+}
+
+TEST_F(CacheTest, ShardStats) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 2, true);
+
+  std::vector<Cache::ShardStats> stats;
+  cache_->GetShardStats(&stats);
+  ASSERT_EQ(4, stats.size());
+  for (const Cache::ShardStats& shard : stats) {
+    ASSERT_EQ(static_cast<size_t>(kCacheSize / 4), shard.capacity);
+  }
+
+  Insert(1, 100, 10);
+  Cache::Handle* handle = InsertAndReturnHandle(2, 200, 20);
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(3));
+  Cache::Handle* too_big;
+  ASSERT_TRUE(!cache_
+                   ->TryInsert(EncodeKey(4), EncodeValue(400), kCacheSize,
+                               &CacheTest::Deleter, Cache::kLowPriority,
+                               &too_big)
+                   .ok());
+
+  cache_->GetShardStats(&stats);
+  Cache::ShardStats total = {0, 0, 0, 0, 0, 0};
+  for (const Cache::ShardStats& shard : stats) {
+    total.usage += shard.usage;
+    total.pinned_usage += shard.pinned_usage;
+    total.lookups += shard.lookups;
+    total.hits += shard.hits;
+    total.failed_inserts += shard.failed_inserts;
+  }
+  ASSERT_EQ(30, total.usage);
+  ASSERT_EQ(20, total.pinned_usage);
+  ASSERT_EQ(2, total.lookups);
+  ASSERT_EQ(1, total.hits);
+  ASSERT_EQ(1, total.failed_inserts);
+  cache_->Release(handle);
+}
+
+TEST_F(CacheTest, SingleShard) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, false);
+
+  // With one shard, eviction follows the global LRU order.
+  for (int i = 0; i < kCacheSize + 10; i++) {
+    Insert(i, 1000 + i);
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(-1, Lookup(i));
+  }
+  for (int i = 10; i < kCacheSize + 10; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+}
+
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 1);
+  }
+};
+
+TEST_F(ClockCacheTest, HitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+  Insert(100, 101);
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(-1, Lookup(300));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+  ASSERT_EQ(2, cache_->TotalCharge());
+}
+
+TEST_F(ClockCacheTest, EntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(0, cache_->TotalCharge());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST_F(ClockCacheTest, FrequentlyUsedEntriesSurvive) {
+  Insert(100, 101);
+  Insert(200, 201);
+  Cache::Handle* h = InsertAndReturnHandle(300, 301);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(301, Lookup(300));
+  cache_->Release(h);
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + 16);  // Shards round up
+}
+
+TEST_F(ClockCacheTest, HeavyEntries) {
+  int index = 0;
+  for (int added = 0; added < 2 * kCacheSize; index++) {
+    const int weight = (index & 1) ? 1 : 10;
+    Insert(index, 1000 + index, weight);
+    added += weight;
+  }
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += (i & 1) ? 1 : 10;
+      ASSERT_EQ(1000 + i, r);
+    }
+  }
+  ASSERT_GT(cached_weight, kCacheSize / 2);
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+}
+
+TEST_F(ClockCacheTest, HighPriorityCharge) {
+  InsertHighPriority(1, 100, 5);
+  Insert(2, 200, 3);
+  ASSERT_EQ(5, cache_->HighPriorityCharge());
+  ASSERT_EQ(8, cache_->TotalCharge());
+  Erase(1);
+  ASSERT_EQ(0, cache_->HighPriorityCharge());
+}
+
+TEST_F(ClockCacheTest, Prune) {
+  Insert(1, 100);
+  Insert(2, 200);
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+}
+
+TEST_F(ClockCacheTest, ZeroSizeCache) {
+  delete cache_;
+  cache_ = NewClockCache(0);
+
+  Cache::Handle* handle = InsertAndReturnHandle(1, 100);
+  ASSERT_EQ(100, DecodeValue(cache_->Value(handle)));
+  ASSERT_EQ(-1, Lookup(1));
+  cache_->Release(handle);
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST_F(ClockCacheTest, LongKeys) {
+  const std::string key(100, 'k');
+  cache_->Release(
+      cache_->Insert(key, EncodeValue(7), 1, [](const Slice& k, void* v) {}));
+  Cache::Handle* handle = cache_->Lookup(key);
+  ASSERT_TRUE(handle != nullptr);
+  ASSERT_EQ(7, DecodeValue(cache_->Value(handle)));
+  cache_->Release(handle);
+  ASSERT_TRUE(cache_->Lookup(std::string(99, 'k')) == nullptr);
+}
+
+static std::atomic<int> concurrent_deletions(0);
+
+static void ConcurrentDeleter(const Slice& key, void* v) {
+  ASSERT_EQ(DecodeKey(key), DecodeValue(v) / 10);
+  concurrent_deletions.fetch_add(1);
+}
+
+TEST(ClockCacheConcurrencyTest, ConcurrentUse) {
+  const int kKeys = 500;
+  const int kThreads = 8;
+  Cache* cache = NewClockCache(kKeys / 2, 1);
+  std::atomic<int> insertions(0);
+  concurrent_deletions.store(0);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([cache, t, &insertions]() {
+      uint32_t rnd = 301 + t;
+      for (int i = 0; i < 20000; i++) {
+        rnd = rnd * 1103515245 + 12345;
+        const int key = (rnd >> 8) % kKeys;
+        const std::string encoded = EncodeKey(key);
+        Cache::Handle* h = cache->Lookup(encoded);
+        if (h != nullptr) {
+          ASSERT_EQ(key, DecodeValue(cache->Value(h)) / 10);
+        } else {
+          h = cache->Insert(encoded, EncodeValue(key * 10 + t % 10), 1,
+                            &ConcurrentDeleter);
+          insertions.fetch_add(1);
+        }
+        if (i % 97 == 0) {
+          cache->Erase(encoded);
+        }
+        cache->Release(h);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(cache->TotalCharge(), kKeys / 2 + 16);
+  delete cache;
+  ASSERT_EQ(insertions.load(), concurrent_deletions.load());
+}
+
 }  // namespace leveldb
@@ -0,0 +1,457 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard is an open addressing hash table of fixed size.  Its slots
+// are never freed, so lookups can probe it without taking a lock.  The
+// state of a slot and the number of references to it share one atomic
+// word, "meta".  The states are:
+// - empty: the slot holds no entry.
+// - construction: one thread owns the slot, to fill it in or to tear its
+//   entry down.  Only a thread that finds the slot unreferenced may move
+//   it into this state.
+// - visible: the slot holds an entry that lookups may return.
+// - invisible: the entry was erased or replaced but is still referenced.
+//   The thread that drops the last reference tears it down.
+// A lookup takes a reference on a slot before it looks at the entry, and
+// drops it again if the slot turns out not to hold the entry it wants, so
+// slots in any state may briefly have references.  State changes are
+// therefore made by adding to meta, or by compare-and-swap from a state
+// without references.
+//
+// Eviction follows the CLOCK algorithm: a hand sweeps over the slots and
+// evicts unreferenced entries whose countdown is zero, after decrementing
+// the countdown of the others.  Hits and high priority inserts raise the
+// countdown, so entries that are used again survive more sweeps.
+//
+// Entries that do not find a free slot on their probe sequence are not
+// cached: the caller gets a handle of its own ("detached"), which is
+// deleted on release.
+
+static const uint64_t kRefMask = (uint64_t{1} << 32) - 1;
+static const uint64_t kStateMask = uint64_t{3} << 62;
+static const uint64_t kStateEmpty = 0;
+static const uint64_t kStateConstruction = uint64_t{1} << 62;
+static const uint64_t kStateInvisible = uint64_t{2} << 62;
+static const uint64_t kStateVisible = uint64_t{3} << 62;
+
+static const uint8_t kMaxCountdown = 3;
+
+struct ClockHandle {
+  std::atomic<uint64_t> meta{kStateEmpty};
+  // Number of entries whose probe sequence passes over this slot.  A probe
+  // for a key can stop at a slot that no entry was displaced past.
+  std::atomic<uint32_t> displacements{0};
+  std::atomic<uint32_t> hash{0};  // Read without a reference as a hint
+  std::atomic<uint8_t> countdown{0};
+
+  // Set in the construction state, and read while holding a reference.
+  bool high_priority;
+  bool detached;
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  size_t key_length;
+  char* key_data;  // Points to key_buffer for short keys
+  char key_buffer[16];
+
+  Slice key() const { return Slice(key_data, key_length); }
+
+  void SetKey(const Slice& key) {
+    key_length = key.size();
+    key_data = key.size() <= sizeof(key_buffer) ? key_buffer
+                                                : new char[key.size()];
+    std::memcpy(key_data, key.data(), key.size());
+  }
+
+  void FreeKey() {
+    if (key_data != key_buffer) {
+      delete[] key_data;
+    }
+  }
+};
+
+class ClockCacheShard {
+ public:
+  ClockCacheShard();
+  ~ClockCacheShard();
+
+  ClockCacheShard(const ClockCacheShard&) = delete;
+  ClockCacheShard& operator=(const ClockCacheShard&) = delete;
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCacheShard.  The table gets room for about capacity /
+  // estimated_entry_charge entries.
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge);
+
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+  size_t HighPriorityCharge() const {
+    return high_pri_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  size_t Home(uint32_t hash) const { return hash & mask_; }
+
+  // Takes a reference on the slot if it holds a visible entry for key.
+  bool RefIfMatch(ClockHandle* h, const Slice& key, uint32_t hash);
+  void Unref(ClockHandle* h);
+
+  // Moves a visible entry to the invisible state.
+  void MakeInvisible(ClockHandle* h);
+
+  // Evicts the slot's entry if it is visible and unreferenced.
+  bool EvictIfUnused(ClockHandle* h);
+
+  // Calls the deleter of the entry in the construction state and empties
+  // the slot.
+  void FreeEntry(ClockHandle* h);
+
+  void EvictFor(size_t charge);
+
+  size_t capacity_;
+  size_t num_slots_;
+  size_t mask_;
+  size_t max_occupancy_;
+  ClockHandle* slots_;
+
+  std::atomic<size_t> usage_;
+  std::atomic<size_t> high_pri_usage_;
+  std::atomic<size_t> occupancy_;  // Number of non-empty slots
+  std::atomic<size_t> clock_hand_;
+};
+
+ClockCacheShard::ClockCacheShard()
+    : capacity_(0),
+      num_slots_(0),
+      mask_(0),
+      max_occupancy_(0),
+      slots_(nullptr),
+      usage_(0),
+      high_pri_usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    assert((meta & kRefMask) == 0);  // Error if caller has an unreleased handle
+    if (meta == kStateVisible) {
+      (*h->deleter)(h->key(), h->value);
+      h->FreeKey();
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCacheShard::SetCapacity(size_t capacity,
+                                  size_t estimated_entry_charge) {
+  capacity_ = capacity;
+  const size_t entries =
+      capacity / (estimated_entry_charge > 0 ? estimated_entry_charge : 1);
+  // Keep the table at most 3/4 full when it holds the expected entries.
+  num_slots_ = 16;
+  while (num_slots_ * 3 / 4 < entries * 3 / 2) {
+    num_slots_ *= 2;
+  }
+  mask_ = num_slots_ - 1;
+  max_occupancy_ = num_slots_ * 3 / 4;
+  slots_ = new ClockHandle[num_slots_];
+}
+
+bool ClockCacheShard::RefIfMatch(ClockHandle* h, const Slice& key,
+                                 uint32_t hash) {
+  if ((h->meta.load(std::memory_order_relaxed) & kStateMask) !=
+          kStateVisible ||
+      h->hash.load(std::memory_order_relaxed) != hash) {
+    return false;
+  }
+  const uint64_t old = h->meta.fetch_add(1, std::memory_order_acquire);
+  if ((old & kStateMask) == kStateVisible && h->key() == key) {
+    return true;
+  }
+  Unref(h);
+  return false;
+}
+
+void ClockCacheShard::Unref(ClockHandle* h) {
+  const uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert((old & kRefMask) > 0);
+  if ((old & kRefMask) == 1 && (old & kStateMask) == kStateInvisible) {
+    // Last reference to an erased entry.  Lookups may have taken a
+    // reference in the meantime; the last of them frees the entry then.
+    uint64_t expected = kStateInvisible;
+    if (h->meta.compare_exchange_strong(expected, kStateConstruction,
+                                        std::memory_order_acq_rel)) {
+      FreeEntry(h);
+    }
+  }
+}
+
+void ClockCacheShard::MakeInvisible(ClockHandle* h) {
+  uint64_t meta = h->meta.load(std::memory_order_relaxed);
+  while ((meta & kStateMask) == kStateVisible) {
+    if (h->meta.compare_exchange_weak(meta,
+                                      meta - kStateVisible + kStateInvisible,
+                                      std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      if (h->high_priority) {
+        high_pri_usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      }
+      return;
+    }
+  }
+}
+
+bool ClockCacheShard::EvictIfUnused(ClockHandle* h) {
+  uint64_t expected = kStateVisible;
+  if (!h->meta.compare_exchange_strong(expected, kStateConstruction,
+                                       std::memory_order_acq_rel)) {
+    return false;
+  }
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  if (h->high_priority) {
+    high_pri_usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  }
+  FreeEntry(h);
+  return true;
+}
+
+void ClockCacheShard::FreeEntry(ClockHandle* h) {
+  (*h->deleter)(h->key(), h->value);
+  h->FreeKey();
+  if (h->detached) {
+    delete h;
+    return;
+  }
+  // Undo the displacements made when the entry was inserted.
+  const uint32_t hash = h->hash.load(std::memory_order_relaxed);
+  for (size_t i = Home(hash); &slots_[i] != h; i = (i + 1) & mask_) {
+    slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  // Keeps the references that lookups may have taken meanwhile.
+  h->meta.fetch_sub(kStateConstruction, std::memory_order_release);
+}
+
+void ClockCacheShard::EvictFor(size_t charge) {
+  // Each entry needs at most kMaxCountdown + 1 visits to be evicted.
+  size_t steps = (kMaxCountdown + 1) * num_slots_;
+  while ((usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+          occupancy_.load(std::memory_order_relaxed) >= max_occupancy_) &&
+         steps-- > 0) {
+    ClockHandle* h =
+        &slots_[clock_hand_.fetch_add(1, std::memory_order_relaxed) & mask_];
+    if (h->meta.load(std::memory_order_relaxed) != kStateVisible) {
+      continue;  // Empty, busy or referenced
+    }
+    const uint8_t countdown = h->countdown.load(std::memory_order_relaxed);
+    if (countdown > 0) {
+      h->countdown.store(countdown - 1, std::memory_order_relaxed);
+    } else {
+      EvictIfUnused(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCacheShard::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value), Cache::Priority priority) {
+  if (capacity_ > 0) {
+    Erase(key, hash);
+    EvictFor(charge);
+
+    for (size_t probes = 0, i = Home(hash); probes < num_slots_;
+         probes++, i = (i + 1) & mask_) {
+      ClockHandle* h = &slots_[i];
+      uint64_t expected = kStateEmpty;
+      if (h->meta.compare_exchange_strong(expected, kStateConstruction,
+                                          std::memory_order_acquire)) {
+        occupancy_.fetch_add(1, std::memory_order_relaxed);
+        h->high_priority = (priority == Cache::kHighPriority);
+        h->detached = false;
+        h->value = value;
+        h->deleter = deleter;
+        h->charge = charge;
+        h->SetKey(key);
+        h->hash.store(hash, std::memory_order_relaxed);
+        h->countdown.store(h->high_priority ? kMaxCountdown : 1,
+                           std::memory_order_relaxed);
+        usage_.fetch_add(charge, std::memory_order_relaxed);
+        if (h->high_priority) {
+          high_pri_usage_.fetch_add(charge, std::memory_order_relaxed);
+        }
+        // Publish the entry with a reference for the caller.
+        h->meta.fetch_add(kStateVisible - kStateConstruction + 1,
+                          std::memory_order_release);
+        return reinterpret_cast<Cache::Handle*>(h);
+      }
+      h->displacements.fetch_add(1, std::memory_order_relaxed);
+    }
+    // No free slot: undo the displacements.
+    for (size_t probes = 0, i = Home(hash); probes < num_slots_;
+         probes++, i = (i + 1) & mask_) {
+      slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Not cached: the caller gets the only reference.
+  ClockHandle* h = new ClockHandle;
+  h->meta.store(kStateInvisible + 1, std::memory_order_relaxed);
+  h->hash.store(hash, std::memory_order_relaxed);
+  h->high_priority = false;
+  h->detached = true;
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->SetKey(key);
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  for (size_t probes = 0, i = Home(hash); probes < num_slots_;
+       probes++, i = (i + 1) & mask_) {
+    ClockHandle* h = &slots_[i];
+    if (RefIfMatch(h, key, hash)) {
+      const uint8_t countdown = h->countdown.load(std::memory_order_relaxed);
+      if (countdown < kMaxCountdown) {
+        h->countdown.store(countdown + 1, std::memory_order_relaxed);
+      }
+      return reinterpret_cast<Cache::Handle*>(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  // Concurrent inserts of one key may have left several entries for it.
+  for (size_t probes = 0, i = Home(hash); probes < num_slots_;
+       probes++, i = (i + 1) & mask_) {
+    ClockHandle* h = &slots_[i];
+    if (RefIfMatch(h, key, hash)) {
+      MakeInvisible(h);
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+}
+
+void ClockCacheShard::Prune() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    EvictIfUnused(&slots_[i]);
+  }
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCacheShard shard_[kNumShards];
+  std::atomic<uint64_t> last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge)
+      : last_id_(0) {
+    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].SetCapacity(per_shard, estimated_entry_charge);
+    }
+  }
+  ~ShardedClockCache() override {}
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return InsertWithPriority(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shard_[Shard(h->hash.load(std::memory_order_relaxed))].Release(handle);
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  void Prune() override {
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
+  size_t HighPriorityCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].HighPriorityCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+Cache* NewClockCache(size_t capacity) { return NewClockCache(capacity, 4096); }
+
+}  // namespace leveldb
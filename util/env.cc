@@ -22,16 +22,53 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+Status Env::LinkFile(const std::string& src, const std::string& target) {
+  return Status::NotSupported("LinkFile", src);
+}
+
+void Env::ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                               Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+Status RandomAccessFile::Prefetch(uint64_t offset, size_t n) const {
+  return Status::OK();
+}
+
+Status RandomAccessFile::MultiRead(ReadRequest* requests, size_t num) const {
+  Status result;
+  for (size_t i = 0; i < num; i++) {
+    ReadRequest* r = &requests[i];
+    r->status = Read(r->offset, r->n, &r->result, r->scratch);
+    if (result.ok()) {
+      result = r->status;
+    }
+  }
+  return result;
+}
+
 WritableFile::~WritableFile() = default;
 
 Logger::~Logger() = default;
@@ -27,6 +27,7 @@
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
@@ -36,6 +37,12 @@
 #include "util/env_posix_test_helper.h"
 #include "util/posix_logger.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -56,6 +63,17 @@ constexpr const int kOpenBaseFlags = O_CLOEXEC;
 constexpr const int kOpenBaseFlags = 0;
 #endif  // defined(HAVE_O_CLOEXEC)
 
+#if defined(O_DIRECT)
+constexpr const int kDirectIOFlag = O_DIRECT;
+#else
+constexpr const int kDirectIOFlag = 0;  // Direct I/O is not supported.
+#endif  // defined(O_DIRECT)
+
+// Direct I/O transfers must start at and cover whole blocks of the device,
+// and use memory aligned the same way.  No common device has blocks larger
+// than 4KB.
+constexpr const size_t kDirectIOAlignment = 4096;
+
 constexpr const size_t kWritableFileBufferSize = 65536;
 
 Status PosixError(const std::string& context, int error_number) {
@@ -66,6 +84,56 @@ Status PosixError(const std::string& context, int error_number) {
   }
 }
 
+// Returns a buffer of |size| bytes that is aligned for direct I/O, or nullptr
+// if there is no memory for it.  The buffer must be released with free().
+char* NewAlignedBuffer(size_t size) {
+  void* buffer;
+  if (::posix_memalign(&buffer, kDirectIOAlignment, size) != 0) {
+    return nullptr;
+  }
+  return static_cast<char*>(buffer);
+}
+
+// Turns off direct I/O for |fd|, for file systems that accept O_DIRECT when
+// a file is opened but refuse the transfers.  Returns false if it was not
+// on, or cannot be turned off.
+bool DisableDirectIO(int fd) {
+  const int flags = ::fcntl(fd, F_GETFL);
+  if (kDirectIOFlag == 0 || flags < 0 || (flags & kDirectIOFlag) == 0) {
+    return false;
+  }
+  return ::fcntl(fd, F_SETFL, flags & ~kDirectIOFlag) == 0;
+}
+
+// Ensures that all the caches associated with the given file descriptor's
+// data are flushed all the way to durable media, and can withstand power
+// failures.
+//
+// The path argument is only used to populate the description string in the
+// returned Status if an error occurs.
+Status SyncFd(int fd, const std::string& fd_path) {
+#if HAVE_FULLFSYNC
+  // On macOS and iOS, fsync() doesn't guarantee durability past power
+  // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
+  // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
+  // fsync().
+  if (::fcntl(fd, F_FULLFSYNC) == 0) {
+    return Status::OK();
+  }
+#endif  // HAVE_FULLFSYNC
+
+#if HAVE_FDATASYNC
+  bool sync_success = ::fdatasync(fd) == 0;
+#else
+  bool sync_success = ::fsync(fd) == 0;
+#endif  // HAVE_FDATASYNC
+
+  if (sync_success) {
+    return Status::OK();
+  }
+  return PosixError(fd_path, errno);
+}
+
 // Helper class to limit resource usage to avoid exhaustion.
 // Currently used to limit read-only file descriptors and mmap file usage
 // so that we do not run out of file descriptors or virtual memory, or run into
@@ -168,8 +236,233 @@ class PosixSequentialFile final : public SequentialFile {
   const std::string filename_;
 };
 
+#if HAVE_IO_URING
+// Makes batches of reads through an io_uring instance, which lets the
+// device work on all of them at once.  Uses the system calls directly,
+// so that leveldb does not depend on liburing.
+//
+// Each thread has its own instance; see ForCurrentThread().
+class IoUring {
+ public:
+  IoUring()
+      : initialized_(false),
+        usable_(false),
+        ring_fd_(-1),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)) {}
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sq_ring_ != MAP_FAILED) ::munmap(sq_ring_, sq_ring_size_);
+    if (cq_ring_ != MAP_FAILED) ::munmap(cq_ring_, cq_ring_size_);
+    if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqes_size_);
+    if (ring_fd_ >= 0) ::close(ring_fd_);
+  }
+
+  // Returns the instance of the calling thread, or nullptr if the kernel
+  // does not support io_uring.
+  static IoUring* ForCurrentThread() {
+    static thread_local IoUring ring;
+    if (!ring.initialized_) {
+      ring.initialized_ = true;
+      ring.usable_ = ring.Init();
+    }
+    return ring.usable_ ? &ring : nullptr;
+  }
+
+  // Makes the reads of RandomAccessFile::MultiRead() from "fd".
+  Status Read(int fd, const std::string& filename,
+              RandomAccessFile::ReadRequest* requests, size_t num);
+
+ private:
+  static const unsigned kQueueDepth = 32;
+
+  // Sets up the ring.  Returns false if the kernel does not support it.
+  bool Init();
+
+  // Adds a read into "iov" from "offset" of "fd" to the submission queue.
+  void Queue(int fd, struct iovec* iov, uint64_t offset, uint64_t user_data);
+
+  bool initialized_;
+  bool usable_;
+  int ring_fd_;
+  unsigned sq_entries_;
+
+  // The memory shared with the kernel.
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  // Fields of the submission and completion queues.
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+};
+
+bool IoUring::Init() {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ring_fd_ = ::syscall(__NR_io_uring_setup, kQueueDepth, &params);
+  if (ring_fd_ < 0) {
+    return false;
+  }
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+  sqes_ = static_cast<struct io_uring_sqe*>(
+      ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+  if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+      sqes_ == MAP_FAILED) {
+    return false;
+  }
+
+  char* sq = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  sq_entries_ = params.sq_entries;
+  return true;
+}
+
+void IoUring::Queue(int fd, struct iovec* iov, uint64_t offset,
+                    uint64_t user_data) {
+  // Only this thread writes the tail.
+  const unsigned tail = *sq_tail_;
+  const unsigned index = tail & sq_mask_;
+  struct io_uring_sqe* sqe = &sqes_[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(iov);
+  sqe->len = 1;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+}
+
+Status IoUring::Read(int fd, const std::string& filename,
+                     RandomAccessFile::ReadRequest* requests, size_t num) {
+  // The part of each request's buffer that is still to be filled.
+  std::vector<struct iovec> iovs(num);
+  std::vector<size_t> pending;    // Requests to queue, the last one first
+  std::vector<size_t> fallbacks;  // Requests to make with pread()
+  for (size_t i = num; i-- > 0;) {
+    requests[i].status = Status::OK();
+    iovs[i].iov_base = requests[i].scratch;
+    iovs[i].iov_len = requests[i].n;
+    pending.push_back(i);
+  }
+
+  unsigned in_flight = 0;  // Queued or submitted, and not completed
+  while (!pending.empty() || in_flight > 0) {
+    while (!pending.empty() && in_flight < sq_entries_) {
+      const size_t i = pending.back();
+      pending.pop_back();
+      if (!usable_) {
+        fallbacks.push_back(i);
+        continue;
+      }
+      Queue(fd, &iovs[i],
+            requests[i].offset + (requests[i].n - iovs[i].iov_len), i);
+      in_flight++;
+    }
+    if (in_flight == 0) {
+      break;
+    }
+
+    const unsigned unsubmitted =
+        *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (::syscall(__NR_io_uring_enter, ring_fd_, unsubmitted, 1,
+                  IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+        errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      // Take back the reads that the kernel did not accept and make them
+      // with pread().  The kernel owns the buffers of the submitted ones
+      // until they complete, so those are still waited for.
+      const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      for (unsigned t = head; t != *sq_tail_; t++) {
+        fallbacks.push_back(sqes_[sq_array_[t & sq_mask_]].user_data);
+      }
+      in_flight -= *sq_tail_ - head;
+      __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+      fallbacks.insert(fallbacks.end(), pending.begin(), pending.end());
+      pending.clear();
+      usable_ = false;
+    }
+
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const struct io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+      const size_t i = cqe->user_data;
+      const int result = cqe->res;
+      in_flight--;
+      if (result == -EINTR || result == -EAGAIN) {
+        pending.push_back(i);
+      } else if (result < 0) {
+        requests[i].status = PosixError(filename, -result);
+      } else {
+        iovs[i].iov_base = static_cast<char*>(iovs[i].iov_base) + result;
+        iovs[i].iov_len -= result;
+        if (result > 0 && iovs[i].iov_len > 0) {
+          pending.push_back(i);  // A short read before the end of the file
+        }
+      }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  for (size_t i : fallbacks) {
+    const ssize_t result =
+        ::pread(fd, iovs[i].iov_base, iovs[i].iov_len,
+                requests[i].offset + (requests[i].n - iovs[i].iov_len));
+    if (result < 0) {
+      requests[i].status = PosixError(filename, errno);
+    } else {
+      iovs[i].iov_len -= result;
+    }
+  }
+
+  Status status;
+  for (size_t i = 0; i < num; i++) {
+    RandomAccessFile::ReadRequest* r = &requests[i];
+    r->result = Slice(r->scratch, r->status.ok() ? r->n - iovs[i].iov_len : 0);
+    if (status.ok()) {
+      status = r->status;
+    }
+  }
+  return status;
+}
+#endif  // HAVE_IO_URING
+
 // Implements random read access in a file using pread().
 //
+// With |direct_io|, the file is read with O_DIRECT, through aligned buffers
+// that cover the requested ranges.
+//
 // Instances of this class are thread-safe, as required by the RandomAccessFile
 // API. Instances are immutable and Read() only calls thread-safe library
 // functions.
@@ -177,8 +470,10 @@ class PosixRandomAccessFile final : public RandomAccessFile {
  public:
   // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
   // instance, and will be used to determine if .
-  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter)
+  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                        bool direct_io = false)
       : has_permanent_fd_(fd_limiter->Acquire()),
+        direct_io_(direct_io),
         fd_(has_permanent_fd_ ? fd : -1),
         fd_limiter_(fd_limiter),
         filename_(std::move(filename)) {
@@ -200,7 +495,8 @@ class PosixRandomAccessFile final : public RandomAccessFile {
               char* scratch) const override {
     int fd = fd_;
     if (!has_permanent_fd_) {
-      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      fd = ::open(filename_.c_str(),
+                  O_RDONLY | kOpenBaseFlags | (direct_io_ ? kDirectIOFlag : 0));
       if (fd < 0) {
         return PosixError(filename_, errno);
       }
@@ -209,11 +505,15 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     assert(fd != -1);
 
     Status status;
-    ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
-    *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
-    if (read_size < 0) {
-      // An error: return a non-ok status.
-      status = PosixError(filename_, errno);
+    if (direct_io_) {
+      status = ReadDirect(fd, offset, n, result, scratch);
+    } else {
+      ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
+      *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
+      if (read_size < 0) {
+        // An error: return a non-ok status.
+        status = PosixError(filename_, errno);
+      }
     }
     if (!has_permanent_fd_) {
       // Close the temporary file descriptor opened earlier.
@@ -223,8 +523,77 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+#if HAVE_IO_URING
+  Status MultiRead(ReadRequest* requests, size_t num) const override {
+    IoUring* ring;
+    if (has_permanent_fd_ && !direct_io_ && num > 1 &&
+        (ring = IoUring::ForCurrentThread()) != nullptr) {
+      return ring->Read(fd_, filename_, requests, num);
+    }
+    return RandomAccessFile::MultiRead(requests, num);
+  }
+#endif  // HAVE_IO_URING
+
+  Status Prefetch(uint64_t offset, size_t n) const override {
+#if HAVE_POSIX_FADVISE
+    // Without a permanent fd, the advice is not worth opening the file.  Direct
+    // reads do not use the page cache that the advice would fill.
+    if (has_permanent_fd_ && !direct_io_) {
+      int error = ::posix_fadvise(fd_, static_cast<off_t>(offset),
+                                  static_cast<off_t>(n), POSIX_FADV_WILLNEED);
+      if (error != 0) {
+        return PosixError(filename_, error);
+      }
+    }
+#endif  // HAVE_POSIX_FADVISE
+    return Status::OK();
+  }
+
  private:
+  // Reads like pread() into |scratch|, through an aligned buffer that
+  // covers the whole blocks that hold |offset|...|offset|+|n|-1.
+  Status ReadDirect(int fd, uint64_t offset, size_t n, Slice* result,
+                    char* scratch) const {
+    *result = Slice(scratch, 0);
+    const uint64_t start = offset - offset % kDirectIOAlignment;
+    const uint64_t end = offset + n;
+    const size_t size =
+        (end - start + kDirectIOAlignment - 1) / kDirectIOAlignment *
+        kDirectIOAlignment;
+    char* buffer = NewAlignedBuffer(size);
+    if (buffer == nullptr) {
+      return PosixError(filename_, ENOMEM);
+    }
+
+    Status status;
+    size_t filled = 0;
+    // A read that ends off a block boundary has reached the end of the file.
+    while (filled < size && filled % kDirectIOAlignment == 0) {
+      ssize_t read_size = ::pread(fd, buffer + filled, size - filled,
+                                  static_cast<off_t>(start + filled));
+      if (read_size < 0) {
+        if (errno == EINTR || (errno == EINVAL && DisableDirectIO(fd))) {
+          continue;  // Retry
+        }
+        status = PosixError(filename_, errno);
+        break;
+      }
+      if (read_size == 0) {
+        break;  // End of file
+      }
+      filled += read_size;
+    }
+    if (status.ok() && filled > offset - start) {
+      const size_t read_size = std::min<size_t>(n, filled - (offset - start));
+      std::memcpy(scratch, buffer + (offset - start), read_size);
+      *result = Slice(scratch, read_size);
+    }
+    std::free(buffer);
+    return status;
+  }
+
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
+  const bool direct_io_;         // If true, the file is read with O_DIRECT.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
   const std::string filename_;
@@ -267,6 +636,24 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  Status Prefetch(uint64_t offset, size_t n) const override {
+#if defined(POSIX_MADV_WILLNEED)
+    if (offset >= length_) {
+      return Status::OK();
+    }
+    n = std::min<uint64_t>(n, length_ - offset);
+    // The advice must start at a page boundary.
+    static const size_t kPageSize = ::sysconf(_SC_PAGESIZE);
+    const size_t start = offset - offset % kPageSize;
+    int error = ::posix_madvise(mmap_base_ + start, offset + n - start,
+                                POSIX_MADV_WILLNEED);
+    if (error != 0) {
+      return PosixError(filename_, error);
+    }
+#endif  // defined(POSIX_MADV_WILLNEED)
+    return Status::OK();
+  }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -388,35 +775,6 @@ class PosixWritableFile final : public WritableFile {
     return status;
   }
 
-  // Ensures that all the caches associated with the given file descriptor's
-  // data are flushed all the way to durable media, and can withstand power
-  // failures.
-  //
-  // The path argument is only used to populate the description string in the
-  // returned Status if an error occurs.
-  static Status SyncFd(int fd, const std::string& fd_path) {
-#if HAVE_FULLFSYNC
-    // On macOS and iOS, fsync() doesn't guarantee durability past power
-    // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
-    // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
-    // fsync().
-    if (::fcntl(fd, F_FULLFSYNC) == 0) {
-      return Status::OK();
-    }
-#endif  // HAVE_FULLFSYNC
-
-#if HAVE_FDATASYNC
-    bool sync_success = ::fdatasync(fd) == 0;
-#else
-    bool sync_success = ::fsync(fd) == 0;
-#endif  // HAVE_FDATASYNC
-
-    if (sync_success) {
-      return Status::OK();
-    }
-    return PosixError(fd_path, errno);
-  }
-
   // Returns the directory name in a path pointing to a file.
   //
   // Returns "." if the path does not contain any directory separator.
@@ -464,6 +822,133 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+// Implements sequential writes to a file opened with O_DIRECT.
+//
+// Direct writes must cover whole blocks at block boundaries, from aligned
+// memory, so appended data is gathered in an aligned buffer and written out
+// when the buffer fills.  Sync() and Close() also write the partial block at
+// the end, padded with zeros, and then truncate the file to the size of the
+// data; the padding is overwritten once the block fills up.
+//
+// Instances of this class are thread-friendly but not thread-safe, as required
+// by the WritableFile API.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // Takes ownership of |fd| and of |buffer|, which holds
+  // kWritableFileBufferSize bytes and comes from NewAlignedBuffer().
+  PosixDirectWritableFile(std::string filename, int fd, char* buffer)
+      : buf_(buffer),
+        pos_(0),
+        offset_(0),
+        fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      size_t copy_size = std::min(write_size, kWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kWritableFileBufferSize) {
+        Status status = WriteBlocks(pos_);
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteTail();
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  // Direct writes go to the device before they return, so writing out the
+  // buffer here would turn every Flush() into a small synchronous write.
+  Status Flush() override { return Status::OK(); }
+
+  Status Sync() override {
+    Status status = WriteTail();
+    if (!status.ok()) {
+      return status;
+    }
+    return SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Writes buf_[0, size - 1], which is made of whole blocks, at offset_, and
+  // removes it from the buffer.
+  Status WriteBlocks(size_t size) {
+    assert(size % kDirectIOAlignment == 0);
+    Status status = WriteAt(buf_, size, offset_);
+    if (status.ok()) {
+      std::memmove(buf_, buf_ + size, pos_ - size);
+      pos_ -= size;
+      offset_ += size;
+    }
+    return status;
+  }
+
+  // Writes all of the buffer, and leaves the file the size of the data
+  // appended so far.  The partial block at the end stays in the buffer.
+  Status WriteTail() {
+    Status status = WriteBlocks(pos_ - pos_ % kDirectIOAlignment);
+    if (!status.ok() || pos_ == 0) {
+      return status;
+    }
+    std::memset(buf_ + pos_, 0, kDirectIOAlignment - pos_);
+    status = WriteAt(buf_, kDirectIOAlignment, offset_);
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    return status;
+  }
+
+  Status WriteAt(const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+      ssize_t write_result =
+          ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+      if (write_result < 0) {
+        if (errno == EINTR || (errno == EINVAL && DisableDirectIO(fd_))) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      data += write_result;
+      size -= write_result;
+      offset += write_result;
+    }
+    return Status::OK();
+  }
+
+  // buf_[0, pos_ - 1] contains data to be written to fd_ at offset_, which is
+  // a multiple of kDirectIOAlignment.
+  char* const buf_;
+  size_t pos_;
+  uint64_t offset_;
+  int fd_;
+
+  const std::string filename_;
+};
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -596,6 +1081,52 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+    *result = nullptr;
+    int fd = -1;
+    if (kDirectIOFlag != 0) {
+      fd = ::open(filename.c_str(), O_RDONLY | kOpenBaseFlags | kDirectIOFlag);
+    }
+    if (fd < 0) {
+      if (kDirectIOFlag == 0 || errno == EINVAL) {
+        // The file system does not support direct I/O.
+        return NewRandomAccessFile(filename, result);
+      }
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_,
+                                        /*direct_io=*/true);
+    return Status::OK();
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+    *result = nullptr;
+    int fd = -1;
+    if (kDirectIOFlag != 0) {
+      fd = ::open(filename.c_str(),
+                  O_TRUNC | O_WRONLY | O_CREAT | kOpenBaseFlags | kDirectIOFlag,
+                  0644);
+    }
+    if (fd < 0) {
+      if (kDirectIOFlag == 0 || errno == EINVAL) {
+        // The file system does not support direct I/O.
+        return NewWritableFile(filename, result);
+      }
+      return PosixError(filename, errno);
+    }
+
+    char* buffer = NewAlignedBuffer(kWritableFileBufferSize);
+    if (buffer == nullptr) {
+      ::close(fd);
+      return PosixError(filename, ENOMEM);
+    }
+    *result = new PosixDirectWritableFile(filename, fd, buffer);
+    return Status::OK();
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
@@ -653,6 +1184,13 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status LinkFile(const std::string& from, const std::string& to) override {
+    if (::link(from.c_str(), to.c_str()) != 0) {
+      return PosixError(from, errno);
+    }
+    return Status::OK();
+  }
+
   Status LockFile(const std::string& filename, FileLock** lock) override {
     *lock = nullptr;
 
@@ -689,7 +1227,16 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    ScheduleWithPriority(background_work_function, background_work_arg,
+                         kLowPriority);
+  }
+
+  void ScheduleWithPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg, Priority pri) override;
+
+  void SetBackgroundThreads(int number, Priority pri) override;
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -745,12 +1292,6 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
-
   // Stores the work item data in a Schedule() call.
   //
   // Instances are constructed on the thread calling Schedule() and used on the
@@ -765,12 +1306,31 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // The threads and work queue of one priority.  All fields are guarded
+  // by background_work_mutex_.
+  struct BackgroundPool {
+    explicit BackgroundPool(port::Mutex* mu)
+        : cv(mu), started_threads(0), max_threads(1) {}
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+    port::CondVar cv;
+    int started_threads;
+    int max_threads;  // Threads to start once work is scheduled
+    std::queue<BackgroundWorkItem> queue;
+  };
+
+  BackgroundPool* Pool(Priority pri) {
+    return pri == kHighPriority ? &high_priority_pool_ : &low_priority_pool_;
+  }
+
+  void BackgroundThreadMain(BackgroundPool* pool);
+
+  static void BackgroundThreadEntryPoint(PosixEnv* env, BackgroundPool* pool) {
+    env->BackgroundThreadMain(pool);
+  }
+
+  port::Mutex background_work_mutex_;
+  BackgroundPool low_priority_pool_ GUARDED_BY(background_work_mutex_);
+  BackgroundPool high_priority_pool_ GUARDED_BY(background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -806,45 +1366,54 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : low_priority_pool_(&background_work_mutex_),
+      high_priority_pool_(&background_work_mutex_),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
-void PosixEnv::Schedule(
+void PosixEnv::ScheduleWithPriority(
     void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
+    void* background_work_arg, Priority pri) {
   background_work_mutex_.Lock();
+  BackgroundPool* pool = Pool(pri);
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+  // Start the pool's background threads, if we haven't done so already.
+  while (pool->started_threads < pool->max_threads) {
+    pool->started_threads++;
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  pool);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  // Some background thread of the pool may be waiting for work.
+  pool->cv.Signal();
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
+  pool->queue.emplace(background_work_function, background_work_arg);
+  background_work_mutex_.Unlock();
+}
+
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  background_work_mutex_.Lock();
+  BackgroundPool* pool = Pool(pri);
+  if (number > pool->max_threads) {
+    pool->max_threads = number;
+  }
   background_work_mutex_.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundThreadMain(BackgroundPool* pool) {
   while (true) {
     background_work_mutex_.Lock();
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (pool->queue.empty()) {
+      pool->cv.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!pool->queue.empty());
+    auto background_work_function = pool->queue.front().function;
+    void* background_work_arg = pool->queue.front().arg;
+    pool->queue.pop();
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
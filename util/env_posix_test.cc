@@ -6,6 +6,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -17,6 +18,7 @@
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 #if HAVE_O_CLOEXEC
@@ -181,6 +183,69 @@ class EnvPosixTest : public testing::Test {
   Env* env_;
 };
 
+TEST_F(EnvPosixTest, RunHighPriority) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool release_low = false;
+    bool low_done = false;
+    bool high_done = false;
+
+    static void BlockLow(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      while (!state->release_low) {
+        state->cvar.Wait();
+      }
+      state->low_done = true;
+      state->cvar.SignalAll();
+    }
+
+    static void RunHigh(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_done = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  // A high priority job must not queue behind a blocked low priority job.
+  env_->SetBackgroundThreads(1, Env::kHighPriority);
+  RunState state;
+  env_->ScheduleWithPriority(&RunState::BlockLow, &state, Env::kLowPriority);
+  env_->ScheduleWithPriority(&RunState::RunHigh, &state, Env::kHighPriority);
+
+  MutexLock l(&state.mu);
+  while (!state.high_done) {
+    state.cvar.Wait();
+  }
+  ASSERT_TRUE(!state.low_done);
+  state.release_low = true;
+  state.cvar.SignalAll();
+  while (!state.low_done) {
+    state.cvar.Wait();
+  }
+}
+
+TEST_F(EnvPosixTest, LinkFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  const std::string src = test_dir + "/link_src.txt";
+  const std::string target = test_dir + "/link_target.txt";
+  env_->RemoveFile(target);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "linked", src));
+
+  ASSERT_LEVELDB_OK(env_->LinkFile(src, target));
+  ASSERT_TRUE(!env_->LinkFile(src, target).ok());  // Target exists
+
+  // The link outlives the original name.
+  ASSERT_LEVELDB_OK(env_->RemoveFile(src));
+  std::string data;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, target, &data));
+  ASSERT_EQ("linked", data);
+  ASSERT_LEVELDB_OK(env_->RemoveFile(target));
+}
+
 TEST_F(EnvPosixTest, TestOpenOnRead) {
   // Write some test data to a single file that will be opened |n| times.
   std::string test_dir;
@@ -212,6 +277,132 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, Prefetch) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/prefetch.txt";
+  std::string data(100000, 'x');
+  for (size_t i = 0; i < data.size(); i += 7) {
+    data[i] = 'a' + i % 26;
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Covers memory-mapped files, files with a permanent fd and files that
+  // are opened on every read.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 1;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  char scratch[100];
+  Slice read_result;
+  for (int i = 0; i < kNumFiles; i++) {
+    // Unaligned, and partly or entirely past the end of the file.
+    ASSERT_LEVELDB_OK(files[i]->Prefetch(12345, 1 << 20));
+    ASSERT_LEVELDB_OK(files[i]->Prefetch(data.size() + 10, 100));
+    ASSERT_LEVELDB_OK(files[i]->Read(12345, 100, &read_result, scratch));
+    ASSERT_EQ(data.substr(12345, 100), read_result.ToString());
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, MultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+  std::string data(100000, 'x');
+  for (size_t i = 0; i < data.size(); i += 7) {
+    data[i] = 'a' + i % 26;
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // More reads than fit in the io_uring queue at once.
+  const int kNumReads = 100;
+  const size_t kReadSize = 1000;
+  std::vector<std::string> scratches(kNumReads, std::string(kReadSize, 0));
+  RandomAccessFile::ReadRequest requests[kNumReads];
+  for (int i = 0; i < kNumReads; i++) {
+    requests[i].offset = (i * 7919) % (data.size() - kReadSize);
+    requests[i].n = kReadSize;
+    requests[i].scratch = &scratches[i][0];
+  }
+
+  // Covers memory-mapped files, files with a permanent fd and files that
+  // are opened on every read.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 1;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(files[i]->MultiRead(requests, kNumReads));
+    for (int j = 0; j < kNumReads; j++) {
+      ASSERT_LEVELDB_OK(requests[j].status);
+      ASSERT_EQ(data.substr(requests[j].offset, kReadSize),
+                requests[j].result.ToString());
+    }
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, DirectIO) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+  std::string data;
+  for (int i = 0; data.size() < 200000; i++) {
+    data.append(std::to_string(i));
+  }
+  data.resize(200000 + 123);  // Not a whole number of blocks
+
+  // Appends of many sizes, with syncs in between that write out a partial
+  // last block, which later appends must overwrite.
+  leveldb::WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+  size_t pos = 0;
+  for (size_t n = 1; pos < data.size(); n = n * 3 + 1) {
+    n = std::min(n % 100000, data.size() - pos);
+    ASSERT_LEVELDB_OK(writable_file->Append(Slice(data.data() + pos, n)));
+    pos += n;
+    ASSERT_LEVELDB_OK(writable_file->Flush());
+    if (n % 2 == 0) {
+      ASSERT_LEVELDB_OK(writable_file->Sync());
+      uint64_t file_size;
+      ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+      ASSERT_EQ(pos, file_size);
+    }
+  }
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file, &contents));
+  ASSERT_EQ(data, contents);
+
+  // Unaligned reads, and reads that go past the end of the file.
+  leveldb::RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+  char scratch[10000];
+  Slice read_result;
+  const uint64_t offsets[] = {0, 1, 4095, 4096, 12345, data.size() - 5000,
+                              data.size() - 1, data.size(), data.size() + 10};
+  for (uint64_t offset : offsets) {
+    ASSERT_LEVELDB_OK(file->Read(offset, sizeof(scratch), &read_result,
+                                 scratch));
+    ASSERT_EQ(data.substr(std::min<uint64_t>(offset, data.size()),
+                          sizeof(scratch)),
+              read_result.ToString());
+  }
+  delete file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -0,0 +1,245 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// A binary fuse filter [Graf,Lemire 2022] with three hash functions.
+// Each key maps to one slot in each of three consecutive segments of the
+// slot array, and the fingerprints stored in those slots XOR to the
+// key's fingerprint.  Construction "peels" the keys off one at a time,
+// which succeeds with high probability when the array has ~1.13 slots
+// per key; otherwise we retry with a different seed.
+//
+// Encoding:
+//    fingerprints: ceil(slots * bits / 8) bytes, packed little-endian
+//    seed: fixed64
+//    segment_count: fixed32
+//    log2(segment_length): uint8
+//    bits: uint8
+static const size_t kTrailerSize = 8 + 4 + 1 + 1;
+static const int kMaxSegmentLengthLog = 18;
+
+static uint64_t KeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0xbc9f1d34))
+          << 32) |
+         Hash(key.data(), key.size(), 0x9ae16a3b);
+}
+
+// Finalizer from MurmurHash3: spreads the seed over all bits.
+static uint64_t Mix(uint64_t h, uint64_t seed) {
+  h += seed;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+struct Layout {
+  uint32_t segment_length_log;
+  uint32_t segment_count;
+
+  uint32_t segment_length() const { return 1u << segment_length_log; }
+  size_t slots() const {
+    return static_cast<size_t>(segment_count + 2) << segment_length_log;
+  }
+
+  void Slots(uint64_t h, uint32_t* s) const {
+    const uint64_t range = static_cast<uint64_t>(segment_count)
+                           << segment_length_log;
+    // High 64 bits of h * range, which is below 2^32.
+    const uint64_t hi =
+        ((h >> 32) * range + (((h & 0xffffffffu) * range) >> 32)) >> 32;
+    const uint32_t mask = segment_length() - 1;
+    s[0] = static_cast<uint32_t>(hi);
+    s[1] = (s[0] + segment_length()) ^ (static_cast<uint32_t>(h >> 18) & mask);
+    s[2] = (s[0] + 2 * segment_length()) ^ (static_cast<uint32_t>(h) & mask);
+  }
+};
+
+static uint32_t Fingerprint(uint64_t h, int bits) {
+  return static_cast<uint32_t>(h ^ (h >> 32)) & ((1u << bits) - 1);
+}
+
+// Reads slot "i" of a packed array.  Callers guarantee that three bytes
+// follow the last slot.
+static uint32_t ReadSlot(const char* array, size_t i, int bits) {
+  const size_t bit = i * bits;
+  return (DecodeFixed32(array + bit / 8) >> (bit % 8)) & ((1u << bits) - 1);
+}
+
+class BinaryFuseFilterPolicy : public FilterPolicy {
+ public:
+  explicit BinaryFuseFilterPolicy(int bits_per_fingerprint)
+      : bits_(std::max(1, std::min(bits_per_fingerprint, 16))) {}
+
+  const char* Name() const override { return "leveldb.BinaryFuseFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    // Duplicate keys would cancel out while peeling, so drop them.
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = KeyHash(keys[i]);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    Layout layout = InitialLayout(hashes.size());
+    std::vector<uint16_t> fingerprints;
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    if (!hashes.empty()) {
+      for (int attempt = 1; !Build(hashes, layout, seed, &fingerprints);
+           attempt++) {
+        seed = Mix(seed, attempt);
+        // Small filters may keep failing; give them more room.
+        if (attempt % 4 == 0) layout.segment_count++;
+      }
+    }
+
+    const size_t slots = hashes.empty() ? 0 : layout.slots();
+    const size_t init_size = dst->size();
+    dst->resize(init_size + (slots * bits_ + 7) / 8, 0);
+    char* array = &(*dst)[init_size];
+    for (size_t i = 0; i < slots; i++) {
+      const size_t bit = i * bits_;
+      for (int b = 0; b < bits_; b++) {
+        if (fingerprints[i] & (1u << b)) {
+          array[(bit + b) / 8] |= static_cast<char>(1 << ((bit + b) % 8));
+        }
+      }
+    }
+    PutFixed64(dst, seed);
+    PutFixed32(dst, hashes.empty() ? 0 : layout.segment_count);
+    dst->push_back(static_cast<char>(layout.segment_length_log));
+    dst->push_back(static_cast<char>(bits_));
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const size_t len = filter.size();
+    if (len == 0) return false;
+    if (len < kTrailerSize) return true;
+
+    const char* trailer = filter.data() + len - kTrailerSize;
+    Layout layout;
+    const uint64_t seed = DecodeFixed64(trailer);
+    layout.segment_count = DecodeFixed32(trailer + 8);
+    layout.segment_length_log = static_cast<uint8_t>(trailer[12]);
+    const int bits = static_cast<uint8_t>(trailer[13]);
+    if (layout.segment_count == 0) return false;  // No keys
+    if (layout.segment_length_log > kMaxSegmentLengthLog || bits < 1 ||
+        bits > 16 ||
+        (layout.slots() * bits + 7) / 8 != len - kTrailerSize) {
+      // Unknown encoding; consider it a match.
+      return true;
+    }
+
+    const uint64_t h = Mix(KeyHash(key), seed);
+    uint32_t s[3];
+    layout.Slots(h, s);
+    const char* array = filter.data();
+    return Fingerprint(h, bits) == (ReadSlot(array, s[0], bits) ^
+                                    ReadSlot(array, s[1], bits) ^
+                                    ReadSlot(array, s[2], bits));
+  }
+
+ private:
+  // Sizing rules from the paper: short segments and extra slack for small
+  // key counts, where peeling is otherwise likely to fail.
+  static Layout InitialLayout(size_t n) {
+    Layout layout;
+    const double log_n = std::log(static_cast<double>(std::max<size_t>(n, 2)));
+    layout.segment_length_log = std::min(
+        static_cast<uint32_t>(std::floor(log_n / std::log(3.33) + 2.25)),
+        static_cast<uint32_t>(kMaxSegmentLengthLog));
+    const double size_factor =
+        std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / log_n);
+    const size_t capacity = static_cast<size_t>(std::ceil(n * size_factor));
+    const size_t segments = (capacity + layout.segment_length() - 1) >>
+                            layout.segment_length_log;
+    layout.segment_count =
+        segments > 3 ? static_cast<uint32_t>(segments - 2) : 1;
+    return layout;
+  }
+
+  // Tries to assign fingerprints for "hashes" with the given seed.
+  bool Build(const std::vector<uint64_t>& hashes, const Layout& layout,
+             uint64_t seed, std::vector<uint16_t>* fingerprints) const {
+    const size_t slots = layout.slots();
+    // Number of keys in each slot and the XOR of their hashes, kept
+    // together so that updating a slot touches one cache line.
+    struct Slot {
+      uint64_t xor_hash;
+      uint32_t count;
+    };
+    std::vector<Slot> table(slots, Slot{0, 0});
+    uint32_t s[3];
+    for (uint64_t key_hash : hashes) {
+      const uint64_t h = Mix(key_hash, seed);
+      layout.Slots(h, s);
+      for (uint32_t slot : s) {
+        table[slot].count++;
+        table[slot].xor_hash ^= h;
+      }
+    }
+
+    // Repeatedly remove a key that is alone in one of its slots.  The
+    // XOR of the hashes in a slot then is the hash of that key.
+    std::vector<uint32_t> singles;
+    for (size_t i = 0; i < slots; i++) {
+      if (table[i].count == 1) singles.push_back(static_cast<uint32_t>(i));
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> peeled;
+    peeled.reserve(hashes.size());
+    while (!singles.empty()) {
+      const uint32_t i = singles.back();
+      singles.pop_back();
+      if (table[i].count != 1) continue;
+      const uint64_t h = table[i].xor_hash;
+      peeled.emplace_back(h, i);
+      layout.Slots(h, s);
+      for (uint32_t slot : s) {
+        table[slot].count--;
+        table[slot].xor_hash ^= h;
+        if (table[slot].count == 1) singles.push_back(slot);
+      }
+    }
+    if (peeled.size() != hashes.size()) return false;
+
+    // In reverse peeling order, each key's own slot is still free and
+    // can be set so that its three slots XOR to its fingerprint.
+    fingerprints->assign(slots, 0);
+    for (size_t k = peeled.size(); k > 0; k--) {
+      const uint64_t h = peeled[k - 1].first;
+      layout.Slots(h, s);
+      (*fingerprints)[peeled[k - 1].second] = static_cast<uint16_t>(
+          Fingerprint(h, bits_) ^ (*fingerprints)[s[0]] ^
+          (*fingerprints)[s[1]] ^ (*fingerprints)[s[2]]);
+    }
+    return true;
+  }
+
+  const int bits_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewBinaryFuseFilterPolicy(int bits_per_fingerprint) {
+  return new BinaryFuseFilterPolicy(bits_per_fingerprint);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,331 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() = default;
+
+namespace {
+
+// File-based persistent cache
+//
+// Records are appended to an in-memory buffer for the current cache
+// file.  Once the buffer reaches the file size, the file is written out
+// in one piece and read back with a RandomAccessFile from then on, so
+// that files on disk are never modified.  Each record is
+//    crc: fixed32, masked crc32c of the rest of the record
+//    key length: varint32
+//    data length: varint32
+//    key: char[key length]
+//    data: char[data length]
+// The in-memory index maps each key to its file, offset and size.
+// Eviction deletes whole files, the least recently used one first.
+static const char kFileSuffix[] = ".pcache";
+
+struct CacheFile {
+  explicit CacheFile(uint64_t number)
+      : number(number), refs(1), last_use(0), file(nullptr) {}
+
+  const uint64_t number;
+  int refs;  // One for the cache while the file is not evicted
+  uint64_t last_use;
+  std::string buffer;      // The records, until "file" is set
+  RandomAccessFile* file;  // Set once the records are on disk
+  std::vector<std::string> keys;
+};
+
+struct Location {
+  CacheFile* file;
+  uint64_t offset;
+  size_t size;
+};
+
+class FilePersistentCache : public PersistentCache {
+ public:
+  FilePersistentCache(Env* env, const std::string& dir, uint64_t capacity)
+      : env_(env),
+        dir_(dir),
+        capacity_(capacity),
+        file_size_(std::max<uint64_t>(
+            std::min<uint64_t>(capacity / 8, 4 << 20), 4 << 10)),
+        next_file_number_(1),
+        clock_(0),
+        last_id_(0),
+        current_(nullptr) {
+    stats_.lookups = 0;
+    stats_.hits = 0;
+    stats_.inserts = 0;
+    stats_.usage = 0;
+  }
+
+  ~FilePersistentCache() override {
+    MutexLock l(&mutex_);
+    for (CacheFile* f : files_) {
+      Unref(f);
+    }
+  }
+
+  // Prepares the cache directory.
+  Status Init();
+
+  Status Insert(const Slice& key, const Slice& data) override;
+  Status Lookup(const Slice& key, std::string* data) override;
+
+  uint64_t NewId() override {
+    MutexLock l(&mutex_);
+    return ++last_id_;
+  }
+
+  Stats GetStats() const override {
+    MutexLock l(&mutex_);
+    return stats_;
+  }
+
+ private:
+  std::string FileName(uint64_t number) const {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu%s",
+                  static_cast<unsigned long long>(number), kFileSuffix);
+    return dir_ + buf;
+  }
+
+  // Writes out the records of a full file and opens it for reading.
+  Status WriteFile(CacheFile* f, RandomAccessFile** file);
+
+  // Drops the file and its index entries from the cache.
+  void Evict(CacheFile* f) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Unref(CacheFile* f) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  Env* const env_;
+  const std::string dir_;
+  const uint64_t capacity_;
+  const uint64_t file_size_;
+
+  mutable port::Mutex mutex_;
+  uint64_t next_file_number_ GUARDED_BY(mutex_);
+  uint64_t clock_ GUARDED_BY(mutex_);  // Ticks on every use of a file
+  uint64_t last_id_ GUARDED_BY(mutex_);
+  CacheFile* current_ GUARDED_BY(mutex_);  // Receives new records
+  std::vector<CacheFile*> files_ GUARDED_BY(mutex_);  // Not yet evicted
+  std::unordered_map<std::string, Location> index_ GUARDED_BY(mutex_);
+  Stats stats_ GUARDED_BY(mutex_);
+};
+
+Status FilePersistentCache::Init() {
+  env_->CreateDir(dir_);  // Ignore error, the directory may exist
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(dir_, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  const Slice suffix(kFileSuffix);
+  for (const std::string& child : children) {
+    if (child.size() > suffix.size() &&
+        Slice(child.data() + child.size() - suffix.size(), suffix.size()) ==
+            suffix) {
+      env_->RemoveFile(dir_ + "/" + child);
+    }
+  }
+  return Status::OK();
+}
+
+static bool ParseRecord(Slice record, const Slice& key, std::string* data) {
+  if (record.size() < 4) {
+    return false;
+  }
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(record.data()));
+  record.remove_prefix(4);
+  uint32_t key_length, data_length;
+  if (crc32c::Value(record.data(), record.size()) != crc ||
+      !GetVarint32(&record, &key_length) ||
+      !GetVarint32(&record, &data_length) ||
+      record.size() != static_cast<uint64_t>(key_length) + data_length ||
+      Slice(record.data(), key_length) != key) {
+    return false;
+  }
+  data->assign(record.data() + key_length, data_length);
+  return true;
+}
+
+Status FilePersistentCache::Insert(const Slice& key, const Slice& data) {
+  std::string record(4, '\0');
+  PutVarint32(&record, key.size());
+  PutVarint32(&record, data.size());
+  record.append(key.data(), key.size());
+  record.append(data.data(), data.size());
+  EncodeFixed32(&record[0], crc32c::Mask(crc32c::Value(record.data() + 4,
+                                                       record.size() - 4)));
+
+  CacheFile* full = nullptr;
+  {
+    MutexLock l(&mutex_);
+    std::string key_string = key.ToString();
+    if (record.size() > capacity_ || index_.count(key_string) > 0) {
+      return Status::OK();
+    }
+    if (current_ == nullptr) {
+      current_ = new CacheFile(next_file_number_++);
+      files_.push_back(current_);
+    }
+    index_[key_string] = Location{current_, current_->buffer.size(),
+                                  record.size()};
+    current_->buffer.append(record);
+    current_->keys.push_back(std::move(key_string));
+    current_->last_use = ++clock_;
+    stats_.inserts++;
+    stats_.usage += record.size();
+    if (current_->buffer.size() >= file_size_) {
+      // The buffer no longer changes, so it can be written out without
+      // holding the lock.
+      full = current_;
+      full->refs++;
+      current_ = nullptr;
+    }
+
+    while (stats_.usage > capacity_) {
+      CacheFile* victim = nullptr;
+      for (CacheFile* f : files_) {
+        if (f != current_ &&
+            (victim == nullptr || f->last_use < victim->last_use)) {
+          victim = f;
+        }
+      }
+      if (victim == nullptr) {
+        break;
+      }
+      Evict(victim);
+    }
+  }
+
+  Status s;
+  if (full != nullptr) {
+    RandomAccessFile* file;
+    s = WriteFile(full, &file);
+    MutexLock l(&mutex_);
+    if (s.ok()) {
+      full->file = file;
+      std::string().swap(full->buffer);
+    } else if (std::find(files_.begin(), files_.end(), full) !=
+               files_.end()) {
+      Evict(full);
+    }
+    Unref(full);
+  }
+  return s;
+}
+
+Status FilePersistentCache::Lookup(const Slice& key, std::string* data) {
+  MutexLock l(&mutex_);
+  stats_.lookups++;
+  auto it = index_.find(key.ToString());
+  if (it == index_.end()) {
+    return Status::NotFound(Slice());
+  }
+  const Location loc = it->second;
+  CacheFile* f = loc.file;
+  f->last_use = ++clock_;
+
+  bool found;
+  if (f->file == nullptr) {
+    found = ParseRecord(Slice(f->buffer.data() + loc.offset, loc.size), key,
+                        data);
+  } else {
+    // Read without holding the lock; the reference keeps the file open.
+    f->refs++;
+    mutex_.Unlock();
+    char* scratch = new char[loc.size];
+    Slice record;
+    Status s = f->file->Read(loc.offset, loc.size, &record, scratch);
+    found = s.ok() && ParseRecord(record, key, data);
+    delete[] scratch;
+    mutex_.Lock();
+    Unref(f);
+  }
+  if (!found) {
+    return Status::Corruption("bad persistent cache record");
+  }
+  stats_.hits++;
+  return Status::OK();
+}
+
+Status FilePersistentCache::WriteFile(CacheFile* f, RandomAccessFile** file) {
+  const std::string fname = FileName(f->number);
+  WritableFile* out;
+  Status s = env_->NewWritableFile(fname, &out);
+  if (!s.ok()) {
+    return s;
+  }
+  s = out->Append(f->buffer);
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, file);
+  }
+  if (!s.ok()) {
+    env_->RemoveFile(fname);
+  }
+  return s;
+}
+
+void FilePersistentCache::Evict(CacheFile* f) {
+  for (const std::string& key : f->keys) {
+    auto it = index_.find(key);
+    if (it != index_.end() && it->second.file == f) {
+      stats_.usage -= it->second.size;
+      index_.erase(it);
+    }
+  }
+  files_.erase(std::find(files_.begin(), files_.end(), f));
+  if (f == current_) {
+    current_ = nullptr;
+  }
+  Unref(f);
+}
+
+void FilePersistentCache::Unref(CacheFile* f) {
+  assert(f->refs > 0);
+  if (--f->refs == 0) {
+    if (f->file != nullptr) {
+      delete f->file;
+      env_->RemoveFile(FileName(f->number));
+    }
+    delete f;
+  }
+}
+
+}  // namespace
+
+Status NewFilePersistentCache(Env* env, const std::string& dir,
+                              uint64_t capacity, PersistentCache** result) {
+  *result = nullptr;
+  FilePersistentCache* cache = new FilePersistentCache(env, dir, capacity);
+  Status s = cache->Init();
+  if (!s.ok()) {
+    delete cache;
+    return s;
+  }
+  *result = cache;
+  return s;
+}
+
+}  // namespace leveldb
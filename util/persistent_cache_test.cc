@@ -0,0 +1,157 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[20];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+static std::string Value(int i) { return std::string(1000, 'a' + i % 26); }
+
+// Runs each test against an in-memory Env and the default Env.
+class PersistentCacheTest : public testing::TestWithParam<bool> {
+ public:
+  PersistentCacheTest()
+      : mem_env_(GetParam() ? NewMemEnv(Env::Default()) : nullptr),
+        env_(GetParam() ? mem_env_ : Env::Default()),
+        cache_(nullptr) {
+    env_->GetTestDirectory(&dir_);
+    dir_ += "/persistent_cache_test";
+    env_->CreateDir(dir_);
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    std::vector<std::string> children;
+    env_->GetChildren(dir_, &children);
+    for (const std::string& child : children) {
+      env_->RemoveFile(dir_ + "/" + child);
+    }
+    env_->RemoveDir(dir_);
+    delete mem_env_;
+  }
+
+  void Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = nullptr;
+    ASSERT_LEVELDB_OK(NewFilePersistentCache(env_, dir_, capacity, &cache_));
+  }
+
+  void Insert(int i) { ASSERT_LEVELDB_OK(cache_->Insert(Key(i), Value(i))); }
+
+  bool Contains(int i) {
+    std::string data;
+    Status s = cache_->Lookup(Key(i), &data);
+    EXPECT_TRUE(s.ok() || s.IsNotFound()) << s.ToString();
+    if (s.ok()) {
+      EXPECT_EQ(Value(i), data);
+    }
+    return s.ok();
+  }
+
+  int NumCacheFiles() {
+    std::vector<std::string> children;
+    EXPECT_LEVELDB_OK(env_->GetChildren(dir_, &children));
+    int count = 0;
+    for (const std::string& child : children) {
+      if (child.find(".pcache") != std::string::npos) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  Env* mem_env_;
+  Env* env_;
+  std::string dir_;
+  PersistentCache* cache_;
+};
+
+INSTANTIATE_TEST_SUITE_P(Envs, PersistentCacheTest, testing::Bool());
+
+TEST_P(PersistentCacheTest, InsertAndLookup) {
+  Open(1 << 20);
+  ASSERT_TRUE(!Contains(1));
+  Insert(1);
+  Insert(2);
+  ASSERT_TRUE(Contains(1));
+  ASSERT_TRUE(Contains(2));
+  ASSERT_TRUE(!Contains(3));
+
+  // Inserting a key again keeps the first copy.
+  ASSERT_LEVELDB_OK(cache_->Insert(Key(1), "other"));
+  ASSERT_TRUE(Contains(1));
+
+  PersistentCache::Stats stats = cache_->GetStats();
+  ASSERT_EQ(5, stats.lookups);
+  ASSERT_EQ(3, stats.hits);
+  ASSERT_EQ(2, stats.inserts);
+  ASSERT_GT(stats.usage, 2 * Value(1).size());
+}
+
+TEST_P(PersistentCacheTest, ReadsFromFiles) {
+  Open(2 << 20);  // 256KB files
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    Insert(i);
+  }
+  ASSERT_EQ(N, cache_->GetStats().inserts);
+  ASSERT_GE(NumCacheFiles(), 3);
+  for (int i = 0; i < N; i++) {
+    ASSERT_TRUE(Contains(i)) << i;
+  }
+
+  // The files go away with the cache.
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_EQ(0, NumCacheFiles());
+}
+
+TEST_P(PersistentCacheTest, EvictsLeastRecentlyUsedFile) {
+  Open(64 << 10);  // 8KB files
+  for (int i = 0; i < 40; i++) {
+    Insert(i);
+  }
+  for (int i = 40; i < 100; i++) {
+    ASSERT_TRUE(Contains(0));  // Keeps the first file in use
+    Insert(i);
+  }
+  ASSERT_LE(cache_->GetStats().usage, 64 << 10);
+  ASSERT_TRUE(Contains(0));
+  ASSERT_TRUE(!Contains(10));
+  ASSERT_TRUE(Contains(99));
+  ASSERT_LE(NumCacheFiles(), 9);
+}
+
+TEST_P(PersistentCacheTest, RemovesStaleFiles) {
+  ASSERT_LEVELDB_OK(
+      WriteStringToFile(env_, "stale", dir_ + "/000001.pcache"));
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "other", dir_ + "/other"));
+  Open(1 << 20);
+  ASSERT_EQ(0, NumCacheFiles());
+  ASSERT_TRUE(env_->FileExists(dir_ + "/other"));
+}
+
+TEST_P(PersistentCacheTest, NewId) {
+  Open(1 << 20);
+  const uint64_t a = cache_->NewId();
+  const uint64_t b = cache_->NewId();
+  ASSERT_NE(a, b);
+}
+
+}  // namespace leveldb
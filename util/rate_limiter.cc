@@ -0,0 +1,212 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+namespace {
+
+// Token bucket refilled once per period.  Requests that do not fit in the
+// current bucket queue up by priority; the oldest waiting request acts as
+// the "leader" that sleeps until the next refill and then hands out the
+// new budget, so at most one thread polls the clock at a time.
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t bytes_per_second, int64_t refill_period_micros,
+                     Env* env)
+      : env_(env),
+        refill_period_micros_(std::max<int64_t>(refill_period_micros, 1)),
+        bytes_per_second_(0),
+        refill_bytes_per_period_(0),
+        available_bytes_(0),
+        next_refill_micros_(0),
+        leader_(nullptr) {
+    total_bytes_through_[Env::kLowPriority] = 0;
+    total_bytes_through_[Env::kHighPriority] = 0;
+    SetBytesPerSecond(bytes_per_second);
+  }
+
+  ~GenericRateLimiter() override {
+    MutexLock l(&mu_);
+    assert(queue_[Env::kLowPriority].empty());
+    assert(queue_[Env::kHighPriority].empty());
+  }
+
+  void SetBytesPerSecond(int64_t bytes_per_second) override {
+    MutexLock l(&mu_);
+    bytes_per_second_ = std::max<int64_t>(bytes_per_second, 1);
+    refill_bytes_per_period_ = std::max<int64_t>(
+        bytes_per_second_ * refill_period_micros_ / 1000000, 1);
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return bytes_per_second_;
+  }
+
+  int64_t GetTotalBytesThrough(Env::Priority priority) const override {
+    MutexLock l(&mu_);
+    return total_bytes_through_[priority];
+  }
+
+  void Request(int64_t bytes, Env::Priority priority) override {
+    MutexLock l(&mu_);
+    while (bytes > 0) {
+      // Large requests are granted piecewise so that a single compaction
+      // write cannot hold up a flush for many periods.
+      const int64_t chunk = std::min(bytes, refill_bytes_per_period_);
+      bytes -= chunk;
+
+      MaybeRefill(env_->NowMicros());
+      if (queue_[Env::kHighPriority].empty() &&
+          queue_[Env::kLowPriority].empty() && available_bytes_ >= chunk) {
+        available_bytes_ -= chunk;
+        total_bytes_through_[priority] += chunk;
+        continue;
+      }
+
+      Req req(chunk, &mu_);
+      queue_[priority].push_back(&req);
+      while (!req.granted) {
+        if (leader_ == nullptr) {
+          leader_ = &req;
+          const uint64_t now = env_->NowMicros();
+          if (now < next_refill_micros_) {
+            mu_.Unlock();
+            env_->SleepForMicroseconds(
+                static_cast<int>(next_refill_micros_ - now));
+            mu_.Lock();
+          }
+          MaybeRefill(env_->NowMicros());
+          leader_ = nullptr;
+          if (req.granted) {
+            // Let the next waiter take over sleeping until the refill.
+            Req* next = NextWaiter();
+            if (next != nullptr) {
+              next->cv.Signal();
+            }
+          }
+        } else {
+          req.cv.Wait();
+        }
+      }
+      total_bytes_through_[priority] += chunk;
+    }
+  }
+
+ private:
+  struct Req {
+    Req(int64_t bytes, port::Mutex* mu)
+        : bytes(bytes), granted(false), cv(mu) {}
+
+    const int64_t bytes;
+    bool granted;
+    port::CondVar cv;
+  };
+
+  Req* NextWaiter() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (!queue_[Env::kHighPriority].empty()) {
+      return queue_[Env::kHighPriority].front();
+    }
+    if (!queue_[Env::kLowPriority].empty()) {
+      return queue_[Env::kLowPriority].front();
+    }
+    return nullptr;
+  }
+
+  // Start a new period if the current one is over and grant as many
+  // queued requests from it as possible, high priority first.
+  void MaybeRefill(uint64_t now) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (now < next_refill_micros_) {
+      return;
+    }
+    next_refill_micros_ = now + refill_period_micros_;
+    // Unused budget does not carry over, but debt from a request that was
+    // granted before the limit was lowered does.
+    available_bytes_ = std::min<int64_t>(available_bytes_, 0) +
+                       refill_bytes_per_period_;
+
+    const Env::Priority order[] = {Env::kHighPriority, Env::kLowPriority};
+    for (Env::Priority pri : order) {
+      std::deque<Req*>* queue = &queue_[pri];
+      while (!queue->empty()) {
+        Req* next = queue->front();
+        if (next->bytes > available_bytes_ &&
+            available_bytes_ < refill_bytes_per_period_) {
+          // Keep strict priority order: nothing else may overtake it.
+          return;
+        }
+        available_bytes_ -= next->bytes;
+        next->granted = true;
+        queue->pop_front();
+        if (next != leader_) {
+          next->cv.Signal();
+        }
+      }
+    }
+  }
+
+  Env* const env_;
+  const int64_t refill_period_micros_;
+
+  mutable port::Mutex mu_;
+  int64_t bytes_per_second_ GUARDED_BY(mu_);
+  int64_t refill_bytes_per_period_ GUARDED_BY(mu_);
+  // May go negative when a request larger than the bucket is granted.
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+  int64_t total_bytes_through_[2] GUARDED_BY(mu_);
+  std::deque<Req*> queue_[2] GUARDED_BY(mu_);
+  Req* leader_ GUARDED_BY(mu_);
+};
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* base, RateLimiter* limiter,
+                          Env::Priority priority)
+      : base_(base), limiter_(limiter), priority_(priority) {}
+
+  ~RateLimitedWritableFile() override { delete base_; }
+
+  Status Append(const Slice& data) override {
+    limiter_->Request(static_cast<int64_t>(data.size()), priority_);
+    return base_->Append(data);
+  }
+  Status Close() override { return base_->Close(); }
+  Status Flush() override { return base_->Flush(); }
+  Status Sync() override { return base_->Sync(); }
+
+ private:
+  WritableFile* const base_;
+  RateLimiter* const limiter_;
+  const Env::Priority priority_;
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(int64_t bytes_per_second,
+                                   int64_t refill_period_micros, Env* env) {
+  return new GenericRateLimiter(bytes_per_second, refill_period_micros, env);
+}
+
+WritableFile* NewRateLimitedWritableFile(WritableFile* base,
+                                         RateLimiter* limiter,
+                                         Env::Priority priority) {
+  if (limiter == nullptr) {
+    return base;
+  }
+  return new RateLimitedWritableFile(base, limiter, priority);
+}
+
+}  // namespace leveldb
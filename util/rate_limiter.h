@@ -0,0 +1,22 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+// Return a WritableFile that passes every Append() through
+// "limiter->Request(size, priority)" before handing it to "base".  The
+// result owns "base".  If "limiter" is null, "base" is returned as is.
+WritableFile* NewRateLimitedWritableFile(WritableFile* base,
+                                         RateLimiter* limiter,
+                                         Env::Priority priority);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
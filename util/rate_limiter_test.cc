@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+// Env whose clock only advances when somebody sleeps.
+class FakeClockEnv : public EnvWrapper {
+ public:
+  FakeClockEnv() : EnvWrapper(Env::Default()), now_micros_(1000000) {}
+
+  uint64_t NowMicros() override { return now_micros_; }
+  void SleepForMicroseconds(int micros) override { now_micros_ += micros; }
+
+  uint64_t now_micros_;
+};
+
+TEST(RateLimiterTest, BytesPerSecond) {
+  FakeClockEnv env;
+  RateLimiter* limiter = NewGenericRateLimiter(1000000, 1000, &env);
+  ASSERT_EQ(1000000, limiter->GetBytesPerSecond());
+  limiter->SetBytesPerSecond(2000000);
+  ASSERT_EQ(2000000, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+TEST(RateLimiterTest, Throttles) {
+  FakeClockEnv env;
+  // 1000 bytes per 1ms period.
+  RateLimiter* limiter = NewGenericRateLimiter(1000000, 1000, &env);
+  const uint64_t start = env.now_micros_;
+  for (int i = 0; i < 100; i++) {
+    limiter->Request(500, Env::kLowPriority);
+  }
+  // 50000 bytes need 50 periods, the first of which is free.
+  ASSERT_GE(env.now_micros_ - start, 49000);
+  ASSERT_LE(env.now_micros_ - start, 50000);
+  ASSERT_EQ(50000, limiter->GetTotalBytesThrough(Env::kLowPriority));
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::kHighPriority));
+
+  // Requests larger than the bucket are split up rather than stuck.
+  limiter->Request(10000, Env::kHighPriority);
+  ASSERT_EQ(10000, limiter->GetTotalBytesThrough(Env::kHighPriority));
+  delete limiter;
+}
+
+TEST(RateLimiterTest, ChangeRate) {
+  FakeClockEnv env;
+  RateLimiter* limiter = NewGenericRateLimiter(1000000, 1000, &env);
+  uint64_t start = env.now_micros_;
+  limiter->Request(100000, Env::kLowPriority);
+  const uint64_t slow = env.now_micros_ - start;
+
+  limiter->SetBytesPerSecond(10000000);
+  start = env.now_micros_;
+  limiter->Request(100000, Env::kLowPriority);
+  const uint64_t fast = env.now_micros_ - start;
+  ASSERT_LT(fast * 5, slow);
+  delete limiter;
+}
+
+}  // namespace leveldb